@@ -869,6 +869,23 @@ void TriggerStage::add_match(shared_ptr<Channel> channel,
 	add_match(move(channel), type, NAN);
 }
 
+const TriggerDuration *TriggerStage::duration() const
+{
+	return TriggerDuration::get(_structure->duration);
+}
+
+uint64_t TriggerStage::duration_samples() const
+{
+	return _structure->duration_samples;
+}
+
+void TriggerStage::set_duration(const TriggerDuration *duration,
+	uint64_t samples)
+{
+	check(sr_trigger_stage_duration_set(_structure,
+		duration->id(), samples));
+}
+
 TriggerMatch::TriggerMatch(struct sr_trigger_match *structure,
 		shared_ptr<Channel> channel) :
 	_structure(structure),
@@ -1644,7 +1661,8 @@ Output::Output(shared_ptr<OutputFormat> format,
 		map_to_hash_variant(options), device->_structure, nullptr)),
 	_format(move(format)),
 	_device(move(device)),
-	_options(move(options))
+	_options(move(options)),
+	_buffer(g_string_sized_new(512))
 {
 }
 
@@ -1654,12 +1672,14 @@ Output::Output(string filename, shared_ptr<OutputFormat> format,
 		map_to_hash_variant(options), device->_structure, filename.c_str())),
 	_format(move(format)),
 	_device(move(device)),
-	_options(move(options))
+	_options(move(options)),
+	_buffer(g_string_sized_new(512))
 {
 }
 
 Output::~Output()
 {
+	g_string_free(_buffer, true);
 	check(sr_output_free(_structure));
 }
 
@@ -1670,15 +1690,16 @@ shared_ptr<OutputFormat> Output::format()
 
 string Output::receive(shared_ptr<Packet> packet)
 {
-	GString *out;
-	check(sr_output_send(_structure, packet->_structure, &out));
-	if (out) {
-		auto result = string(out->str, out->str + out->len);
-		g_string_free(out, true);
-		return result;
-	} else {
-		return string();
-	}
+	string result;
+	receive(move(packet), result);
+	return result;
+}
+
+void Output::receive(shared_ptr<Packet> packet, string &buffer)
+{
+	g_string_truncate(_buffer, 0);
+	check(sr_output_send_into(_structure, packet->_structure, _buffer));
+	buffer.append(_buffer->str, _buffer->len);
 }
 
 #include <enums.cpp>
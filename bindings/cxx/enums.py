@@ -44,6 +44,7 @@ mapping = dict([
     ('sr_datatype', ('DataType', 'Configuration data type')),
     ('sr_channeltype', ('ChannelType', 'Channel type')),
     ('sr_trigger_matches', ('TriggerMatchType', 'Trigger match type')),
+    ('sr_trigger_durations', ('TriggerDuration', 'Trigger stage duration qualifier')),
     ('sr_output_flag', ('OutputFlag', 'Flag applied to output modules'))])
 
 index = ElementTree.parse(index_file)
@@ -106,6 +106,7 @@ class SR_API Trigger;
 class SR_API TriggerStage;
 class SR_API TriggerMatch;
 class SR_API TriggerMatchType;
+class SR_API TriggerDuration;
 class SR_API ChannelType;
 class SR_API Packet;
 class SR_API PacketPayload;
@@ -541,6 +542,14 @@ public:
 	 * @param type TriggerMatchType to apply.
 	 * @param value Threshold value. */
 	void add_match(std::shared_ptr<Channel> channel, const TriggerMatchType *type, float value);
+	/** Duration qualifier of this stage. */
+	const TriggerDuration *duration() const;
+	/** Number of samples for the duration qualifier. */
+	uint64_t duration_samples() const;
+	/** Set a duration qualifier on this stage.
+	 * @param duration TriggerDuration to apply.
+	 * @param samples Number of samples the qualifier refers to. */
+	void set_duration(const TriggerDuration *duration, uint64_t samples);
 private:
 	struct sr_trigger_stage *_structure;
 	std::vector<std::unique_ptr<TriggerMatch> > _matches;
@@ -1014,6 +1023,11 @@ public:
 	/** Update output with data from the given packet.
 	 * @param packet Packet to handle. */
 	std::string receive(std::shared_ptr<Packet> packet);
+	/** Update output with data from the given packet, appending the
+	 * output to a caller provided buffer which can be reused.
+	 * @param packet Packet to handle.
+	 * @param buffer String to append the output to. */
+	void receive(std::shared_ptr<Packet> packet, std::string &buffer);
 	/** Output format in use for this output */
 	std::shared_ptr<OutputFormat> format();
 private:
@@ -1028,6 +1042,7 @@ private:
 	const std::shared_ptr<OutputFormat> _format;
 	const std::shared_ptr<Device> _device;
 	const std::map<std::string, Glib::VariantBase> _options;
+	GString *_buffer;
 
 	friend class OutputFormat;
 	friend struct std::default_delete<Output>;
@@ -80,6 +80,7 @@ template< class T > class enable_shared_from_this;
 #define SR_PRIV
 
 %ignore sigrok::DatafeedCallbackData;
+%ignore sigrok::Output::receive(std::shared_ptr<sigrok::Packet>, std::string &);
 
 #ifndef SWIGJAVA
 
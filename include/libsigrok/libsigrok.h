@@ -402,6 +402,19 @@ enum sr_trigger_matches {
 	SR_TRIGGER_UNDER,
 };
 
+/** Duration qualifiers for a trigger stage. */
+enum sr_trigger_durations {
+	/** No qualifier, the stage matches on a single sample. */
+	SR_TRIGGER_DURATION_NONE = 0,
+	/** The stage's conditions must hold for at least N samples. */
+	SR_TRIGGER_DURATION_AT_LEAST,
+	/**
+	 * The stage's conditions must hold for less than N samples. The
+	 * stage matches on the first sample after such a short pulse.
+	 */
+	SR_TRIGGER_DURATION_LESS_THAN,
+};
+
 /** The representation of a trigger, consisting of one or more stages
  * containing one or more matches on a channel.
  */
@@ -418,6 +431,10 @@ struct sr_trigger_stage {
 	int stage;
 	/** List of pointers to struct sr_trigger_match. */
 	GSList *matches;
+	/** Duration qualifier, one of enum sr_trigger_durations. */
+	int duration;
+	/** Number of samples for the duration qualifier. */
+	uint64_t duration_samples;
 };
 
 /** A channel to match and what to match it on. */
@@ -1057,6 +1074,12 @@ enum sr_configkey {
 	/** Number of powerline cycles for ADC integration time. */
 	SR_CONF_ADC_POWERLINE_CYCLES,
 
+	/**
+	 * The device supports replaying a sample range [start, end) of
+	 * its capturefile.
+	 */
+	SR_CONF_CAPTURE_RANGE,
+
 	/* Update sr_key_info_config[] (hwdriver.c) upon changes! */
 
 	/*--- Acquisition modes, sample limiting ----------------------------*/
@@ -131,6 +131,8 @@ SR_API struct sr_trigger *sr_session_trigger_get(struct sr_session *session);
 /* Session setup */
 SR_API int sr_session_load(struct sr_context *ctx, const char *filename,
 	struct sr_session **session);
+SR_API int sr_session_range_set(struct sr_session *session,
+	uint64_t start, uint64_t end);
 SR_API int sr_session_new(struct sr_context *ctx, struct sr_session **session);
 SR_API int sr_session_destroy(struct sr_session *session);
 SR_API int sr_session_dev_remove_all(struct sr_session *session);
@@ -176,6 +178,8 @@ SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in);
 SR_API const struct sr_input_module *sr_input_module_get(const struct sr_input *in);
 SR_API struct sr_dev_inst *sr_input_dev_inst_get(const struct sr_input *in);
 SR_API int sr_input_send(const struct sr_input *in, GString *buf);
+SR_API int sr_input_send_mapped(const struct sr_input *in,
+		const char *filename);
 SR_API int sr_input_end(const struct sr_input *in);
 SR_API int sr_input_reset(const struct sr_input *in);
 SR_API void sr_input_free(const struct sr_input *in);
@@ -194,10 +198,15 @@ SR_API void sr_output_options_free(const struct sr_option **opts);
 SR_API const struct sr_output *sr_output_new(const struct sr_output_module *omod,
 		GHashTable *params, const struct sr_dev_inst *sdi,
 		const char *filename);
+SR_API const struct sr_output *sr_output_new_file(
+		const struct sr_output_module *omod, GHashTable *options,
+		const struct sr_dev_inst *sdi, const char *filename);
 SR_API gboolean sr_output_test_flag(const struct sr_output_module *omod,
 		uint64_t flag);
 SR_API int sr_output_send(const struct sr_output *o,
 		const struct sr_datafeed_packet *packet, GString **out);
+SR_API int sr_output_send_into(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *out);
 SR_API int sr_output_free(const struct sr_output *o);
 
 /*--- transform/transform.c -------------------------------------------------*/
@@ -220,6 +229,8 @@ SR_API void sr_trigger_free(struct sr_trigger *trig);
 SR_API struct sr_trigger_stage *sr_trigger_stage_add(struct sr_trigger *trig);
 SR_API int sr_trigger_match_add(struct sr_trigger_stage *stage,
 		struct sr_channel *ch, int trigger_match, float value);
+SR_API int sr_trigger_stage_duration_set(struct sr_trigger_stage *stage,
+		int duration, uint64_t samples);
 
 /*--- serial.c --------------------------------------------------------------*/
 
@@ -154,6 +154,37 @@ SR_PRIV int sr_analog_init(struct sr_datafeed_analog *analog,
 	return SR_OK;
 }
 
+/** @cond PRIVATE */
+static inline uint16_t load_u16(const uint8_t *p)
+{
+	uint16_t value;
+
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline uint32_t load_u32(const uint8_t *p)
+{
+	uint32_t value;
+
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+/*
+ * Loop over all values, with the given expression reading value i.
+ * The loops have no branches and plain loads, so that compilers can
+ * turn them into vector code.
+ */
+#define CONVERT_LOOP(read) \
+	do { \
+		for (i = 0; i < count; i++) { \
+			outbuf[i] = scale * (read); \
+			outbuf[i] += offset; \
+		} \
+	} while (0)
+/** @endcond */
+
 /**
  * Convert an analog datafeed payload to an array of floats.
  *
@@ -174,8 +205,12 @@ SR_PRIV int sr_analog_init(struct sr_datafeed_analog *analog,
 SR_API int sr_analog_to_float(const struct sr_datafeed_analog *analog,
 		float *outbuf)
 {
-	unsigned int b, count;
-	gboolean bigendian;
+	unsigned int count, i;
+	gboolean bigendian, swap;
+	const uint8_t *raw;
+	uint64_t tmp64;
+	double dval;
+	float scale, offset;
 
 	if (!analog || !(analog->data) || !(analog->meaning)
 			|| !(analog->encoding) || !outbuf)
@@ -189,74 +224,46 @@ SR_API int sr_analog_to_float(const struct sr_datafeed_analog *analog,
 	bigendian = FALSE;
 #endif
 
+	offset = analog->encoding->offset.p / (float)analog->encoding->offset.q;
+
+	raw = analog->data;
+	swap = analog->encoding->is_bigendian != bigendian;
+
 	if (!analog->encoding->is_float) {
-		float offset = analog->encoding->offset.p / (float)analog->encoding->offset.q;
-		float scale = analog->encoding->scale.p / (float)analog->encoding->scale.q;
-		gboolean is_signed = analog->encoding->is_signed;
-		gboolean is_bigendian = analog->encoding->is_bigendian;
-		int8_t *data8 = (int8_t *)(analog->data);
-		int16_t *data16 = (int16_t *)(analog->data);
-		int32_t *data32 = (int32_t *)(analog->data);
-
-		switch (analog->encoding->unitsize) {
-		case 1:
-			if (is_signed) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * data8[i];
-					outbuf[i] += offset;
-				}
-			} else {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * R8(data8 + i);
-					outbuf[i] += offset;
-				}
-			}
+		scale = analog->encoding->scale.p / (float)analog->encoding->scale.q;
+		switch (analog->encoding->unitsize * 4
+				+ analog->encoding->is_signed * 2 + swap) {
+		case 1 * 4 + 0 * 2 + 0:
+		case 1 * 4 + 0 * 2 + 1:
+			CONVERT_LOOP(raw[i]);
 			break;
-		case 2:
-			if (is_signed && is_bigendian) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RB16S(&data16[i]);
-					outbuf[i] += offset;
-				}
-			} else if (is_bigendian) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RB16(&data16[i]);
-					outbuf[i] += offset;
-				}
-			} else if (is_signed) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RL16S(&data16[i]);
-					outbuf[i] += offset;
-				}
-			} else {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RL16(&data16[i]);
-					outbuf[i] += offset;
-				}
-			}
+		case 1 * 4 + 1 * 2 + 0:
+		case 1 * 4 + 1 * 2 + 1:
+			CONVERT_LOOP(((const int8_t *)raw)[i]);
 			break;
-		case 4:
-			if (is_signed && is_bigendian) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RB32S(&data32[i]);
-					outbuf[i] += offset;
-				}
-			} else if (is_bigendian) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RB32(&data32[i]);
-					outbuf[i] += offset;
-				}
-			} else if (is_signed) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RL32S(&data32[i]);
-					outbuf[i] += offset;
-				}
-			} else {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RL32(&data32[i]);
-					outbuf[i] += offset;
-				}
-			}
+		case 2 * 4 + 0 * 2 + 0:
+			CONVERT_LOOP(load_u16(&raw[2 * i]));
+			break;
+		case 2 * 4 + 0 * 2 + 1:
+			CONVERT_LOOP(GUINT16_SWAP_LE_BE(load_u16(&raw[2 * i])));
+			break;
+		case 2 * 4 + 1 * 2 + 0:
+			CONVERT_LOOP((int16_t)load_u16(&raw[2 * i]));
+			break;
+		case 2 * 4 + 1 * 2 + 1:
+			CONVERT_LOOP((int16_t)GUINT16_SWAP_LE_BE(load_u16(&raw[2 * i])));
+			break;
+		case 4 * 4 + 0 * 2 + 0:
+			CONVERT_LOOP(load_u32(&raw[4 * i]));
+			break;
+		case 4 * 4 + 0 * 2 + 1:
+			CONVERT_LOOP(GUINT32_SWAP_LE_BE(load_u32(&raw[4 * i])));
+			break;
+		case 4 * 4 + 1 * 2 + 0:
+			CONVERT_LOOP((int32_t)load_u32(&raw[4 * i]));
+			break;
+		case 4 * 4 + 1 * 2 + 1:
+			CONVERT_LOOP((int32_t)GUINT32_SWAP_LE_BE(load_u32(&raw[4 * i])));
 			break;
 		default:
 			sr_err("Unsupported unit size '%d' for analog-to-float"
@@ -266,29 +273,41 @@ SR_API int sr_analog_to_float(const struct sr_datafeed_analog *analog,
 		return SR_OK;
 	}
 
-	if (analog->encoding->unitsize == sizeof(float)
-			&& analog->encoding->is_bigendian == bigendian
-			&& analog->encoding->scale.p == 1
-			&& analog->encoding->scale.q == 1
-			&& analog->encoding->offset.p / (float)analog->encoding->offset.q == 0) {
-		/* The data is already in the right format. */
-		memcpy(outbuf, analog->data, count * sizeof(float));
-	} else {
-		for (unsigned int i = 0; i < count; i += analog->encoding->unitsize) {
-			for (b = 0; b < analog->encoding->unitsize; b++) {
-				if (analog->encoding->is_bigendian == bigendian)
-					((uint8_t *)outbuf)[i + b] =
-						((uint8_t *)analog->data)[i * analog->encoding->unitsize + b];
-				else
-					((uint8_t *)outbuf)[i + (analog->encoding->unitsize - b)] =
-						((uint8_t *)analog->data)[i * analog->encoding->unitsize + b];
-			}
-			if (analog->encoding->scale.p != 1
-					|| analog->encoding->scale.q != 1)
-				outbuf[i] = (outbuf[i] * analog->encoding->scale.p) / analog->encoding->scale.q;
-			float offset = ((float)analog->encoding->offset.p / (float)analog->encoding->offset.q);
-			outbuf[i] += offset;
+	switch (analog->encoding->unitsize) {
+	case sizeof(float):
+		if (!swap) {
+			memcpy(outbuf, raw, count * sizeof(float));
+		} else if (analog->encoding->is_bigendian) {
+			for (i = 0; i < count; i++)
+				outbuf[i] = RBFL(raw + i * sizeof(float));
+		} else {
+			for (i = 0; i < count; i++)
+				outbuf[i] = RLFL(raw + i * sizeof(float));
 		}
+		break;
+	case sizeof(double):
+		for (i = 0; i < count; i++) {
+			memcpy(&tmp64, raw + i * sizeof(double), sizeof(double));
+			if (swap)
+				tmp64 = GUINT64_SWAP_LE_BE(tmp64);
+			memcpy(&dval, &tmp64, sizeof(double));
+			outbuf[i] = dval;
+		}
+		break;
+	default:
+		sr_err("Unsupported unit size '%d' for analog-to-float"
+		       " conversion.", analog->encoding->unitsize);
+		return SR_ERR;
+	}
+
+	if (analog->encoding->scale.p != 1 || analog->encoding->scale.q != 1) {
+		for (i = 0; i < count; i++)
+			outbuf[i] = (outbuf[i] * analog->encoding->scale.p)
+				/ analog->encoding->scale.q;
+	}
+	if (offset != 0) {
+		for (i = 0; i < count; i++)
+			outbuf[i] += offset;
 	}
 
 	return SR_OK;
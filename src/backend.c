@@ -466,7 +466,7 @@ static int sanity_check_all_output_modules(void)
 			sr_err("No description in module '%s'.", d);
 			errors++;
 		}
-		if (!outputs[i]->receive) {
+		if (!outputs[i]->receive && !outputs[i]->receive_into) {
 			sr_err("No receive in module '%s'.", d);
 			errors++;
 		}
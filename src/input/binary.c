@@ -32,17 +32,173 @@
 #define CHUNK_SIZE           (4 * 1024 * 1024)
 #define DEFAULT_NUM_CHANNELS 8
 #define DEFAULT_SAMPLERATE   0
+#define DEFAULT_UNITSIZE     0
+
+/*
+ * Selected channels get repacked with lookup tables. Each table takes
+ * the value of one input byte, and returns that byte's selected bits at
+ * their positions in one 64bit word of the output sample. Input bytes
+ * which feed two output words have two tables.
+ */
+struct gather_table {
+	size_t in_offset;
+	size_t out_word;
+	uint64_t bits[256];
+};
 
 struct context {
 	gboolean started;
 	uint64_t samplerate;
 	uint16_t unitsize;
+	/* Repacking of a channel subset into a narrower unitsize. */
+	uint16_t out_unitsize;
+	size_t table_count;
+	struct gather_table *tables;
+	uint8_t *out_buffer;
+	/* Mapped input data which was not sent yet. */
+	const uint8_t *mapped;
+	size_t mapped_len;
 };
 
+/*
+ * Parse the "channels" option: a comma separated list of bit numbers
+ * and ranges, like "0-7,12". Returns the number of selected bits, or
+ * 0 for an invalid specification.
+ */
+static size_t parse_channel_list(const char *spec, size_t num_channels,
+	int *selected)
+{
+	char **items, *item, *end;
+	size_t count, idx;
+	unsigned long first, last, bit;
+	gboolean *used;
+
+	used = g_malloc0_n(num_channels, sizeof(used[0]));
+	items = g_strsplit(spec, ",", 0);
+	count = 0;
+	for (idx = 0; items[idx]; idx++) {
+		item = g_strstrip(items[idx]);
+		first = strtoul(item, &end, 10);
+		last = first;
+		if (end != item && *end == '-') {
+			item = end + 1;
+			last = strtoul(item, &end, 10);
+		}
+		if (end == item || *end || first > last || last >= num_channels) {
+			sr_err("Invalid channel selection '%s'.", items[idx]);
+			count = 0;
+			break;
+		}
+		for (bit = first; bit <= last; bit++) {
+			if (used[bit]) {
+				sr_err("Channel %lu is selected twice.", bit);
+				count = 0;
+				goto out;
+			}
+			used[bit] = TRUE;
+			selected[count++] = bit;
+		}
+	}
+out:
+	g_strfreev(items);
+	g_free(used);
+
+	return count;
+}
+
+/* Set up the lookup tables which gather the selected bits. */
+static void create_gather_tables(struct context *inc,
+	const int *selected, size_t count)
+{
+	struct gather_table *table;
+	size_t out_bit, idx, in_offset, out_word, alloc_count;
+	unsigned int value, in_shift;
+
+	/*
+	 * The number of tables depends on the order of the selection,
+	 * grow the array as needed.
+	 */
+	alloc_count = 0;
+	inc->tables = NULL;
+	inc->table_count = 0;
+	for (out_bit = 0; out_bit < count; out_bit++) {
+		in_offset = selected[out_bit] / 8;
+		in_shift = selected[out_bit] % 8;
+		out_word = out_bit / 64;
+		table = NULL;
+		for (idx = 0; idx < inc->table_count; idx++) {
+			if (inc->tables[idx].in_offset == in_offset &&
+					inc->tables[idx].out_word == out_word) {
+				table = &inc->tables[idx];
+				break;
+			}
+		}
+		if (!table) {
+			if (inc->table_count == alloc_count) {
+				alloc_count = alloc_count ? 2 * alloc_count : 8;
+				inc->tables = g_realloc_n(inc->tables, alloc_count,
+					sizeof(inc->tables[0]));
+			}
+			table = &inc->tables[inc->table_count++];
+			memset(table, 0, sizeof(*table));
+			table->in_offset = in_offset;
+			table->out_word = out_word;
+		}
+		for (value = 0; value < 256; value++) {
+			if (value & (1 << in_shift))
+				table->bits[value] |= UINT64_C(1) << (out_bit % 64);
+		}
+	}
+}
+
+/* Repack a number of samples into the narrower output unitsize. */
+static void gather_samples(const struct context *inc,
+	const uint8_t *data, size_t count, uint8_t *out)
+{
+	const struct gather_table *table, *tables_end;
+	uint64_t words[8], word;
+	size_t word_count, idx, out_idx;
+
+	tables_end = &inc->tables[inc->table_count];
+	word_count = (inc->out_unitsize + 7) / 8;
+
+	/* Up to 64 channels: all tables feed one word. */
+	if (word_count == 1) {
+		while (count--) {
+			word = 0;
+			for (table = inc->tables; table < tables_end; table++)
+				word |= table->bits[data[table->in_offset]];
+			for (idx = 0; idx < inc->out_unitsize; idx++)
+				out[idx] = word >> (8 * idx);
+			data += inc->unitsize;
+			out += inc->out_unitsize;
+		}
+		return;
+	}
+
+	while (count--) {
+		out_idx = 0;
+		for (idx = 0; idx < word_count; idx += 8) {
+			memset(words, 0, sizeof(words));
+			for (table = inc->tables; table < tables_end; table++) {
+				if (table->out_word >= idx && table->out_word < idx + 8)
+					words[table->out_word - idx] |= table->bits[data[table->in_offset]];
+			}
+			for (; out_idx < MIN(inc->out_unitsize, 8 * (idx + 8)); out_idx++)
+				out[out_idx] = words[out_idx / 8 - idx] >> (8 * (out_idx % 8));
+		}
+		data += inc->unitsize;
+		out += inc->out_unitsize;
+	}
+}
+
 static int init(struct sr_input *in, GHashTable *options)
 {
 	struct context *inc;
-	int num_channels, i;
+	int num_channels, unitsize, i;
+	int *selected;
+	size_t count;
+	const char *spec;
 	char name[16];
 
 	num_channels = g_variant_get_int32(g_hash_table_lookup(options, "numchannels"));
@@ -50,23 +206,66 @@ static int init(struct sr_input *in, GHashTable *options)
 		sr_err("Invalid value for numchannels: must be at least 1.");
 		return SR_ERR_ARG;
 	}
+	unitsize = g_variant_get_int32(g_hash_table_lookup(options, "unitsize"));
+	if (!unitsize)
+		unitsize = (num_channels + 7) / 8;
+	if (unitsize < (num_channels + 7) / 8 || unitsize > UINT16_MAX) {
+		sr_err("Invalid value for unitsize: must hold all channels.");
+		return SR_ERR_ARG;
+	}
+
+	/* Get the selected channels, all of them by default. */
+	selected = g_malloc_n(num_channels, sizeof(selected[0]));
+	spec = g_variant_get_string(g_hash_table_lookup(options, "channels"), NULL);
+	if (spec && *spec) {
+		count = parse_channel_list(spec, num_channels, selected);
+		if (!count) {
+			g_free(selected);
+			return SR_ERR_ARG;
+		}
+	} else {
+		for (i = 0; i < num_channels; i++)
+			selected[i] = i;
+		count = num_channels;
+	}
 
 	in->sdi = g_malloc0(sizeof(struct sr_dev_inst));
 	in->priv = inc = g_malloc0(sizeof(struct context));
 
 	inc->samplerate = g_variant_get_uint64(g_hash_table_lookup(options, "samplerate"));
 
-	for (i = 0; i < num_channels; i++) {
-		snprintf(name, sizeof(name), "%d", i);
+	for (i = 0; i < (int)count; i++) {
+		snprintf(name, sizeof(name), "%d", selected[i]);
 		sr_channel_new(in->sdi, i, SR_CHANNEL_LOGIC, TRUE, name);
 	}
 
-	inc->unitsize = (g_slist_length(in->sdi->channels) + 7) / 8;
+	/*
+	 * Samples get sent as they are, unless channels were left out,
+	 * or the input has padding. Then they get repacked.
+	 */
+	inc->unitsize = unitsize;
+	inc->out_unitsize = (count + 7) / 8;
+	for (i = 0; i < (int)count; i++) {
+		if (selected[i] != i)
+			break;
+	}
+	if (i < (int)count || inc->out_unitsize != inc->unitsize) {
+		create_gather_tables(inc, selected, count);
+		inc->out_buffer = g_malloc(CHUNK_SIZE / inc->unitsize * inc->out_unitsize);
+		sr_dbg("Repacking %zu channels from unitsize %d to %d.",
+			count, inc->unitsize, inc->out_unitsize);
+	}
+	g_free(selected);
 
 	return SR_OK;
 }
 
-static int process_buffer(struct sr_input *in)
+/*
+ * Send the samples in the given data, which can be the receive buffer
+ * or mapped input. Returns the number of bytes that were used.
+ */
+static size_t send_samples(struct sr_input *in,
+	const uint8_t *data, size_t length)
 {
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_meta meta;
@@ -95,37 +294,116 @@ static int process_buffer(struct sr_input *in)
 
 	packet.type = SR_DF_LOGIC;
 	packet.payload = &logic;
-	logic.unitsize = inc->unitsize;
+	logic.unitsize = inc->out_unitsize;
 
 	/* Cut off at multiple of unitsize. */
-	chunk_size = in->buf->len / logic.unitsize * logic.unitsize;
+	chunk_size = length / inc->unitsize * inc->unitsize;
 
 	for (i = 0; i < chunk_size; i += chunk) {
-		logic.data = in->buf->str + i;
-		chunk = MIN(CHUNK_SIZE, chunk_size - i);
-		logic.length = chunk;
-		sr_session_send(in->sdi, &packet);
+		chunk = MIN(CHUNK_SIZE / inc->unitsize * inc->unitsize,
+			chunk_size - i);
+		if (inc->tables) {
+			gather_samples(inc, data + i, chunk / inc->unitsize,
+				inc->out_buffer);
+			logic.data = inc->out_buffer;
+			logic.length = chunk / inc->unitsize * inc->out_unitsize;
+		} else {
+			logic.data = (uint8_t *)data + i;
+			logic.length = chunk;
+		}
+		sr_session_send_readonly(in->sdi, &packet);
+	}
+
+	return chunk_size;
+}
+
+static int process_buffer(struct sr_input *in)
+{
+	struct context *inc;
+	size_t used;
+
+	/*
+	 * Mapped input gets sent in place. It precedes the content of
+	 * the receive buffer, a trailing partial sample is moved there.
+	 */
+	inc = in->priv;
+	if (inc->mapped_len) {
+		used = send_samples(in, inc->mapped, inc->mapped_len);
+		g_string_prepend_len(in->buf, (const char *)&inc->mapped[used],
+			inc->mapped_len - used);
+		inc->mapped = NULL;
+		inc->mapped_len = 0;
 	}
-	g_string_erase(in->buf, 0, chunk_size);
+
+	used = send_samples(in, (const uint8_t *)in->buf->str, in->buf->len);
+	g_string_erase(in->buf, 0, used);
 
 	return SR_OK;
 }
 
+static int receive_mapped(struct sr_input *in,
+	const uint8_t *data, size_t length)
+{
+	struct context *inc;
+
+	/* Keep the order of data which was received before. */
+	inc = in->priv;
+	if (in->buf->len) {
+		g_string_append_len(in->buf, (const char *)data, length);
+	} else {
+		inc->mapped = data;
+		inc->mapped_len = length;
+	}
+
+	if (!in->sdi_ready) {
+		/* sdi is ready, notify frontend. */
+		in->sdi_ready = TRUE;
+		return SR_OK;
+	}
+
+	return process_buffer(in);
+}
+
 static int receive(struct sr_input *in, GString *buf)
 {
+	struct context *inc;
+	const uint8_t *data;
+	size_t length, size, used;
 	int ret;
 
-	g_string_append_len(in->buf, buf->str, buf->len);
-
 	if (!in->sdi_ready) {
+		g_string_append_len(in->buf, buf->str, buf->len);
 		/* sdi is ready, notify frontend. */
 		in->sdi_ready = TRUE;
 		return SR_OK;
 	}
 
-	ret = process_buffer(in);
+	/*
+	 * Complete a partial sample from previous data. Then the samples
+	 * get sent from the caller's buffer, without copying them to the
+	 * receive buffer first. Only a trailing partial sample is kept.
+	 */
+	inc = in->priv;
+	data = (const uint8_t *)buf->str;
+	length = buf->len;
+	if (in->buf->len || inc->mapped_len) {
+		size = inc->unitsize - in->buf->len % inc->unitsize;
+		size = MIN(size, length);
+		g_string_append_len(in->buf, (const char *)data, size);
+		data += size;
+		length -= size;
+		ret = process_buffer(in);
+		if (ret != SR_OK)
+			return ret;
+		if (in->buf->len) {
+			g_string_append_len(in->buf, (const char *)data, length);
+			return SR_OK;
+		}
+	}
+	used = send_samples(in, data, length);
+	g_string_append_len(in->buf, (const char *)&data[used], length - used);
 
-	return ret;
+	return SR_OK;
 }
 
 static int end(struct sr_input *in)
@@ -145,11 +423,24 @@ static int end(struct sr_input *in)
 	return ret;
 }
 
+static void cleanup(struct sr_input *in)
+{
+	struct context *inc;
+
+	inc = in->priv;
+	g_free(inc->tables);
+	inc->tables = NULL;
+	g_free(inc->out_buffer);
+	inc->out_buffer = NULL;
+}
+
 static int reset(struct sr_input *in)
 {
 	struct context *inc = in->priv;
 
 	inc->started = FALSE;
+	inc->mapped = NULL;
+	inc->mapped_len = 0;
 	g_string_truncate(in->buf, 0);
 
 	return SR_OK;
@@ -158,6 +449,8 @@ static int reset(struct sr_input *in)
 static struct sr_option options[] = {
 	{ "numchannels", "Number of logic channels", "The number of (logic) channels in the data", NULL, NULL },
 	{ "samplerate", "Sample rate (Hz)", "The sample rate of the (logic) data in Hz", NULL, NULL },
+	{ "unitsize", "Sample size (bytes)", "The size of one sample in the data in bytes, 0 to derive it from the number of channels", NULL, NULL },
+	{ "channels", "Channel selection", "The channels to use, as a list of channel numbers and ranges like 0-7,12 (all channels when empty)", NULL, NULL },
 	ALL_ZERO
 };
 
@@ -166,6 +459,8 @@ static const struct sr_option *get_options(void)
 	if (!options[0].def) {
 		options[0].def = g_variant_ref_sink(g_variant_new_int32(DEFAULT_NUM_CHANNELS));
 		options[1].def = g_variant_ref_sink(g_variant_new_uint64(DEFAULT_SAMPLERATE));
+		options[2].def = g_variant_ref_sink(g_variant_new_int32(DEFAULT_UNITSIZE));
+		options[3].def = g_variant_ref_sink(g_variant_new_string(""));
 	}
 
 	return options;
@@ -179,6 +474,8 @@ SR_PRIV struct sr_input_module input_binary = {
 	.options = get_options,
 	.init = init,
 	.receive = receive,
+	.receive_mapped = receive_mapped,
 	.end = end,
+	.cleanup = cleanup,
 	.reset = reset,
 };
@@ -81,6 +81,9 @@ struct context {
 	gboolean started;
 	uint64_t samplerate;
 	uint64_t samples_remain;
+	/* Mapped input data which was not sent yet. */
+	const uint8_t *mapped;
+	size_t mapped_len;
 };
 
 static int format_match(GHashTable *metadata, unsigned int *confidence)
@@ -127,7 +130,12 @@ static int init(struct sr_input *in, GHashTable *options)
 	return SR_OK;
 }
 
-static int process_buffer(struct sr_input *in)
+/*
+ * Send the samples in the given data, which can be the receive buffer
+ * or mapped input. Returns the number of bytes that were used.
+ */
+static size_t send_samples(struct sr_input *in,
+	const uint8_t *data, size_t length)
 {
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_meta meta;
@@ -165,23 +173,69 @@ static int process_buffer(struct sr_input *in)
 	logic.unitsize = unitsize;
 
 	/* Cut off at multiple of unitsize. Avoid sending the "header". */
-	chunk_size = in->buf->len / logic.unitsize * logic.unitsize;
+	chunk_size = length / logic.unitsize * logic.unitsize;
 	chunk_size = MIN(chunk_size, inc->samples_remain * unitsize);
 
 	for (i = 0; i < chunk_size; i += chunk) {
-		logic.data = in->buf->str + i;
+		logic.data = (uint8_t *)data + i;
 		chunk = MIN(CHUNK_SIZE, chunk_size - i);
 		if (chunk) {
 			logic.length = chunk;
-			sr_session_send(in->sdi, &packet);
+			sr_session_send_readonly(in->sdi, &packet);
 			inc->samples_remain -= chunk / unitsize;
 		}
 	}
-	g_string_erase(in->buf, 0, chunk_size);
+
+	return chunk_size;
+}
+
+static int process_buffer(struct sr_input *in)
+{
+	struct context *inc;
+	size_t used;
+
+	/*
+	 * Mapped input gets sent in place. It precedes the content of
+	 * the receive buffer, the unused rest is moved there.
+	 */
+	inc = in->priv;
+	if (inc->mapped_len) {
+		used = send_samples(in, inc->mapped, inc->mapped_len);
+		g_string_prepend_len(in->buf, (const char *)&inc->mapped[used],
+			inc->mapped_len - used);
+		inc->mapped = NULL;
+		inc->mapped_len = 0;
+	}
+
+	used = send_samples(in, (const uint8_t *)in->buf->str, in->buf->len);
+	g_string_erase(in->buf, 0, used);
 
 	return SR_OK;
 }
 
+static int receive_mapped(struct sr_input *in,
+	const uint8_t *data, size_t length)
+{
+	struct context *inc;
+
+	/* Keep the order of data which was received before. */
+	inc = in->priv;
+	if (in->buf->len) {
+		g_string_append_len(in->buf, (const char *)data, length);
+	} else {
+		inc->mapped = data;
+		inc->mapped_len = length;
+	}
+
+	if (!in->sdi_ready) {
+		/* sdi is ready, notify frontend. */
+		in->sdi_ready = TRUE;
+		return SR_OK;
+	}
+
+	return process_buffer(in);
+}
+
 static int receive(struct sr_input *in, GString *buf)
 {
 	int ret;
@@ -221,6 +275,8 @@ static int reset(struct sr_input *in)
 	struct context *inc = in->priv;
 
 	inc->started = FALSE;
+	inc->mapped = NULL;
+	inc->mapped_len = 0;
 	g_string_truncate(in->buf, 0);
 
 	return SR_OK;
@@ -252,6 +308,7 @@ SR_PRIV struct sr_input_module input_chronovu_la8 = {
 	.format_match = format_match,
 	.init = init,
 	.receive = receive,
+	.receive_mapped = receive_mapped,
 	.end = end,
 	.reset = reset,
 };
@@ -34,6 +34,12 @@
 
 #define CHUNK_SIZE	(4 * 1024 * 1024)
 
+/* Minimum amount of input text per parser thread. */
+#define SLICE_SIZE	(256 * 1024)
+
+/* Maximum length of the first text line in format detection. */
+#define FORMAT_MATCH_MAX_LEN	(4 * 1024)
+
 /*
  * The CSV input module has the following options:
  *
@@ -91,6 +97,10 @@
  *     up to the end of the current text line. Can be empty to disable
  *     comment support. Defaults to semicolon.
  *
+ * threads: Specifies the number of threads which parse large blocks of
+ *     input text. Defaults to 0, one thread per CPU. 1 parses all text
+ *     in the calling thread.
+ *
  * Typical examples of using these options:
  * - ... -I csv:column_formats=*l ...
  *   All columns are single-bit logic data. Identical to the previous
@@ -228,6 +238,7 @@ struct context {
 	const char *column_formats;
 	size_t column_want_count;
 	struct column_details *column_details;
+	char **column_texts;
 
 	/* Line number to start processing. */
 	size_t start_line;
@@ -259,6 +270,33 @@ struct context {
 	/* List of previously created sigrok channels. */
 	GSList *prev_sr_channels;
 	GSList **prev_df_channels;
+
+	/* Parser threads, and the number of their pending slices. */
+	size_t num_threads;
+	gboolean quiet;
+	gboolean have_timestamps;
+	GThreadPool *pool;
+	GMutex slices_mutex;
+	GCond slices_cond;
+	size_t slices_pending;
+};
+
+/*
+ * A slice of input text which consists of complete lines, and gets
+ * parsed by a worker thread. The worker uses a copy of the context,
+ * with its own line number and its own sample buffers. Workers parse
+ * copies of the lines and don't log, the line which failed gets parsed
+ * again by the caller, for the diagnostics of the first error only.
+ */
+struct parse_slice {
+	struct context ctx;
+	char *text, *end;
+	gboolean is_last;
+	size_t line_count;
+	size_t sample_count;
+	GString *line;
+	char *error_line, *error_line_end;
+	int ret;
 };
 
 /*
@@ -306,20 +344,23 @@ static void clear_logic_samples(struct context *inc)
 	memset(inc->sample_buffer, 0, inc->sample_unit_size);
 }
 
-static void set_logic_level(struct context *inc, size_t ch_idx, int on)
+/*
+ * Set the logic levels of several adjacent channels at once. Takes at
+ * most 56 bits, so that they fit a 64-bit word at any bit position.
+ */
+static void set_logic_levels(struct context *inc, size_t ch_idx, uint64_t bits)
 {
-	size_t byte_idx, bit_idx;
-	uint8_t bit_mask;
+	uint8_t *p;
 
 	if (ch_idx >= inc->logic_channels)
 		return;
-	if (!on)
-		return;
 
-	byte_idx = ch_idx / 8;
-	bit_idx = ch_idx % 8;
-	bit_mask = 1 << bit_idx;
-	inc->sample_buffer[byte_idx] |= bit_mask;
+	p = &inc->sample_buffer[ch_idx / 8];
+	bits <<= ch_idx % 8;
+	while (bits) {
+		*p++ |= bits & 0xff;
+		bits >>= 8;
+	}
 }
 
 static int flush_logic_samples(const struct sr_input *in)
@@ -390,8 +431,6 @@ static void set_analog_value(struct context *inc, size_t ch_idx, csv_analog_t va
 {
 	if (ch_idx >= inc->analog_channels)
 		return;
-	if (!value)
-		return;
 	inc->analog_sample_buffer[ch_idx * inc->analog_datafeed_buf_size] = value;
 }
 
@@ -468,6 +507,73 @@ static int queue_analog_samples(const struct sr_input *in)
 	return SR_OK;
 }
 
+/*
+ * Queue a block of logic samples that were taken in elsewhere, e.g. by
+ * a parser thread. The result is the same as queueing them one by one.
+ */
+static int queue_logic_block(const struct sr_input *in,
+	const uint8_t *data, size_t count)
+{
+	struct context *inc;
+	size_t size;
+	int rc;
+
+	inc = in->priv;
+	if (!inc->logic_channels)
+		return SR_OK;
+
+	while (count) {
+		size = inc->datafeed_buf_size - inc->datafeed_buf_fill;
+		size = MIN(size, count * inc->sample_unit_size);
+		memcpy(&inc->datafeed_buffer[inc->datafeed_buf_fill], data, size);
+		inc->datafeed_buf_fill += size;
+		data += size;
+		count -= size / inc->sample_unit_size;
+		if (inc->datafeed_buf_fill == inc->datafeed_buf_size) {
+			rc = flush_logic_samples(in);
+			if (rc != SR_OK)
+				return rc;
+		}
+	}
+
+	return SR_OK;
+}
+
+/*
+ * Queue a block of analog samples in "striped" layout, the samples of
+ * one channel are followed by the next channel's at the given stride.
+ */
+static int queue_analog_block(const struct sr_input *in,
+	const csv_analog_t *data, size_t stride, size_t count)
+{
+	struct context *inc;
+	size_t ch_idx, n;
+	int rc;
+
+	inc = in->priv;
+	if (!inc->analog_channels)
+		return SR_OK;
+
+	while (count) {
+		n = inc->analog_datafeed_buf_size - inc->analog_datafeed_buf_fill;
+		n = MIN(n, count);
+		for (ch_idx = 0; ch_idx < inc->analog_channels; ch_idx++) {
+			memcpy(&inc->analog_datafeed_buffer[ch_idx * inc->analog_datafeed_buf_size + inc->analog_datafeed_buf_fill],
+				&data[ch_idx * stride], n * sizeof(data[0]));
+		}
+		inc->analog_datafeed_buf_fill += n;
+		data += n;
+		count -= n;
+		if (inc->analog_datafeed_buf_fill == inc->analog_datafeed_buf_size) {
+			rc = flush_analog_samples(in);
+			if (rc != SR_OK)
+				return rc;
+		}
+	}
+
+	return SR_OK;
+}
+
 /* Helpers for "column processing". */
 
 static int split_column_format(const char *spec,
@@ -770,6 +876,43 @@ static char **split_line(char *buf, struct context *inc)
 	return g_strsplit(buf, inc->delimiter->str, 0);
 }
 
+/**
+ * Splits a text line into its columns in place.
+ *
+ * @param[in] buf	The input text line to split.
+ * @param[in] inc	The input module's context.
+ *
+ * @returns The number of columns found, at most the number of columns
+ *   which get processed.
+ *
+ * The columns get terminated within the input text, and referenced from
+ * the context's column_texts[] array. Columns beyond those which get
+ * processed are not inspected. Nothing gets allocated or copied.
+ */
+static size_t split_line_in_place(char *buf, struct context *inc)
+{
+	const char *delim;
+	size_t delim_len, count;
+	char *sep;
+
+	delim = inc->delimiter->str;
+	delim_len = inc->delimiter->len;
+	count = 0;
+	while (count < inc->column_want_count) {
+		inc->column_texts[count++] = buf;
+		if (delim_len == 1)
+			sep = strchr(buf, delim[0]);
+		else
+			sep = strstr(buf, delim);
+		if (!sep)
+			break;
+		*sep = '\0';
+		buf = sep + delim_len;
+	}
+
+	return count;
+}
+
 /**
  * Parse a multi-bit field into several logic channels.
  *
@@ -786,12 +929,34 @@ static char **split_line(char *buf, struct context *inc)
 static int parse_logic(const char *column, struct context *inc,
 	const struct column_details *details)
 {
-	size_t length, ch_rem, ch_idx, ch_inc;
+	size_t length, ch_rem, ch_idx, ch_inc, bit_count;
 	const char *rdptr;
 	char c;
-	gboolean valid;
+	int value;
 	const char *type_text;
-	uint8_t bits;
+	uint64_t bits;
+
+	switch (details->text_format) {
+	case FORMAT_BIN:
+		ch_inc = 1;
+		break;
+	case FORMAT_OCT:
+		ch_inc = 3;
+		break;
+	case FORMAT_HEX:
+		ch_inc = 4;
+		break;
+	default:
+		/* ShouldNotHappen(TM), but silences compiler warning. */
+		return SR_ERR;
+	}
+
+	/* Single bit columns with a single digit are most common. */
+	if (details->channel_count == 1 && (column[0] == '0' || column[0] == '1')
+			&& !column[1]) {
+		set_logic_levels(inc, details->channel_offset, column[0] == '1');
+		return SR_OK;
+	}
 
 	/*
 	 * Prepare to read the digits from the text end towards the start.
@@ -801,8 +966,9 @@ static int parse_logic(const char *column, struct context *inc,
 	 */
 	length = strlen(column);
 	if (!length) {
-		sr_err("Column %zu in line %zu is empty.", details->col_nr,
-			inc->line_number);
+		if (!inc->quiet)
+			sr_err("Column %zu in line %zu is empty.",
+				details->col_nr, inc->line_number);
 		return SR_ERR;
 	}
 	rdptr = &column[length];
@@ -812,63 +978,45 @@ static int parse_logic(const char *column, struct context *inc,
 	/*
 	 * Get another digit and derive up to four logic channels' state from
 	 * it. Make sure to not process more bits than the column has channels
-	 * associated with it.
+	 * associated with it. Collect the bits in a word, and only update
+	 * the sample when the word is full or all digits were seen.
 	 */
+	bits = 0;
+	bit_count = 0;
 	while (rdptr > column && ch_rem) {
 		/* Check for valid digits according to the input radix. */
 		c = *(--rdptr);
-		switch (details->text_format) {
-		case FORMAT_BIN:
-			valid = g_ascii_isxdigit(c) && c < '2';
-			ch_inc = 1;
-			break;
-		case FORMAT_OCT:
-			valid = g_ascii_isxdigit(c) && c < '8';
-			ch_inc = 3;
-			break;
-		case FORMAT_HEX:
-			valid = g_ascii_isxdigit(c);
-			ch_inc = 4;
-			break;
-		default:
-			valid = FALSE;
-			break;
-		}
-		if (!valid) {
+		if (c >= '0' && c <= '9')
+			value = c - '0';
+		else if (c >= 'a' && c <= 'f')
+			value = c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F')
+			value = c - 'A' + 10;
+		else
+			value = -1;
+		if (value < 0 || value >= (1 << ch_inc)) {
 			type_text = col_format_text[details->text_format];
-			sr_err("Invalid text '%s' in %s type column %zu in line %zu.",
-				column, type_text, details->col_nr, inc->line_number);
+			if (!inc->quiet)
+				sr_err("Invalid text '%s' in %s type column %zu in line %zu.",
+					column, type_text, details->col_nr, inc->line_number);
 			return SR_ERR;
 		}
 		/* Use the digit's bits for logic channels' data. */
-		bits = g_ascii_xdigit_value(c);
-		switch (details->text_format) {
-		case FORMAT_HEX:
-			if (ch_rem >= 4) {
-				ch_rem--;
-				set_logic_level(inc, ch_idx + 3, bits & (1 << 3));
-			}
-			/* FALLTHROUGH */
-		case FORMAT_OCT:
-			if (ch_rem >= 3) {
-				ch_rem--;
-				set_logic_level(inc, ch_idx + 2, bits & (1 << 2));
-			}
-			if (ch_rem >= 2) {
-				ch_rem--;
-				set_logic_level(inc, ch_idx + 1, bits & (1 << 1));
-			}
-			/* FALLTHROUGH */
-		case FORMAT_BIN:
-			ch_rem--;
-			set_logic_level(inc, ch_idx + 0, bits & (1 << 0));
-			break;
-		default:
-			/* ShouldNotHappen(TM), but silences compiler warning. */
-			return SR_ERR;
+		if (ch_rem < ch_inc) {
+			value &= (1 << ch_rem) - 1;
+			ch_inc = ch_rem;
+		}
+		bits |= (uint64_t)value << bit_count;
+		bit_count += ch_inc;
+		ch_rem -= ch_inc;
+		if (bit_count > 52) {
+			set_logic_levels(inc, ch_idx, bits);
+			ch_idx += bit_count;
+			bits = 0;
+			bit_count = 0;
 		}
-		ch_idx += ch_inc;
 	}
+	set_logic_levels(inc, ch_idx, bits);
 	/*
 	 * TODO Determine whether the availability of extra input data
 	 * for unhandled logic channels is worth warning here. In this
@@ -896,7 +1044,6 @@ static int parse_logic(const char *column, struct context *inc,
 static int parse_analog(const char *column, struct context *inc,
 	const struct column_details *details)
 {
-	size_t length;
 	double dvalue; float fvalue;
 	csv_analog_t value;
 	int ret;
@@ -904,10 +1051,10 @@ static int parse_analog(const char *column, struct context *inc,
 	if (!format_is_analog(details->text_format))
 		return SR_ERR_BUG;
 
-	length = strlen(column);
-	if (!length) {
-		sr_err("Column %zu in line %zu is empty.", details->col_nr,
-			inc->line_number);
+	if (!*column) {
+		if (!inc->quiet)
+			sr_err("Column %zu in line %zu is empty.",
+				details->col_nr, inc->line_number);
 		return SR_ERR;
 	}
 	if (sizeof(value) == sizeof(double)) {
@@ -920,8 +1067,9 @@ static int parse_analog(const char *column, struct context *inc,
 		ret = SR_ERR_BUG;
 	}
 	if (ret != SR_OK) {
-		sr_err("Cannot parse analog text %s in column %zu in line %zu.",
-			column, details->col_nr, inc->line_number);
+		if (!inc->quiet)
+			sr_err("Cannot parse analog text %s in column %zu in line %zu.",
+				column, details->col_nr, inc->line_number);
 		return SR_ERR_DATA;
 	}
 	set_analog_value(inc, details->channel_offset, value);
@@ -1091,11 +1239,8 @@ static int format_match(GHashTable *metadata, unsigned int *confidence)
 	const char *fn;
 	GString *buf;
 	size_t fn_len;
-	GString *tmpbuf;
-	gboolean status;
-	size_t line_idx, col_idx;
-	char *rdptr, **lines, *line;
-	char **cols, *col;
+	const char *rdptr, *line;
+	size_t line_len, idx;
 
 	/* Get the application provided input data properties. */
 	fn = g_hash_table_lookup(metadata, GINT_TO_POINTER(SR_INPUT_META_FILENAME));
@@ -1125,43 +1270,34 @@ static int format_match(GHashTable *metadata, unsigned int *confidence)
 	 *   columns nor analog data nor timestamps in the default layout.
 	 *   (See the above "sync format match with default options"
 	 *   comment though during maintenance!)
-	 * Run the check on a copy to not affect the caller's buffer.
+	 * Only the first line is checked, and only within the first few
+	 * KiB of the buffer. Characters get checked in place, there is no
+	 * need to split columns since empty columns are acceptable.
 	 */
 	if (!buf || !buf->len || !buf->str || !*buf->str)
 		return SR_ERR;
-	rdptr = g_strstr_len(buf->str, buf->len, line_termination);
+	rdptr = g_strstr_len(buf->str, MIN(buf->len, FORMAT_MATCH_MAX_LEN),
+		line_termination);
 	if (!rdptr)
 		return SR_ERR;
-	tmpbuf = g_string_new_len(buf->str, rdptr + 1 - buf->str);
-	tmpbuf->str[tmpbuf->len - 1] = '\0';
-	status = TRUE;
-	*confidence = match_confidence;
-	lines = g_strsplit(tmpbuf->str, line_termination, 0);
-	for (line_idx = 0; status && (line = lines[line_idx]); line_idx++) {
-		rdptr = strstr(line, comment_leader);
-		if (rdptr)
-			*rdptr = '\0';
-		line = g_strstrip(line);
-		if (!line || !*line)
+	line = buf->str;
+	line_len = rdptr - line;
+	rdptr = g_strstr_len(line, line_len, comment_leader);
+	if (rdptr)
+		line_len = rdptr - line;
+	while (line_len && g_ascii_isspace(line[0])) {
+		line++;
+		line_len--;
+	}
+	while (line_len && g_ascii_isspace(line[line_len - 1]))
+		line_len--;
+	for (idx = 0; idx < line_len; idx++) {
+		if (line[idx] == column_separator[0])
 			continue;
-		cols = g_strsplit(line, column_separator, 0);
-		if (!cols) {
-			status = FALSE;
-			break;
-		}
-		for (col_idx = 0; status && (col = cols[col_idx]); col_idx++) {
-			if (strspn(col, binary_charset) != strlen(col)) {
-				status = FALSE;
-				break;
-			}
-		}
-		g_strfreev(cols);
+		if (!strchr(binary_charset, line[idx]) || !line[idx])
+			return SR_ERR;
 	}
-	g_strfreev(lines);
-	g_string_free(tmpbuf, TRUE);
-
-	if (!status)
-		return SR_ERR;
+	*confidence = match_confidence;
 
 	return SR_OK;
 }
@@ -1209,6 +1345,9 @@ static int init(struct sr_input *in, GHashTable *options)
 		g_string_truncate(inc->comment, 0);
 	}
 	inc->samplerate = g_variant_get_uint64(g_hash_table_lookup(options, "samplerate"));
+	inc->num_threads = g_variant_get_uint32(g_hash_table_lookup(options, "threads"));
+	if (!inc->num_threads)
+		inc->num_threads = g_get_num_processors();
 	first_column = g_variant_get_uint32(g_hash_table_lookup(options, "first_column"));
 	inc->use_header = g_variant_get_boolean(g_hash_table_lookup(options, "header"));
 	inc->start_line = g_variant_get_uint32(g_hash_table_lookup(options, "start_line"));
@@ -1343,7 +1482,7 @@ static int initial_parse(const struct sr_input *in, GString *buf)
 {
 	struct context *inc;
 	size_t num_columns;
-	size_t line_number, line_idx;
+	size_t line_number, line_idx, col_idx;
 	int ret;
 	char **lines, *line, **columns;
 
@@ -1443,6 +1582,13 @@ static int initial_parse(const struct sr_input *in, GString *buf)
 		inc->datafeed_buf_fill = 0;
 	}
 
+	inc->column_texts = g_malloc0_n(inc->column_want_count,
+		sizeof(inc->column_texts[0]));
+	for (col_idx = 0; col_idx < inc->column_want_count; col_idx++) {
+		if (format_is_timestamp(inc->column_details[col_idx].text_format))
+			inc->have_timestamps = TRUE;
+	}
+
 	if (inc->analog_channels) {
 		size_t sample_size, sample_count;
 		sample_size = sizeof(inc->analog_datafeed_buffer[0]);
@@ -1509,7 +1655,7 @@ static int initial_receive(const struct sr_input *in)
 	if (!p)
 		/* Don't have a full line yet. */
 		return SR_ERR_NA;
-	len = p - in->buf->str - 1;
+	len = p - in->buf->str;
 	new_buf = g_string_new_len(in->buf->str, len);
 	g_string_append_c(new_buf, '\0');
 
@@ -1525,16 +1671,289 @@ static int initial_receive(const struct sr_input *in)
 	return ret;
 }
 
-static int process_buffer(struct sr_input *in, gboolean is_eof)
+/*
+ * Find the next line termination sequence within the text, or return
+ * NULL when there is none.
+ */
+static char *find_termination(char *text, const char *end, const char *term)
 {
-	struct context *inc;
-	gsize num_columns;
-	size_t line_idx, col_idx, col_nr;
+	size_t term_len;
+
+	term_len = strlen(term);
+	while ((text = memchr(text, term[0], end - text))) {
+		if ((size_t)(end - text) < term_len)
+			return NULL;
+		if (term_len == 1 || !memcmp(text, term, term_len))
+			return text;
+		text++;
+	}
+
+	return NULL;
+}
+
+/*
+ * Process one text line. Returns SR_OK when the line's sample set was
+ * taken in, SR_ERR_NA when the line was skipped, or an error code.
+ */
+static int parse_line(char *line, struct context *inc)
+{
+	size_t num_columns;
+	size_t col_idx, col_nr;
 	const struct column_details *details;
 	col_parse_cb parse_func;
+	char *column;
 	int ret;
-	char *processed_up_to;
-	char **lines, *line, **columns, *column;
+
+	inc->line_number++;
+	if (inc->line_number < inc->start_line) {
+		sr_spew("Line %zu skipped (before start).", inc->line_number);
+		return SR_ERR_NA;
+	}
+	if (line[0] == '\0') {
+		if (!inc->quiet)
+			sr_spew("Blank line %zu skipped.", inc->line_number);
+		return SR_ERR_NA;
+	}
+
+	/* Remove trailing comment. */
+	strip_comment(line, inc->comment);
+	if (line[0] == '\0') {
+		if (!inc->quiet)
+			sr_spew("Comment-only line %zu skipped.", inc->line_number);
+		return SR_ERR_NA;
+	}
+
+	/* Skip the header line, its content was used as the channel names. */
+	if (inc->use_header && !inc->header_seen) {
+		sr_spew("Header line %zu skipped.", inc->line_number);
+		inc->header_seen = TRUE;
+		return SR_ERR_NA;
+	}
+
+	/* Split the line into columns, check for minimum length. */
+	num_columns = split_line_in_place(line, inc);
+	if (num_columns < inc->column_want_count) {
+		if (!inc->quiet)
+			sr_err("Insufficient column count %zu in line %zu.",
+				num_columns, inc->line_number);
+		return SR_ERR;
+	}
+
+	/* Have the columns of the current text line processed. */
+	clear_logic_samples(inc);
+	clear_analog_samples(inc);
+	for (col_idx = 0; col_idx < inc->column_want_count; col_idx++) {
+		column = inc->column_texts[col_idx];
+		col_nr = col_idx + 1;
+		details = lookup_column_details(inc, col_nr);
+		if (!details || !details->text_format)
+			continue;
+		parse_func = col_parse_funcs[details->text_format];
+		if (!parse_func)
+			continue;
+		ret = parse_func(column, inc, details);
+		if (ret != SR_OK)
+			return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+/* Parse all lines of a slice into the slice's own sample buffers. */
+static void parse_slice(struct parse_slice *slice)
+{
+	struct context *inc;
+	size_t term_len;
+	char *line, *line_end;
+	int ret;
+
+	inc = &slice->ctx;
+	term_len = strlen(inc->termination);
+	line = slice->text;
+	do {
+		line_end = find_termination(line, slice->end, inc->termination);
+		g_string_truncate(slice->line, 0);
+		g_string_append_len(slice->line, line,
+			(line_end ? line_end : slice->end) - line);
+		ret = parse_line(slice->line->str, inc);
+		if (ret == SR_OK) {
+			if (inc->logic_channels)
+				inc->datafeed_buf_fill += inc->sample_unit_size;
+			if (inc->analog_channels)
+				inc->analog_datafeed_buf_fill++;
+			slice->sample_count++;
+		} else if (ret != SR_ERR_NA) {
+			slice->ret = ret;
+			slice->error_line = line;
+			slice->error_line_end = line_end;
+			return;
+		}
+		line = line_end ? line_end + term_len : NULL;
+	} while (line && (slice->is_last || line < slice->end));
+}
+
+static void parse_slice_worker(gpointer data, gpointer user_data)
+{
+	struct parse_slice *slice;
+	struct context *inc;
+
+	slice = data;
+	inc = user_data;
+
+	parse_slice(slice);
+
+	g_mutex_lock(&inc->slices_mutex);
+	if (!--inc->slices_pending)
+		g_cond_signal(&inc->slices_cond);
+	g_mutex_unlock(&inc->slices_mutex);
+}
+
+/*
+ * Check whether the remaining lines can get parsed in parallel. The
+ * start line and the header line must have been seen, and timestamps
+ * must not be needed any more, since they depend on previous lines.
+ */
+static size_t get_slice_count(struct context *inc, size_t length)
+{
+	GError *error;
+
+	if (inc->num_threads < 2 || length < 2 * SLICE_SIZE)
+		return 1;
+	if (inc->line_number + 1 < inc->start_line)
+		return 1;
+	if (inc->use_header && !inc->header_seen)
+		return 1;
+	if (inc->have_timestamps && !inc->calc_samplerate)
+		return 1;
+
+	if (!inc->pool) {
+		error = NULL;
+		inc->pool = g_thread_pool_new(parse_slice_worker, inc,
+			inc->num_threads - 1, FALSE, &error);
+		if (!inc->pool) {
+			sr_warn("Cannot start parser threads: %s",
+				error ? error->message : "unknown error");
+			g_clear_error(&error);
+			inc->num_threads = 1;
+			return 1;
+		}
+		g_mutex_init(&inc->slices_mutex);
+		g_cond_init(&inc->slices_cond);
+	}
+
+	return MIN(inc->num_threads, length / SLICE_SIZE);
+}
+
+/*
+ * Parse the lines of a text in several slices at the same time, then
+ * queue their samples in the order of the text. The slices get cut at
+ * line boundaries, and the last slice ends the same way the text does.
+ */
+static int process_slices(const struct sr_input *in, char *text, char *end,
+	size_t slice_count)
+{
+	struct context *inc;
+	struct parse_slice *slices, *slice;
+	size_t term_len, idx, line_number, capacity;
+	char *p;
+	int ret;
+
+	inc = in->priv;
+	term_len = strlen(inc->termination);
+
+	/* Cut the text into slices, and count their lines. */
+	slices = g_malloc0_n(slice_count, sizeof(slices[0]));
+	line_number = inc->line_number;
+	for (idx = 0; idx < slice_count; idx++) {
+		slice = &slices[idx];
+		slice->text = idx ? slices[idx - 1].end : text;
+		slice->end = end;
+		if (idx + 1 < slice_count) {
+			p = text + (end - text) / slice_count * (idx + 1);
+			p = find_termination(MAX(p, slice->text), end, inc->termination);
+			if (p)
+				slice->end = p + term_len;
+		}
+		slice->is_last = slice->end == end;
+		for (p = slice->text; (p = find_termination(p, slice->end, inc->termination)); p += term_len)
+			slice->line_count++;
+		if (slice->is_last) {
+			slice->line_count++;
+			slice_count = idx + 1;
+		}
+
+		/* Set up the slice's context, with buffers for all its lines. */
+		capacity = slice->line_count;
+		slice->line = g_string_sized_new(256);
+		slice->ctx = *inc;
+		slice->ctx.quiet = TRUE;
+		slice->ctx.line_number = line_number;
+		slice->ctx.column_texts = g_malloc0_n(inc->column_want_count,
+			sizeof(inc->column_texts[0]));
+		slice->ctx.datafeed_buf_fill = 0;
+		slice->ctx.datafeed_buf_size = capacity * inc->sample_unit_size;
+		slice->ctx.datafeed_buffer = g_malloc(slice->ctx.datafeed_buf_size);
+		slice->ctx.analog_datafeed_buf_fill = 0;
+		slice->ctx.analog_datafeed_buf_size = capacity;
+		slice->ctx.analog_datafeed_buffer = g_malloc_n(
+			capacity * inc->analog_channels,
+			sizeof(inc->analog_datafeed_buffer[0]));
+		line_number += slice->line_count;
+	}
+
+	/* Have the workers parse all slices but the first one. */
+	g_mutex_lock(&inc->slices_mutex);
+	inc->slices_pending = slice_count - 1;
+	g_mutex_unlock(&inc->slices_mutex);
+	for (idx = 1; idx < slice_count; idx++)
+		g_thread_pool_push(inc->pool, &slices[idx], NULL);
+	parse_slice(&slices[0]);
+	g_mutex_lock(&inc->slices_mutex);
+	while (inc->slices_pending)
+		g_cond_wait(&inc->slices_cond, &inc->slices_mutex);
+	g_mutex_unlock(&inc->slices_mutex);
+
+	/*
+	 * Queue the samples in order, up to the first error. Then parse
+	 * the line which failed again, to get its diagnostics.
+	 */
+	ret = SR_OK;
+	for (idx = 0; idx < slice_count; idx++) {
+		slice = &slices[idx];
+		if (ret == SR_OK) {
+			ret = queue_logic_block(in, slice->ctx.datafeed_buffer,
+				slice->sample_count);
+			ret += queue_analog_block(in, slice->ctx.analog_datafeed_buffer,
+				slice->ctx.analog_datafeed_buf_size, slice->sample_count);
+			if (ret != SR_OK) {
+				sr_err("Sending samples failed.");
+				ret = SR_ERR;
+			} else if (slice->ret != SR_OK) {
+				inc->line_number = slice->ctx.line_number - 1;
+				if (slice->error_line_end)
+					*slice->error_line_end = '\0';
+				(void)parse_line(slice->error_line, inc);
+				ret = SR_ERR;
+			} else {
+				inc->line_number = slice->ctx.line_number;
+			}
+		}
+		g_string_free(slice->line, TRUE);
+		g_free(slice->ctx.column_texts);
+		g_free(slice->ctx.datafeed_buffer);
+		g_free(slice->ctx.analog_datafeed_buffer);
+	}
+	g_free(slices);
+
+	return ret;
+}
+
+static int process_buffer(struct sr_input *in, gboolean is_eof)
+{
+	struct context *inc;
+	size_t term_len, slice_count;
+	int ret;
+	char *processed_up_to, *line, *line_end;
 
 	inc = in->priv;
 	if (!inc->started) {
@@ -1557,6 +1976,7 @@ static int process_buffer(struct sr_input *in, gboolean is_eof)
 	 */
 	if (!in->buf->len)
 		return SR_OK;
+	term_len = strlen(inc->termination);
 	if (is_eof) {
 		processed_up_to = in->buf->str + in->buf->len;
 	} else {
@@ -1565,86 +1985,49 @@ static int process_buffer(struct sr_input *in, gboolean is_eof)
 		if (!processed_up_to)
 			return SR_OK;
 		*processed_up_to = '\0';
-		processed_up_to += strlen(inc->termination);
 	}
 
-	/* Split input text lines and process their columns. */
+	/*
+	 * Walk the input text lines and process their columns. Lines
+	 * and columns get terminated in place, the text is not copied.
+	 * Once the remaining lines are independent of each other, large
+	 * amounts of text get parsed by several threads.
+	 */
 	ret = SR_OK;
-	lines = g_strsplit(in->buf->str, inc->termination, 0);
-	for (line_idx = 0; (line = lines[line_idx]); line_idx++) {
-		inc->line_number++;
-		if (inc->line_number < inc->start_line) {
-			sr_spew("Line %zu skipped (before start).", inc->line_number);
-			continue;
-		}
-		if (line[0] == '\0') {
-			sr_spew("Blank line %zu skipped.", inc->line_number);
-			continue;
+	line = in->buf->str;
+	if (line == processed_up_to)
+		line = NULL;
+	for (; line; line = line_end ? line_end + term_len : NULL) {
+		slice_count = get_slice_count(inc, processed_up_to - line);
+		if (slice_count > 1) {
+			ret = process_slices(in, line, processed_up_to, slice_count);
+			if (ret != SR_OK)
+				return ret;
+			break;
 		}
 
-		/* Remove trailing comment. */
-		strip_comment(line, inc->comment);
-		if (line[0] == '\0') {
-			sr_spew("Comment-only line %zu skipped.", inc->line_number);
-			continue;
-		}
+		line_end = find_termination(line, processed_up_to, inc->termination);
+		if (line_end)
+			*line_end = '\0';
 
-		/* Skip the header line, its content was used as the channel names. */
-		if (inc->use_header && !inc->header_seen) {
-			sr_spew("Header line %zu skipped.", inc->line_number);
-			inc->header_seen = TRUE;
+		ret = parse_line(line, inc);
+		if (ret == SR_ERR_NA) {
+			ret = SR_OK;
 			continue;
 		}
-
-		/* Split the line into columns, check for minimum length. */
-		columns = split_line(line, inc);
-		if (!columns) {
-			sr_err("Error while parsing line %zu.", inc->line_number);
-			g_strfreev(lines);
-			return SR_ERR;
-		}
-		num_columns = g_strv_length(columns);
-		if (num_columns < inc->column_want_count) {
-			sr_err("Insufficient column count %zu in line %zu.",
-				num_columns, inc->line_number);
-			g_strfreev(columns);
-			g_strfreev(lines);
+		if (ret != SR_OK)
 			return SR_ERR;
-		}
-
-		/* Have the columns of the current text line processed. */
-		clear_logic_samples(inc);
-		clear_analog_samples(inc);
-		for (col_idx = 0; col_idx < inc->column_want_count; col_idx++) {
-			column = columns[col_idx];
-			col_nr = col_idx + 1;
-			details = lookup_column_details(inc, col_nr);
-			if (!details || !details->text_format)
-				continue;
-			parse_func = col_parse_funcs[details->text_format];
-			if (!parse_func)
-				continue;
-			ret = parse_func(column, inc, details);
-			if (ret != SR_OK) {
-				g_strfreev(columns);
-				g_strfreev(lines);
-				return SR_ERR;
-			}
-		}
 
 		/* Send sample data to the session bus (buffered). */
 		ret = queue_logic_samples(in);
 		ret += queue_analog_samples(in);
 		if (ret != SR_OK) {
 			sr_err("Sending samples failed.");
-			g_strfreev(columns);
-			g_strfreev(lines);
 			return SR_ERR;
 		}
-
-		g_strfreev(columns);
 	}
-	g_strfreev(lines);
+	if (!is_eof)
+		processed_up_to += term_len;
 	g_string_erase(in->buf, 0, processed_up_to - in->buf->str);
 
 	return ret;
@@ -1722,6 +2105,14 @@ static void cleanup(struct sr_input *in)
 	/* TODO Release channel names (before releasing details). */
 	g_free(inc->column_details);
 	inc->column_details = NULL;
+	g_free(inc->column_texts);
+	inc->column_texts = NULL;
+	if (inc->pool) {
+		g_thread_pool_free(inc->pool, FALSE, TRUE);
+		inc->pool = NULL;
+		g_mutex_clear(&inc->slices_mutex);
+		g_cond_clear(&inc->slices_cond);
+	}
 
 	/* Clear internal state, but keep what .init() has provided. */
 	save_ctx = *inc;
@@ -1734,6 +2125,7 @@ static void cleanup(struct sr_input *in)
 	inc->use_header = save_ctx.use_header;
 	inc->prev_sr_channels = save_ctx.prev_sr_channels;
 	inc->prev_df_channels = save_ctx.prev_df_channels;
+	inc->num_threads = save_ctx.num_threads;
 }
 
 static int reset(struct sr_input *in)
@@ -1759,6 +2151,7 @@ enum option_index {
 	OPT_SAMPLERATE,
 	OPT_COL_SEP,
 	OPT_COMMENT,
+	OPT_THREADS,
 	OPT_MAX,
 };
 
@@ -1813,6 +2206,11 @@ static struct sr_option options[] = {
 		"The text which starts comments at the end of text lines, semicolon by default.",
 		NULL, NULL,
 	},
+	[OPT_THREADS] = {
+		"threads", "Parser threads",
+		"Number of threads which parse large blocks of input text (0 for one per CPU, 1 to disable).",
+		NULL, NULL,
+	},
 	[OPT_MAX] = ALL_ZERO,
 };
 
@@ -1836,6 +2234,7 @@ static const struct sr_option *get_options(void)
 		options[OPT_SAMPLERATE].def = g_variant_ref_sink(g_variant_new_uint64(0));
 		options[OPT_COL_SEP].def = g_variant_ref_sink(g_variant_new_string(","));
 		options[OPT_COMMENT].def = g_variant_ref_sink(g_variant_new_string(";"));
+		options[OPT_THREADS].def = g_variant_ref_sink(g_variant_new_uint32(0));
 	}
 
 	return options;
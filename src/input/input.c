@@ -336,6 +336,96 @@ static gboolean check_required_metadata(const uint8_t *metadata, uint8_t *avail)
 	return TRUE;
 }
 
+/* Confidence of a format match which no other module can beat. */
+#define DEFINITIVE_CONFIDENCE	1
+
+/* Check whether the filename has one of the module's typical extensions. */
+static gboolean has_module_ext(const struct sr_input_module *imod,
+		const char *filename)
+{
+	const char *ext;
+	unsigned int i;
+
+	if (!filename || !imod->exts)
+		return FALSE;
+	ext = strrchr(filename, '.');
+	if (!ext)
+		return FALSE;
+	ext++;
+	for (i = 0; imod->exts[i]; i++) {
+		if (g_ascii_strcasecmp(ext, imod->exts[i]) == 0)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ * Ask the input modules which can identify a stream from the available
+ * metadata. Modules whose file extension matches the filename (when
+ * there is one) get asked first, all others after them. The result is
+ * the same as when asking all modules in list order: the highest
+ * confidence wins, and on equal confidence the earlier module wins.
+ * A definitive match saves asking the modules after it in the list,
+ * modules which look at content usually check magic strings before
+ * they do any expensive parsing.
+ */
+static const struct sr_input_module *find_input_module(GHashTable *meta,
+		uint8_t *avail_metadata, const char *filename)
+{
+	const struct sr_input_module *imod;
+	unsigned int pass, i, best_idx;
+	unsigned int conf, best_conf;
+	int ret;
+
+	best_idx = 0;
+	best_conf = ~0;
+	for (pass = 0; pass < 2; pass++) {
+		for (i = 0; input_module_list[i]; i++) {
+			if (best_conf <= DEFINITIVE_CONFIDENCE && i > best_idx)
+				break;
+			imod = input_module_list[i];
+			if (has_module_ext(imod, filename) != (pass == 0))
+				continue;
+			if (!imod->metadata[0]) {
+				/* Module has no metadata for matching so will take
+				 * any input. No point in letting it try to match. */
+				continue;
+			}
+			if (!check_required_metadata(imod->metadata, avail_metadata))
+				/* Cannot satisfy this module's requirements. */
+				continue;
+
+			sr_dbg("Trying module %s.", imod->id);
+			ret = imod->format_match(meta, &conf);
+			if (ret == SR_ERR) {
+				/* Module didn't recognize this buffer. */
+				continue;
+			} else if (ret != SR_OK) {
+				/*
+				 * Module recognized this buffer, but cannot
+				 * handle it. Can be SR_ERR_NA.
+				 */
+				continue;
+			}
+
+			/* Found a matching module. */
+			sr_dbg("Module %s matched, confidence %u.", imod->id, conf);
+			if (conf > best_conf)
+				continue;
+			if (conf == best_conf && i > best_idx)
+				continue;
+			best_idx = i;
+			best_conf = conf;
+		}
+	}
+
+	if (best_conf == ~0U)
+		return NULL;
+
+	return input_module_list[best_idx];
+}
+
 /**
  * Try to find an input module that can parse the given buffer.
  *
@@ -359,63 +449,19 @@ static gboolean check_required_metadata(const uint8_t *metadata, uint8_t *avail)
  */
 SR_API int sr_input_scan_buffer(GString *buf, const struct sr_input **in)
 {
-	const struct sr_input_module *imod, *best_imod;
+	const struct sr_input_module *best_imod;
 	GHashTable *meta;
-	unsigned int m, i;
-	unsigned int conf, best_conf;
-	int ret;
-	uint8_t mitem, avail_metadata[8];
+	uint8_t avail_metadata[8];
 
 	/* No more metadata to be had from a buffer. */
 	avail_metadata[0] = SR_INPUT_META_HEADER;
 	avail_metadata[1] = 0;
 
 	*in = NULL;
-	best_imod = NULL;
-	best_conf = ~0;
-	for (i = 0; input_module_list[i]; i++) {
-		imod = input_module_list[i];
-		if (!imod->metadata[0]) {
-			/* Module has no metadata for matching so will take
-			 * any input. No point in letting it try to match. */
-			continue;
-		}
-		if (!check_required_metadata(imod->metadata, avail_metadata))
-			/* Cannot satisfy this module's requirements. */
-			continue;
-
-		meta = g_hash_table_new(NULL, NULL);
-		for (m = 0; m < sizeof(imod->metadata); m++) {
-			mitem = imod->metadata[m] & ~SR_INPUT_META_REQUIRED;
-			if (mitem == SR_INPUT_META_HEADER)
-				g_hash_table_insert(meta, GINT_TO_POINTER(mitem), buf);
-		}
-		if (g_hash_table_size(meta) == 0) {
-			/* No metadata for this module, so nothing to match. */
-			g_hash_table_destroy(meta);
-			continue;
-		}
-		sr_spew("Trying module %s.", imod->id);
-		ret = imod->format_match(meta, &conf);
-		g_hash_table_destroy(meta);
-		if (ret == SR_ERR_DATA) {
-			/* Module recognized this buffer, but cannot handle it. */
-			continue;
-		} else if (ret == SR_ERR) {
-			/* Module didn't recognize this buffer. */
-			continue;
-		} else if (ret != SR_OK) {
-			/* Can be SR_ERR_NA. */
-			continue;
-		}
-
-		/* Found a matching module. */
-		sr_spew("Module %s matched, confidence %u.", imod->id, conf);
-		if (conf >= best_conf)
-			continue;
-		best_imod = imod;
-		best_conf = conf;
-	}
+	meta = g_hash_table_new(NULL, NULL);
+	g_hash_table_insert(meta, GINT_TO_POINTER(SR_INPUT_META_HEADER), buf);
+	best_imod = find_input_module(meta, avail_metadata, NULL);
+	g_hash_table_destroy(meta);
 
 	if (best_imod) {
 		*in = sr_input_new(best_imod, NULL);
@@ -434,18 +480,18 @@ SR_API int sr_input_scan_buffer(GString *buf, const struct sr_input **in)
  * support for the format, the one with highest confidence takes
  * precedence. Applications will see at most one input module spec.
  *
+ * Modules which handle the file's extension get asked first.
+ *
  */
 SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in)
 {
 	int64_t filesize;
 	FILE *stream;
-	const struct sr_input_module *imod, *best_imod;
+	const struct sr_input_module *best_imod;
 	GHashTable *meta;
 	GString *header;
 	size_t count;
-	unsigned int midx, i;
-	unsigned int conf, best_conf;
-	int ret;
+	unsigned int midx;
 	uint8_t avail_metadata[8];
 
 	*in = NULL;
@@ -491,36 +537,7 @@ SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in)
 	avail_metadata[midx] = 0;
 	/* TODO: MIME type */
 
-	best_imod = NULL;
-	best_conf = ~0;
-	for (i = 0; input_module_list[i]; i++) {
-		imod = input_module_list[i];
-		if (!imod->metadata[0]) {
-			/* Module has no metadata for matching so will take
-			 * any input. No point in letting it try to match. */
-			continue;
-		}
-		if (!check_required_metadata(imod->metadata, avail_metadata))
-			/* Cannot satisfy this module's requirements. */
-			continue;
-
-		sr_dbg("Trying module %s.", imod->id);
-
-		ret = imod->format_match(meta, &conf);
-		if (ret == SR_ERR) {
-			/* Module didn't recognize this buffer. */
-			continue;
-		} else if (ret != SR_OK) {
-			/* Module recognized this buffer, but cannot handle it. */
-			continue;
-		}
-		/* Found a matching module. */
-		sr_dbg("Module %s matched, confidence %u.", imod->id, conf);
-		if (conf >= best_conf)
-			continue;
-		best_imod = imod;
-		best_conf = conf;
-	}
+	best_imod = find_input_module(meta, avail_metadata, filename);
 	g_hash_table_destroy(meta);
 	g_string_free(header, TRUE);
 
@@ -589,6 +606,106 @@ SR_API int sr_input_send(const struct sr_input *in, GString *buf)
 	return in->module->receive((struct sr_input *)in, buf);
 }
 
+/*
+ * Pass the content of a mapped file to a module which lacks a
+ * receive_mapped() routine, in chunks. Optionally stop when the
+ * device instance became ready, like sr_input_send() would return.
+ */
+static int send_mapped_chunks(struct sr_input *in, gboolean until_ready)
+{
+	const char *data;
+	size_t length, size;
+	GString *chunk;
+	int ret;
+
+	data = g_mapped_file_get_contents(in->mapping);
+	length = g_mapped_file_get_length(in->mapping);
+	chunk = g_string_sized_new(CHUNK_SIZE);
+	ret = SR_OK;
+	while (in->mapping_offset < length) {
+		size = MIN(CHUNK_SIZE, length - in->mapping_offset);
+		g_string_truncate(chunk, 0);
+		g_string_append_len(chunk, &data[in->mapping_offset], size);
+		in->mapping_offset += size;
+		ret = sr_input_send(in, chunk);
+		if (ret != SR_OK)
+			break;
+		if (until_ready && in->sdi_ready)
+			break;
+	}
+	g_string_free(chunk, TRUE);
+
+	return ret;
+}
+
+/**
+ * Send the content of a file to the specified input instance.
+ *
+ * The file gets mapped into memory, instead of being read into buffers
+ * by the caller. Input modules which support this can send packets that
+ * reference the mapped data, the content of large files is not copied.
+ * Other modules receive the content in chunks, like from sr_input_send().
+ *
+ * Like sr_input_send(), this function returns as soon as the device
+ * instance is ready, and the caller can examine it. Content which was
+ * not processed by then, is processed by sr_input_end(). The mapping
+ * is kept until the input instance gets reset or freed. Only one file
+ * can be sent to an input instance this way. The file is mapped read-only,
+ * and is never modified.
+ *
+ * @param in The input instance. Must not be NULL.
+ * @param filename The name of the file. Must not be NULL or empty.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or a file was sent before.
+ * @retval SR_ERR The file could not be mapped.
+ * @retval other Error code of the input module.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_input_send_mapped(const struct sr_input *in_ro,
+		const char *filename)
+{
+	struct sr_input *in;
+	GError *error;
+	const uint8_t *data;
+	size_t length;
+
+	in = (struct sr_input *)in_ro;	/* "un-const" */
+	if (!in || !in->module || !filename || !filename[0])
+		return SR_ERR_ARG;
+	if (in->mapping) {
+		sr_err("A file was already sent to %s module.", in->module->id);
+		return SR_ERR_ARG;
+	}
+
+	/*
+	 * Packets reference the mapped data. Modules send them with
+	 * sr_session_send_readonly(), which copies the data for in place
+	 * transforms.
+	 */
+	error = NULL;
+	in->mapping = g_mapped_file_new(filename, FALSE, &error);
+	if (!in->mapping) {
+		sr_err("Failed to map %s: %s", filename, error->message);
+		g_error_free(error);
+		return SR_ERR;
+	}
+	in->mapping_offset = 0;
+
+	data = (const uint8_t *)g_mapped_file_get_contents(in->mapping);
+	length = g_mapped_file_get_length(in->mapping);
+	if (!length)
+		return SR_OK;
+	if (!in->module->receive_mapped)
+		return send_mapped_chunks(in, TRUE);
+
+	sr_spew("Sending %zu mapped bytes to %s module.",
+		length, in->module->id);
+	in->mapping_offset = length;
+	return in->module->receive_mapped(in, data, length);
+}
+
 /**
  * Signal the input module no more data will come.
  *
@@ -599,6 +716,15 @@ SR_API int sr_input_send(const struct sr_input *in, GString *buf)
  */
 SR_API int sr_input_end(const struct sr_input *in)
 {
+	int ret;
+
+	/* Send what remains of a file from sr_input_send_mapped(). */
+	if (in->mapping) {
+		ret = send_mapped_chunks((struct sr_input *)in, FALSE);
+		if (ret != SR_OK)
+			return ret;
+	}
+
 	sr_spew("Calling end() on %s module.", in->module->id);
 	return in->module->end((struct sr_input *)in);
 }
@@ -643,7 +769,8 @@ SR_API int sr_input_reset(const struct sr_input *in_ro)
 	 * clear the sdi_ready flag. This makes sure that subsequent
 	 * processing will scan the header again before sample data gets
 	 * interpreted, and stale content from previous calls won't affect
-	 * the result.
+	 * the result. A file from sr_input_send_mapped() gets unmapped,
+	 * the module holds no references to it after its reset.
 	 *
 	 * This common logic does not harm when the input module implements
 	 * .reset() and contains identical assignments. In the absence of
@@ -653,6 +780,10 @@ SR_API int sr_input_reset(const struct sr_input *in_ro)
 	if (in->buf)
 		g_string_truncate(in->buf, 0);
 	in->sdi_ready = FALSE;
+	if (in->mapping) {
+		g_mapped_file_unref(in->mapping);
+		in->mapping = NULL;
+	}
 
 	return rc;
 }
@@ -687,6 +818,8 @@ SR_API void sr_input_free(const struct sr_input *in)
 			" unprocessed bytes at free time.", in->buf->len);
 	}
 	g_string_free(in->buf, TRUE);
+	if (in->mapping)
+		g_mapped_file_unref(in->mapping);
 	g_free(in->priv);
 	g_free((gpointer)in);
 }
@@ -1032,6 +1032,7 @@ static int prepare_session_feed(struct sr_input *in)
 static int format_match(GHashTable *metadata, unsigned int *confidence)
 {
 	GString *buf, *tmpbuf;
+	const char *line_end;
 	int rc;
 	gchar *version, *build;
 
@@ -1039,7 +1040,11 @@ static int format_match(GHashTable *metadata, unsigned int *confidence)
 	buf = g_hash_table_lookup(metadata, GINT_TO_POINTER(SR_INPUT_META_HEADER));
 	if (!buf || !buf->str)
 		return SR_ERR_ARG;
-	tmpbuf = g_string_new_len(buf->str, buf->len);
+	if (strncmp(buf->str, "Version", strlen("Version")) != 0)
+		return SR_ERR;
+	line_end = memchr(buf->str, '\n', buf->len);
+	tmpbuf = g_string_new_len(buf->str,
+		line_end ? (gssize)(line_end - buf->str) : (gssize)buf->len);
 	if (!tmpbuf || !tmpbuf->str)
 		return SR_ERR_MALLOC;
 
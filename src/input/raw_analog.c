@@ -34,6 +34,7 @@
 #define CHUNK_SIZE		(4 * 1024 * 1024)
 #define DEFAULT_NUM_CHANNELS	1
 #define DEFAULT_SAMPLERATE	0
+#define DEFAULT_CONVERT		FALSE
 
 struct context {
 	gboolean started;
@@ -45,6 +46,13 @@ struct context {
 	struct sr_analog_encoding encoding;
 	struct sr_analog_meaning meaning;
 	struct sr_analog_spec spec;
+	/* Conversion to native float, into a buffer for one chunk. */
+	gboolean convert;
+	struct sr_analog_encoding raw_encoding;
+	float *float_buffer;
+	/* Mapped input data which was not sent yet. */
+	const uint8_t *mapped;
+	size_t mapped_len;
 };
 
 struct sample_format {
@@ -93,6 +101,23 @@ static void init_context(struct context *inc, const struct sample_format *fmt, G
 	inc->analog.spec = &inc->spec;
 
 	memcpy(&inc->encoding, &fmt->encoding, sizeof(inc->encoding));
+	memcpy(&inc->raw_encoding, &fmt->encoding, sizeof(inc->raw_encoding));
+
+	/* Converted samples are native floats, keep their precision. */
+	if (inc->convert) {
+		inc->encoding.unitsize = sizeof(float);
+		inc->encoding.is_signed = TRUE;
+		inc->encoding.is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+		inc->encoding.is_bigendian = TRUE;
+#else
+		inc->encoding.is_bigendian = FALSE;
+#endif
+		inc->encoding.scale.p = 1;
+		inc->encoding.scale.q = 1;
+		inc->encoding.offset.p = 0;
+		inc->encoding.offset.q = 1;
+	}
 
 	inc->meaning.mq = 0;
 	inc->meaning.unit = 0;
@@ -137,18 +162,50 @@ static int init(struct sr_input *in, GHashTable *options)
 
 	inc->samplerate = g_variant_get_uint64(g_hash_table_lookup(options, "samplerate"));
 	inc->samplesize = sample_formats[fmt_index].encoding.unitsize * num_channels;
+	inc->convert = g_variant_get_boolean(g_hash_table_lookup(options, "convert"));
 	init_context(inc, &sample_formats[fmt_index], in->sdi->channels);
+	if (inc->convert) {
+		inc->float_buffer = g_malloc_n(CHUNK_SIZE / inc->samplesize * num_channels,
+			sizeof(inc->float_buffer[0]));
+	}
 
 	return SR_OK;
 }
 
-static int process_buffer(struct sr_input *in)
+/* Send a number of samples, converting them if requested. */
+static void send_chunk(struct sr_input *in, const uint8_t *data,
+	size_t num_samples)
+{
+	struct context *inc;
+	struct sr_datafeed_analog raw;
+
+	inc = in->priv;
+	inc->analog.num_samples = num_samples;
+	if (inc->convert) {
+		/* The raw samples, in the format they were read in. */
+		raw = inc->analog;
+		raw.encoding = &inc->raw_encoding;
+		raw.data = (uint8_t *)data;
+		sr_analog_to_float(&raw, inc->float_buffer);
+		inc->analog.data = inc->float_buffer;
+	} else {
+		inc->analog.data = (uint8_t *)data;
+	}
+	sr_session_send_readonly(in->sdi, &inc->packet);
+}
+
+/*
+ * Send the samples in the given data, which can be the receive buffer
+ * or mapped input. Returns the number of bytes that were used.
+ */
+static size_t send_samples(struct sr_input *in,
+	const uint8_t *data, size_t length)
 {
 	struct context *inc;
 	struct sr_datafeed_meta meta;
 	struct sr_datafeed_packet packet;
 	struct sr_config *src;
-	unsigned int offset, chunk_size;
+	size_t offset, chunk_size, num_samples;
 
 	inc = in->priv;
 	if (!inc->started) {
@@ -168,30 +225,50 @@ static int process_buffer(struct sr_input *in)
 	}
 
 	/* Round down to the last channels * unitsize boundary. */
-	inc->analog.num_samples = CHUNK_SIZE / inc->samplesize;
-	chunk_size = inc->analog.num_samples * inc->samplesize;
+	num_samples = CHUNK_SIZE / inc->samplesize;
+	chunk_size = num_samples * inc->samplesize;
 	offset = 0;
 
-	while ((offset + chunk_size) < in->buf->len) {
-		inc->analog.data = in->buf->str + offset;
-		sr_session_send(in->sdi, &inc->packet);
+	while ((offset + chunk_size) < length) {
+		send_chunk(in, data + offset, num_samples);
 		offset += chunk_size;
 	}
 
-	inc->analog.num_samples = (in->buf->len - offset) / inc->samplesize;
-	chunk_size = inc->analog.num_samples * inc->samplesize;
+	num_samples = (length - offset) / inc->samplesize;
+	chunk_size = num_samples * inc->samplesize;
 	if (chunk_size > 0) {
-		inc->analog.data = in->buf->str + offset;
-		sr_session_send(in->sdi, &inc->packet);
+		send_chunk(in, data + offset, num_samples);
 		offset += chunk_size;
 	}
 
-	if ((unsigned int)offset < in->buf->len) {
+	return offset;
+}
+
+static int process_buffer(struct sr_input *in)
+{
+	struct context *inc;
+	size_t used;
+
+	/*
+	 * Mapped input gets sent in place. It precedes the content of
+	 * the receive buffer, a trailing partial sample is moved there.
+	 */
+	inc = in->priv;
+	if (inc->mapped_len) {
+		used = send_samples(in, inc->mapped, inc->mapped_len);
+		g_string_prepend_len(in->buf, (const char *)&inc->mapped[used],
+			inc->mapped_len - used);
+		inc->mapped = NULL;
+		inc->mapped_len = 0;
+	}
+
+	used = send_samples(in, (const uint8_t *)in->buf->str, in->buf->len);
+	if (used < in->buf->len) {
 		/*
 		 * The incoming buffer wasn't processed completely. Stash
 		 * the leftover data for next time.
 		 */
-		g_string_erase(in->buf, 0, offset);
+		g_string_erase(in->buf, 0, used);
 	} else {
 		g_string_truncate(in->buf, 0);
 	}
@@ -199,6 +276,29 @@ static int process_buffer(struct sr_input *in)
 	return SR_OK;
 }
 
+static int receive_mapped(struct sr_input *in,
+	const uint8_t *data, size_t length)
+{
+	struct context *inc;
+
+	/* Keep the order of data which was received before. */
+	inc = in->priv;
+	if (in->buf->len) {
+		g_string_append_len(in->buf, (const char *)data, length);
+	} else {
+		inc->mapped = data;
+		inc->mapped_len = length;
+	}
+
+	if (!in->sdi_ready) {
+		/* sdi is ready, notify frontend. */
+		in->sdi_ready = TRUE;
+		return SR_OK;
+	}
+
+	return process_buffer(in);
+}
+
 static int receive(struct sr_input *in, GString *buf)
 {
 	int ret;
@@ -237,6 +337,7 @@ static struct sr_option options[] = {
 	{ "numchannels", "Number of analog channels", "The number of (analog) channels in the data", NULL, NULL },
 	{ "samplerate", "Sample rate (Hz)", "The sample rate of the (analog) data in Hz", NULL, NULL },
 	{ "format", "Data format", "The format of the data (data type, signedness, endianness)", NULL, NULL },
+	{ "convert", "Convert to float", "Convert the data to native float values, instead of passing it on in its format", NULL, NULL },
 	ALL_ZERO
 };
 
@@ -246,6 +347,7 @@ static const struct sr_option *get_options(void)
 		options[0].def = g_variant_ref_sink(g_variant_new_int32(DEFAULT_NUM_CHANNELS));
 		options[1].def = g_variant_ref_sink(g_variant_new_uint64(DEFAULT_SAMPLERATE));
 		options[2].def = g_variant_ref_sink(g_variant_new_string(sample_formats[0].fmt_name));
+		options[3].def = g_variant_ref_sink(g_variant_new_boolean(DEFAULT_CONVERT));
 		for (unsigned int i = 0; i < ARRAY_SIZE(sample_formats); i++) {
 			options[2].values = g_slist_append(options[2].values,
 				g_variant_ref_sink(g_variant_new_string(sample_formats[i].fmt_name)));
@@ -257,12 +359,17 @@ static const struct sr_option *get_options(void)
 
 static void cleanup(struct sr_input *in)
 {
+	struct context *inc;
+
+	inc = in->priv;
+	g_free(inc->float_buffer);
 	g_free(in->priv);
 	in->priv = NULL;
 
 	g_variant_unref(options[0].def);
 	g_variant_unref(options[1].def);
 	g_variant_unref(options[2].def);
+	g_variant_unref(options[3].def);
 	g_slist_free_full(options[2].values, (GDestroyNotify)g_variant_unref);
 }
 
@@ -271,6 +378,8 @@ static int reset(struct sr_input *in)
 	struct context *inc = in->priv;
 
 	inc->started = FALSE;
+	inc->mapped = NULL;
+	inc->mapped_len = 0;
 
 	g_string_truncate(in->buf, 0);
 
@@ -285,6 +394,7 @@ SR_PRIV struct sr_input_module input_raw_analog = {
 	.options = get_options,
 	.init = init,
 	.receive = receive,
+	.receive_mapped = receive_mapped,
 	.end = end,
 	.cleanup = cleanup,
 	.reset = reset,
@@ -45,12 +45,13 @@
  * Based on Verilog standard IEEE Std 1364-2001 Version C
  *
  * Supported features:
- * - $var with 'wire' and 'reg' types of scalar variables
+ * - $var with 'wire' and 'reg' types of scalar and vector variables,
+ *   a vector of N bits becomes N logic channels, least significant
+ *   bit first
  * - $timescale definition for samplerate
  * - multiple character variable identifiers
  *
  * Most important unsupported features:
- * - vector variables (bit vectors etc.)
  * - analog, integer and real number variables
  * - $dumpvars initial value declaration
  * - $scope namespaces
@@ -86,11 +87,18 @@ struct context {
 	uint8_t *buffer;
 	uint8_t *current_levels;
 	GSList *prev_sr_channels;
+	/* Variables with single character identifiers, indexed by character. */
+	struct vcd_channel *ident_index['~' - '!' + 1];
+	/* Variables with longer identifiers. */
+	GHashTable *ident_table;
 };
 
 struct vcd_channel {
 	gchar *name;
 	gchar *identifier;
+	/* The first logic channel, and the number of bits. */
+	unsigned int channel;
+	unsigned int size;
 };
 
 /*
@@ -226,6 +234,70 @@ static int check_header_in_reread(const struct sr_input *in)
 	return TRUE;
 }
 
+/*
+ * Map an identifier to its variable. Single character identifiers, the
+ * most common ones, get looked up in a table, longer ones are hashed.
+ * When an identifier is used by several variables, the first one wins.
+ */
+static void add_identifier(struct context *inc, struct vcd_channel *vcd_ch)
+{
+	const char *identifier;
+	struct vcd_channel **idx;
+
+	identifier = vcd_ch->identifier;
+	if (identifier[0] >= '!' && identifier[0] <= '~' && !identifier[1]) {
+		idx = &inc->ident_index[identifier[0] - '!'];
+		if (!*idx)
+			*idx = vcd_ch;
+		return;
+	}
+
+	if (!inc->ident_table)
+		inc->ident_table = g_hash_table_new(g_str_hash, g_str_equal);
+	if (!g_hash_table_contains(inc->ident_table, identifier))
+		g_hash_table_insert(inc->ident_table, (gpointer)identifier, vcd_ch);
+}
+
+/* Returns the variable of an identifier, or NULL if there is none. */
+static struct vcd_channel *find_identifier(const struct context *inc,
+		const char *identifier)
+{
+	if (identifier[0] >= '!' && identifier[0] <= '~' && !identifier[1])
+		return inc->ident_index[identifier[0] - '!'];
+	if (!inc->ident_table)
+		return NULL;
+
+	return g_hash_table_lookup(inc->ident_table, identifier);
+}
+
+/*
+ * Get the bit numbers of a vector variable from its "[msb:lsb]" suffix,
+ * and cut it off the name. Without a matching suffix, bits are numbered
+ * from 0.
+ */
+static void parse_vector_range(gchar *name, unsigned int size,
+		long *lsb, long *step)
+{
+	char *range, *end;
+	long msb;
+
+	*lsb = 0;
+	*step = 1;
+	if (!(range = strrchr(name, '[')))
+		return;
+	msb = strtol(range + 1, &end, 10);
+	if (end == range + 1 || *end != ':')
+		return;
+	*lsb = strtol(end + 1, &end, 10);
+	if (strcmp(end, "]") || (unsigned long)ABS(msb - *lsb) + 1 != size) {
+		*lsb = 0;
+		return;
+	}
+	if (msb < *lsb)
+		*step = -1;
+	*range = '\0';
+}
+
 /*
  * Parse VCD header to get values for context structure.
  * The context structure should be zeroed before calling this.
@@ -266,19 +338,25 @@ static gboolean parse_header(const struct sr_input *in, GString *buf)
 			}
 		} else if (g_strcmp0(name, "var") == 0) {
 			/* Format: $var type size identifier reference [opt. index] $end */
-			unsigned int length;
+			unsigned int length, size, i;
+			long lsb, step, value;
+			char *chname;
 
 			parts = g_strsplit_set(contents, " \r\n\t", 0);
 			remove_empty_parts(parts);
 			length = g_strv_length(parts);
 
+			/* Check the range before it gets unsigned. */
+			value = length > 1 ? strtol(parts[1], NULL, 10) : 0;
+			size = value >= 1 && value <= G_MAXINT ? value : 0;
+
 			if (length != 4 && length != 5)
 				sr_warn("$var section should have 4 or 5 items");
 			else if (g_strcmp0(parts[0], "reg") != 0 && g_strcmp0(parts[0], "wire") != 0)
 				sr_info("Unsupported signal type: '%s'", parts[0]);
-			else if (strtol(parts[1], NULL, 10) != 1)
+			else if (!size)
 				sr_info("Unsupported signal size: '%s'", parts[1]);
-			else if (inc->maxchannels && inc->channelcount >= inc->maxchannels)
+			else if (inc->maxchannels && inc->channelcount + size > inc->maxchannels)
 				sr_warn("Skipping '%s%s' because only %d channels requested.",
 					parts[3], parts[4] ? : "", inc->maxchannels);
 			else {
@@ -288,11 +366,28 @@ static gboolean parse_header(const struct sr_input *in, GString *buf)
 					vcd_ch->name = g_strdup(parts[3]);
 				else
 					vcd_ch->name = g_strconcat(parts[3], parts[4], NULL);
+				vcd_ch->channel = inc->channelcount;
+				vcd_ch->size = size;
 
-				sr_info("Channel %d is '%s' identified by '%s'.",
+				if (size == 1) {
+					sr_info("Channel %d is '%s' identified by '%s'.",
 						inc->channelcount, vcd_ch->name, vcd_ch->identifier);
-
-				sr_channel_new(in->sdi, inc->channelcount++, SR_CHANNEL_LOGIC, TRUE, vcd_ch->name);
+					sr_channel_new(in->sdi, inc->channelcount++,
+						SR_CHANNEL_LOGIC, TRUE, vcd_ch->name);
+				} else {
+					parse_vector_range(vcd_ch->name, size, &lsb, &step);
+					sr_info("Channels %d-%d are '%s' identified by '%s'.",
+						inc->channelcount, inc->channelcount + size - 1,
+						vcd_ch->name, vcd_ch->identifier);
+					for (i = 0; i < size; i++) {
+						chname = g_strdup_printf("%s[%ld]",
+							vcd_ch->name, lsb + (long)i * step);
+						sr_channel_new(in->sdi, inc->channelcount++,
+							SR_CHANNEL_LOGIC, TRUE, chname);
+						g_free(chname);
+					}
+				}
+				add_identifier(inc, vcd_ch);
 				inc->channels = g_slist_append(inc->channels, vcd_ch);
 			}
 
@@ -327,8 +422,19 @@ static int format_match(GHashTable *metadata, unsigned int *confidence)
 	GString *buf, *tmpbuf;
 	gboolean status;
 	gchar *name, *contents;
+	size_t pos;
 
 	buf = g_hash_table_lookup(metadata, GINT_TO_POINTER(SR_INPUT_META_HEADER));
+
+	/* Cheap check for the section tag before copying the buffer. */
+	pos = 0;
+	if (buf->len >= 3 && !strncmp(buf->str, "\xef\xbb\xbf", 3))
+		pos = 3;
+	while (pos < buf->len && g_ascii_isspace(buf->str[pos]))
+		pos++;
+	if (pos >= buf->len || buf->str[pos] != '$')
+		return SR_ERR;
+
 	tmpbuf = g_string_new_len(buf->str, buf->len);
 
 	/*
@@ -375,54 +481,103 @@ static void send_buffer(const struct sr_input *in)
 static void add_samples(const struct sr_input *in, size_t count)
 {
 	struct context *inc;
-	size_t samples_per_chunk;
-	size_t space_left, i;
+	size_t samples_per_chunk, unitsize;
+	size_t space_left, total, done, len;
+	gboolean filled;
 	uint8_t *p;
 
 	inc = in->priv;
-	samples_per_chunk = CHUNK_SIZE / inc->bytes_per_sample;
+	unitsize = inc->bytes_per_sample;
+	samples_per_chunk = CHUNK_SIZE / unitsize;
+	filled = FALSE;
 
 	while (count) {
-		space_left = samples_per_chunk - inc->samples_in_buffer;
-
-		if (space_left > count)
-			space_left = count;
-
-		p = inc->buffer + inc->samples_in_buffer * inc->bytes_per_sample;
-		for (i = 0; i < space_left; i++) {
-			memcpy(p, inc->current_levels, inc->bytes_per_sample);
-			p += inc->bytes_per_sample;
-			inc->samples_in_buffer++;
-			count--;
+		space_left = MIN(samples_per_chunk - inc->samples_in_buffer, count);
+
+		/*
+		 * Long idle periods span several chunks. Once a whole chunk
+		 * holds the current levels, keep sending it as it is.
+		 */
+		if (!filled || space_left < samples_per_chunk) {
+			p = inc->buffer + inc->samples_in_buffer * unitsize;
+			total = space_left * unitsize;
+			if (unitsize == 1) {
+				memset(p, inc->current_levels[0], total);
+			} else {
+				/* Copy the sample once, then keep doubling the copies. */
+				memcpy(p, inc->current_levels, unitsize);
+				for (done = unitsize; done < total; done += len) {
+					len = MIN(done, total - done);
+					memcpy(p + done, p, len);
+				}
+			}
+			filled = space_left == samples_per_chunk;
 		}
+		inc->samples_in_buffer += space_left;
+		count -= space_left;
 
 		if (inc->samples_in_buffer == samples_per_chunk)
 			send_buffer(in);
 	}
 }
 
-/* Set the channel level depending on the identifier and parsed value. */
-static void process_bit(struct context *inc, char *identifier, unsigned int bit)
+/*
+ * Set the channel levels of a variable from a value, which is a string
+ * of 0/1/x/z digits, most significant bit first. Values shorter than
+ * the variable get extended, values longer than it get truncated. The
+ * x and z states read as low, just like the padding does.
+ */
+static void process_value(struct context *inc, const char *identifier,
+		const char *value, size_t len)
 {
-	GSList *l;
 	struct vcd_channel *vcd_ch;
-	unsigned int j;
-
-	for (j = 0, l = inc->channels; j < inc->channelcount && l; j++, l = l->next) {
-		vcd_ch = l->data;
-		if (g_strcmp0(identifier, vcd_ch->identifier) == 0) {
-			/* Found our channel. */
-			size_t byte_idx = (j / 8);
-			size_t bit_idx = j - 8 * byte_idx;
-			if (bit)
-				inc->current_levels[byte_idx] |= (uint8_t)1 << bit_idx;
-			else
-				inc->current_levels[byte_idx] &= ~((uint8_t)1 << bit_idx);
-			break;
-		}
-	}
-	if (j == inc->channelcount)
+	size_t byte_idx, bit_idx;
+	unsigned int i, j;
+
+	if (!(vcd_ch = find_identifier(inc, identifier))) {
 		sr_dbg("Did not find channel for identifier '%s'.", identifier);
+		return;
+	}
+
+	for (i = 0; i < vcd_ch->size; i++) {
+		j = vcd_ch->channel + i;
+		byte_idx = j / 8;
+		bit_idx = j % 8;
+		if (i < len && value[len - 1 - i] == '1')
+			inc->current_levels[byte_idx] |= (uint8_t)1 << bit_idx;
+		else
+			inc->current_levels[byte_idx] &= ~((uint8_t)1 << bit_idx);
+	}
+}
+
+static gboolean is_token_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/*
+ * Get the next space-delimited token, or NULL at the end of the text.
+ * The token gets terminated in place, no memory is allocated.
+ */
+static char *next_token(char **text)
+{
+	char *p, *token;
+
+	p = *text;
+	while (is_token_space(*p))
+		p++;
+	if (!*p) {
+		*text = p;
+		return NULL;
+	}
+	token = p;
+	while (*p && !is_token_space(*p))
+		p++;
+	if (*p)
+		*p++ = '\0';
+	*text = p;
+
+	return token;
 }
 
 /* Parse a set of lines from the data section. */
@@ -430,25 +585,22 @@ static void parse_contents(const struct sr_input *in, char *data)
 {
 	struct context *inc;
 	uint64_t timestamp;
-	unsigned int bit, i;
-	char **tokens;
+	char *token, *identifier;
 
 	inc = in->priv;
 
 	/* Read one space-delimited token at a time. */
-	tokens = g_strsplit_set(data, " \t\r\n", 0);
-	remove_empty_parts(tokens);
-	for (i = 0; tokens[i]; i++) {
+	while ((token = next_token(&data))) {
 		if (inc->skip_until_end) {
-			if (!strcmp(tokens[i], "$end")) {
+			if (!strcmp(token, "$end")) {
 				/* Done with unhandled/unknown section. */
 				inc->skip_until_end = FALSE;
 				break;
 			}
 		}
-		if (tokens[i][0] == '#' && g_ascii_isdigit(tokens[i][1])) {
+		if (token[0] == '#' && g_ascii_isdigit(token[1])) {
 			/* Numeric value beginning with # is a new timestamp value */
-			timestamp = strtoull(tokens[i] + 1, NULL, 10);
+			timestamp = strtoull(token + 1, NULL, 10);
 
 			if (inc->downsample > 1)
 				timestamp /= inc->downsample;
@@ -481,68 +633,60 @@ static void parse_contents(const struct sr_input *in, char *data)
 				add_samples(in, timestamp - inc->prev_timestamp);
 				inc->prev_timestamp = timestamp;
 			}
-		} else if (tokens[i][0] == '$' && tokens[i][1] != '\0') {
+		} else if (token[0] == '$' && token[1] != '\0') {
 			/*
 			 * This is probably a $dumpvars, $comment or similar.
 			 * $dump* contain useful data.
 			 */
-			if (g_strcmp0(tokens[i], "$dumpvars") == 0
-					|| g_strcmp0(tokens[i], "$dumpon") == 0
-					|| g_strcmp0(tokens[i], "$dumpoff") == 0
-					|| g_strcmp0(tokens[i], "$end") == 0) {
+			if (!strcmp(token, "$dumpvars")
+					|| !strcmp(token, "$dumpon")
+					|| !strcmp(token, "$dumpoff")
+					|| !strcmp(token, "$end")) {
 				/* Ignore, parse contents as normally. */
 			} else {
 				/* Ignore this and future lines until $end. */
 				inc->skip_until_end = TRUE;
 				break;
 			}
-		} else if (strchr("rR", tokens[i][0]) != NULL) {
+		} else if (token[0] == 'r' || token[0] == 'R') {
 			sr_dbg("Real type vector values not supported yet!");
-			if (!tokens[++i])
+			if (!next_token(&data))
 				/* No tokens left, bail out */
 				break;
 			else
 				/* Process next token */
 				continue;
-		} else if (strchr("bB", tokens[i][0]) != NULL) {
-			bit = (tokens[i][1] == '1');
-
+		} else if (token[0] == 'b' || token[0] == 'B') {
 			/*
 			 * Bail out if a) char after 'b' is NUL, or b) there is
-			 * a second character after 'b', or c) there is no
-			 * identifier.
+			 * no identifier.
 			 */
-			if (!tokens[i][1] || tokens[i][2] || !tokens[++i]) {
+			if (!token[1] || !(identifier = next_token(&data))) {
 				sr_dbg("Unexpected vector format!");
 				break;
 			}
 
-			process_bit(inc, tokens[i], bit);
-		} else if (strchr("01xXzZ", tokens[i][0]) != NULL) {
-			char *identifier;
-
+			process_value(inc, identifier, token + 1, strlen(token + 1));
+		} else if (strchr("01xXzZ", token[0]) != NULL) {
 			/* A new 1-bit sample value */
-			bit = (tokens[i][0] == '1');
 
 			/*
 			 * The identifier is either the next character, or, if
 			 * there was whitespace after the bit, the next token.
 			 */
-			if (tokens[i][1] == '\0') {
-				if (!tokens[++i]) {
+			if (token[1] == '\0') {
+				if (!(identifier = next_token(&data))) {
 					sr_dbg("Identifier missing!");
 					break;
 				}
-				identifier = tokens[i];
 			} else {
-				identifier = tokens[i] + 1;
+				identifier = token + 1;
 			}
-			process_bit(inc, identifier, bit);
+			process_value(inc, identifier, token, 1);
 		} else {
-			sr_warn("Skipping unknown token '%s'.", tokens[i]);
+			sr_warn("Skipping unknown token '%s'.", token);
 		}
 	}
-	g_strfreev(tokens);
 }
 
 static int init(struct sr_input *in, GHashTable *options)
@@ -609,11 +753,10 @@ static int process_buffer(struct sr_input *in)
 		inc->started = TRUE;
 	}
 
+	/* Parse all complete lines, the tokenizer skips white space. */
 	while ((p = g_strrstr_len(in->buf->str, in->buf->len, "\n"))) {
 		*p = '\0';
-		g_strstrip(in->buf->str);
-		if (in->buf->str[0] != '\0')
-			parse_contents(in, in->buf->str);
+		parse_contents(in, in->buf->str);
 		g_string_erase(in->buf, 0, p - in->buf->str + 1);
 	}
 
@@ -672,6 +815,10 @@ static void cleanup(struct sr_input *in)
 
 	inc = in->priv;
 	keep_header_for_reread(in);
+	if (inc->ident_table)
+		g_hash_table_destroy(inc->ident_table);
+	inc->ident_table = NULL;
+	memset(inc->ident_index, 0, sizeof(inc->ident_index));
 	g_slist_free_full(inc->channels, free_channel);
 	inc->channels = NULL;
 
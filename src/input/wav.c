@@ -36,42 +36,153 @@
 /* Minimum size of header + 1 8-bit mono PCM sample. */
 #define MIN_DATA_CHUNK_OFFSET    45
 
-/* Expect to find the "data" chunk within this offset from the start. */
-#define MAX_DATA_CHUNK_OFFSET    1024
+/* Expect to find the "fmt " chunk within this offset from the start. */
+#define MAX_FMT_CHUNK_OFFSET     (64 * 1024)
 
 #define WAVE_FORMAT_PCM_         0x0001
 #define WAVE_FORMAT_IEEE_FLOAT_  0x0003
 #define WAVE_FORMAT_EXTENSIBLE_  0xfffe
 
+/*
+ * Supported containers. Classic RIFF files have 32bit sizes. RF64 (and
+ * its BW64 variant) has the same layout, but takes the sizes of the
+ * file and of the "data" chunk from a "ds64" chunk. Sony Wave64 uses
+ * GUIDs as chunk IDs, and 64bit sizes which include the chunk header.
+ * The first four bytes of the Wave64 GUIDs spell the RIFF chunk IDs.
+ */
+enum wav_container {
+	CONTAINER_RIFF,
+	CONTAINER_RF64,
+	CONTAINER_W64,
+};
+
+static const uint8_t w64_riff_guid[] = {
+	'r', 'i', 'f', 'f', 0x2e, 0x91, 0xcf, 0x11,
+	0xa5, 0xd6, 0x28, 0xdb, 0x04, 0xc1, 0x00, 0x00,
+};
+
+/* All other Wave64 GUIDs share these trailing bytes. */
+static const uint8_t w64_guid_tail[] = {
+	0xf3, 0xac, 0xd3, 0x11, 0x8c, 0xd1, 0x00, 0xc0,
+	0x4f, 0x8e, 0xdb, 0x8a,
+};
+
+/* Size of the header in front of the first chunk. */
+#define RIFF_FORM_SIZE           12
+#define W64_FORM_SIZE            40
+
+/* Sizes of chunk headers. */
+#define RIFF_CHUNK_HEADER_SIZE   8
+#define W64_CHUNK_HEADER_SIZE    24
+
+/* Data size of RIFF files which were written without knowing it. */
+#define RIFF_SIZE_UNKNOWN        0xffffffff
+
 struct context {
 	gboolean started;
+	int container;
 	int fmt_code;
 	uint64_t samplerate;
 	int samplesize;
 	int num_channels;
 	int unitsize;
+	uint64_t ds64_data_size;
 	gboolean found_data;
 	gboolean create_channels;
+	/*
+	 * Position in the stream of chunks: the number of bytes to skip,
+	 * or the number of sample data bytes which are left. Without
+	 * either, a chunk header is expected next.
+	 */
+	uint64_t skip_remain;
+	uint64_t data_remain;
+	uint64_t data_pad;
+	/* Converted samples of one chunk, one block per channel. */
+	float *float_buffer;
+	/* Mapped input data which was not sent yet. */
+	const uint8_t *mapped;
+	size_t mapped_len;
 };
 
-static int parse_wav_header(GString *buf, struct context *inc)
+static int get_container(const uint8_t *buf, size_t len)
+{
+	if (len < RIFF_FORM_SIZE)
+		return -1;
+	if (!memcmp(buf, "RIFF", 4) && !memcmp(buf + 8, "WAVE", 4))
+		return CONTAINER_RIFF;
+	if ((!memcmp(buf, "RF64", 4) || !memcmp(buf, "BW64", 4))
+			&& !memcmp(buf + 8, "WAVE", 4))
+		return CONTAINER_RF64;
+	if (len < W64_FORM_SIZE)
+		return -1;
+	if (!memcmp(buf, w64_riff_guid, sizeof(w64_riff_guid))
+			&& !memcmp(buf + 24, "wave", 4)
+			&& !memcmp(buf + 28, w64_guid_tail, sizeof(w64_guid_tail)))
+		return CONTAINER_W64;
+
+	return -1;
+}
+
+static size_t chunk_header_size(int container)
+{
+	return container == CONTAINER_W64 ?
+		W64_CHUNK_HEADER_SIZE : RIFF_CHUNK_HEADER_SIZE;
+}
+
+/* Check the ID of the chunk header at p. */
+static gboolean chunk_is(int container, const uint8_t *p, const char *id)
+{
+	if (memcmp(p, id, 4))
+		return FALSE;
+	if (container == CONTAINER_W64)
+		return !memcmp(p + 4, w64_guid_tail, sizeof(w64_guid_tail));
+
+	return TRUE;
+}
+
+/*
+ * Get the size of the data in the chunk at p, and the size of its
+ * padding. Chunks are padded to an even size in RIFF, and to a multiple
+ * of eight bytes in Wave64 files.
+ */
+static uint64_t chunk_data_size(int container, const uint8_t *p,
+	uint64_t *pad)
+{
+	uint64_t size;
+
+	if (container == CONTAINER_W64) {
+		size = RL64(p + 16);
+		size = size > W64_CHUNK_HEADER_SIZE ?
+			size - W64_CHUNK_HEADER_SIZE : 0;
+		*pad = (8 - size % 8) % 8;
+	} else {
+		size = RL32(p + 4);
+		*pad = size % 2;
+	}
+
+	return size;
+}
+
+static int parse_fmt_chunk(const uint8_t *fmt, uint64_t fmt_size,
+	struct context *inc)
 {
 	uint64_t samplerate;
 	unsigned int fmt_code, samplesize, num_channels, unitsize;
 
-	if (buf->len < MIN_DATA_CHUNK_OFFSET)
-		return SR_ERR_NA;
-
-	fmt_code = RL16(buf->str + 20);
-	samplerate = RL32(buf->str + 24);
+	if (fmt_size < 16) {
+		sr_err("WAV format chunk is too short.");
+		return SR_ERR;
+	}
+	fmt_code = RL16(fmt);
+	samplerate = RL32(fmt + 4);
 
-	samplesize = RL16(buf->str + 32);
-	num_channels = RL16(buf->str + 22);
+	samplesize = RL16(fmt + 12);
+	num_channels = RL16(fmt + 2);
 	if (num_channels == 0)
 		return SR_ERR;
 	unitsize = samplesize / num_channels;
-	if (unitsize != 1 && unitsize != 2 && unitsize != 4) {
-		sr_err("Only 8, 16 or 32 bits per sample supported.");
+	if (unitsize < 1 || unitsize > 4) {
+		sr_err("Only 8, 16, 24 or 32 bits per sample supported.");
 		return SR_ERR_DATA;
 	}
 
@@ -82,24 +193,20 @@ static int parse_wav_header(GString *buf, struct context *inc)
 			return SR_ERR_DATA;
 		}
 	} else if (fmt_code == WAVE_FORMAT_EXTENSIBLE_) {
-		if (buf->len < 70)
-			/* Not enough for extensible header and next chunk. */
-			return SR_ERR_NA;
-
-		if (RL16(buf->str + 16) != 40) {
+		if (fmt_size != 40) {
 			sr_err("WAV extensible format chunk must be 40 bytes.");
 			return SR_ERR;
 		}
-		if (RL16(buf->str + 36) != 22) {
+		if (RL16(fmt + 16) != 22) {
 			sr_err("WAV extension must be 22 bytes.");
 			return SR_ERR;
 		}
-		if (RL16(buf->str + 34) != RL16(buf->str + 38)) {
+		if (RL16(fmt + 14) != RL16(fmt + 18)) {
 			sr_err("Reduced valid bits per sample not supported.");
 			return SR_ERR_DATA;
 		}
 		/* Real format code is the first two bytes of the GUID. */
-		fmt_code = RL16(buf->str + 44);
+		fmt_code = RL16(fmt + 24);
 		if (fmt_code != WAVE_FORMAT_PCM_ && fmt_code != WAVE_FORMAT_IEEE_FLOAT_) {
 			sr_err("Only PCM and floating point samples are supported.");
 			return SR_ERR_DATA;
@@ -125,23 +232,78 @@ static int parse_wav_header(GString *buf, struct context *inc)
 	return SR_OK;
 }
 
+/*
+ * Parse the file header: the container, its "ds64" chunk for RF64,
+ * and the "fmt " chunk. Chunks in front of "fmt " get skipped. RF64
+ * files must have their "ds64" chunk in front of "fmt ", it has the
+ * size of the sample data.
+ */
+static int parse_wav_header(const uint8_t *buf, size_t len,
+	struct context *inc)
+{
+	int container, ret;
+	size_t offset, header_size;
+	uint64_t size, pad;
+	gboolean have_ds64;
+
+	if (len < MIN_DATA_CHUNK_OFFSET)
+		return SR_ERR_NA;
+	container = get_container(buf, len);
+	if (container < 0)
+		return SR_ERR;
+
+	header_size = chunk_header_size(container);
+	offset = container == CONTAINER_W64 ? W64_FORM_SIZE : RIFF_FORM_SIZE;
+	have_ds64 = FALSE;
+	while (offset + header_size <= len) {
+		if (chunk_is(container, buf + offset, "data"))
+			break;
+		size = chunk_data_size(container, buf + offset, &pad);
+		if (size > len - offset - header_size)
+			break;
+		if (container == CONTAINER_RF64 && chunk_is(container, buf + offset, "ds64")) {
+			if (size < 16) {
+				sr_err("RF64 ds64 chunk is too short.");
+				return SR_ERR;
+			}
+			if (inc)
+				inc->ds64_data_size = RL64(buf + offset + header_size + 8);
+			have_ds64 = TRUE;
+		} else if (chunk_is(container, buf + offset, "fmt ")) {
+			if (container == CONTAINER_RF64 && !have_ds64) {
+				sr_err("RF64 file has no ds64 chunk.");
+				return SR_ERR_DATA;
+			}
+			ret = parse_fmt_chunk(buf + offset + header_size, size, inc);
+			if (ret == SR_OK && inc)
+				inc->container = container;
+			return ret;
+		}
+		offset += header_size + size + pad;
+	}
+
+	/* The format must be known before the sample data starts. */
+	if (len < MAX_FMT_CHUNK_OFFSET && !(offset + header_size <= len
+			&& chunk_is(container, buf + offset, "data")))
+		return SR_ERR_NA;
+	sr_err("Couldn't find format chunk.");
+
+	return SR_ERR;
+}
+
 static int format_match(GHashTable *metadata, unsigned int *confidence)
 {
 	GString *buf;
 	int ret;
 
 	buf = g_hash_table_lookup(metadata, GINT_TO_POINTER(SR_INPUT_META_HEADER));
-	if (strncmp(buf->str, "RIFF", 4))
-		return SR_ERR;
-	if (strncmp(buf->str + 8, "WAVE", 4))
-		return SR_ERR;
-	if (strncmp(buf->str + 12, "fmt ", 4))
+	if (get_container((const uint8_t *)buf->str, buf->len) < 0)
 		return SR_ERR;
 	/*
 	 * Only gets called when we already know this is a WAV file, so
 	 * this parser can log error messages.
 	 */
-	if ((ret = parse_wav_header(buf, NULL)) != SR_OK)
+	if ((ret = parse_wav_header((const uint8_t *)buf->str, buf->len, NULL)) != SR_OK)
 		return ret;
 
 	*confidence = 1;
@@ -164,32 +326,57 @@ static int init(struct sr_input *in, GHashTable *options)
 	return SR_OK;
 }
 
-static int find_data_chunk(GString *buf, int initial_offset)
+/*
+ * Convert the interleaved samples of all channels in one pass, into one
+ * block of floats per channel. The format is checked outside the loops,
+ * which read with plain loads and have no branches, so that compilers
+ * can vectorize them.
+ */
+#define CONVERT_FRAMES(read) \
+	do { \
+		for (i = 0; i < num_samples; i++) { \
+			for (ch = 0; ch < num_channels; ch++) { \
+				out[ch * num_samples + i] = (read); \
+				s += unitsize; \
+			} \
+		} \
+	} while (0)
+
+static void convert_samples(const struct context *inc, const uint8_t *s,
+	size_t num_samples, float *out)
 {
-	unsigned int offset, i;
-
-	offset = initial_offset;
-	while (offset < MIN(MAX_DATA_CHUNK_OFFSET, buf->len)) {
-		if (!memcmp(buf->str + offset, "data", 4))
-			/* Skip into the samples. */
-			return offset + 8;
-		for (i = 0; i < 4; i++) {
-			if (!isalnum(buf->str[offset + i])
-					&& !isblank(buf->str[offset + i]))
-				/* Doesn't look like a chunk ID. */
-				return -1;
-		}
-		/* Skip past this chunk. */
-		offset += 8 + RL32(buf->str + offset + 4);
-	}
+	size_t i, ch, num_channels, unitsize;
 
-	if (offset > MAX_DATA_CHUNK_OFFSET)
-		return -1;
+	num_channels = inc->num_channels;
+	unitsize = inc->unitsize;
 
-	return offset;
+	if (inc->fmt_code != WAVE_FORMAT_PCM_) {
+		/* BINARY32 float */
+		CONVERT_FRAMES(RLFL(s));
+		return;
+	}
+	switch (unitsize) {
+	case 1:
+		/* 8-bit PCM samples are unsigned. */
+		CONVERT_FRAMES(*s / (float)255);
+		break;
+	case 2:
+		CONVERT_FRAMES(RL16S(s) / (float)INT16_MAX);
+		break;
+	case 3:
+		/* 24-bit PCM scales like 32-bit PCM with a zero low byte. */
+		CONVERT_FRAMES((int32_t)((uint32_t)RL16(s) << 8 |
+			(uint32_t)s[2] << 24) / (float)INT32_MAX);
+		break;
+	case 4:
+		CONVERT_FRAMES(RL32S(s) / (float)INT32_MAX);
+		break;
+	}
 }
 
-static void send_chunk(const struct sr_input *in, int offset, int num_samples)
+/* Send a number of frames, as one packet per channel. */
+static void send_chunk(const struct sr_input *in, const uint8_t *data,
+	size_t num_samples)
 {
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_analog analog;
@@ -197,57 +384,96 @@ static void send_chunk(const struct sr_input *in, int offset, int num_samples)
 	struct sr_analog_meaning meaning;
 	struct sr_analog_spec spec;
 	struct context *inc;
-	float *fdata;
-	int total_samples, samplenum;
-	char *s, *d;
+	GSList *l;
 
 	inc = in->priv;
 
-	total_samples = num_samples * inc->num_channels;
-	fdata = g_malloc0(total_samples * sizeof(float));
-	s = in->buf->str + offset;
-	d = (char *)fdata;
-
-	for (samplenum = 0; samplenum < total_samples; samplenum++) {
-		if (inc->fmt_code == WAVE_FORMAT_PCM_) {
-			switch (inc->unitsize) {
-			case 1:
-				/* 8-bit PCM samples are unsigned. */
-				fdata[samplenum] = *(uint8_t*)(s) / (float)255;
-				break;
-			case 2:
-				fdata[samplenum] = RL16S(s) / (float)INT16_MAX;
-				break;
-			case 4:
-				fdata[samplenum] = RL32S(s) / (float)INT32_MAX;
-				break;
-			}
-		} else {
-			/* BINARY32 float */
-#ifdef WORDS_BIGENDIAN
-			int i;
-			for (i = 0; i < inc->unitsize; i++)
-				d[i] = s[inc->unitsize - 1 - i];
-#else
-			memcpy(d, s, inc->unitsize);
-#endif
-		}
-		s += inc->unitsize;
-		d += inc->unitsize;
+	if (!inc->float_buffer) {
+		inc->float_buffer = g_malloc_n(CHUNK_SIZE / inc->samplesize * inc->num_channels,
+			sizeof(inc->float_buffer[0]));
 	}
+	convert_samples(inc, data, num_samples, inc->float_buffer);
 
 	/* TODO: Use proper 'digits' value for this device (and its modes). */
 	sr_analog_init(&analog, &encoding, &meaning, &spec, 2);
 	packet.type = SR_DF_ANALOG;
 	packet.payload = &analog;
 	analog.num_samples = num_samples;
-	analog.data = fdata;
-	analog.meaning->channels = in->sdi->channels;
 	analog.meaning->mq = 0;
 	analog.meaning->mqflags = 0;
 	analog.meaning->unit = 0;
-	sr_session_send(in->sdi, &packet);
-	g_free(fdata);
+	analog.data = inc->float_buffer;
+	for (l = in->sdi->channels; l; l = l->next) {
+		analog.meaning->channels = g_slist_append(NULL, l->data);
+		sr_session_send(in->sdi, &packet);
+		g_slist_free(analog.meaning->channels);
+		analog.data = (float *)analog.data + num_samples;
+	}
+}
+
+/*
+ * Walk the chunks in the given data, which can be the receive buffer
+ * or mapped input. Sample data gets sent, other chunks get skipped.
+ * Returns the number of bytes that were used.
+ */
+static size_t process_data(struct sr_input *in, const uint8_t *data,
+	size_t length)
+{
+	struct context *inc;
+	size_t offset, header_size, max_chunk_samples, num_samples, size;
+	uint64_t pad;
+
+	inc = in->priv;
+	header_size = chunk_header_size(inc->container);
+	max_chunk_samples = CHUNK_SIZE / inc->samplesize;
+	offset = 0;
+	while (offset < length) {
+		if (inc->skip_remain) {
+			size = MIN(inc->skip_remain, length - offset);
+			inc->skip_remain -= size;
+			offset += size;
+			continue;
+		}
+		if (inc->data_remain) {
+			/* Round off up to the last channels * unitsize boundary. */
+			size = MIN(inc->data_remain, length - offset);
+			num_samples = size / inc->samplesize;
+			if (!num_samples)
+				break;
+			num_samples = MIN(num_samples, max_chunk_samples);
+			send_chunk(in, data + offset, num_samples);
+			size = num_samples * inc->samplesize;
+			offset += size;
+			inc->data_remain -= size;
+			/* Skip a partial frame at the end of the data. */
+			if (inc->data_remain < (uint64_t)inc->samplesize) {
+				inc->skip_remain = inc->data_remain + inc->data_pad;
+				inc->data_remain = 0;
+			}
+			continue;
+		}
+
+		/* Get the next chunk header. */
+		if (length - offset < header_size)
+			break;
+		size = chunk_data_size(inc->container, data + offset, &pad);
+		if (chunk_is(inc->container, data + offset, "data")) {
+			if (inc->container == CONTAINER_RF64)
+				size = inc->ds64_data_size;
+			else if (inc->container == CONTAINER_RIFF
+					&& (size == RIFF_SIZE_UNKNOWN || !size))
+				size = UINT64_MAX;
+			sr_dbg("Found data chunk of %" PRIu64 " bytes.", (uint64_t)size);
+			inc->found_data = TRUE;
+			inc->data_remain = size;
+			inc->data_pad = pad;
+		} else {
+			inc->skip_remain = size + pad;
+		}
+		offset += header_size;
+	}
+
+	return offset;
 }
 
 static int process_buffer(struct sr_input *in)
@@ -256,8 +482,7 @@ static int process_buffer(struct sr_input *in)
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_meta meta;
 	struct sr_config *src;
-	int offset, chunk_samples, total_samples, processed, max_chunk_samples;
-	int num_samples, i;
+	size_t used;
 
 	inc = in->priv;
 	if (!inc->started) {
@@ -271,57 +496,95 @@ static int process_buffer(struct sr_input *in)
 		g_slist_free(meta.config);
 		sr_config_free(src);
 
+		/* Skip the container's header, then walk its chunks. */
+		inc->skip_remain = inc->container == CONTAINER_W64 ?
+			W64_FORM_SIZE : RIFF_FORM_SIZE;
+		inc->data_remain = 0;
+
 		inc->started = TRUE;
 	}
 
-	if (!inc->found_data) {
-		/* Skip past size of 'fmt ' chunk. */
-		i = 20 + RL32(in->buf->str + 16);
-		offset = find_data_chunk(in->buf, i);
-		if (offset < 0) {
-			if (in->buf->len > MAX_DATA_CHUNK_OFFSET) {
-				sr_err("Couldn't find data chunk.");
-				return SR_ERR;
-			}
-		}
-		inc->found_data = TRUE;
-	} else
-		offset = 0;
-
-	/* Round off up to the last channels * unitsize boundary. */
-	chunk_samples = (in->buf->len - offset) / inc->samplesize;
-	max_chunk_samples = CHUNK_SIZE / inc->samplesize;
-	processed = 0;
-	total_samples = chunk_samples;
-	while (processed < total_samples) {
-		if (chunk_samples > max_chunk_samples)
-			num_samples = max_chunk_samples;
-		else
-			num_samples = chunk_samples;
-		send_chunk(in, offset, num_samples);
-		offset += num_samples * inc->samplesize;
-		chunk_samples -= num_samples;
-		processed += num_samples;
+	/*
+	 * Mapped input gets processed in place. It precedes the content
+	 * of the receive buffer, unused data is moved there.
+	 */
+	if (inc->mapped_len) {
+		used = process_data(in, inc->mapped, inc->mapped_len);
+		g_string_prepend_len(in->buf, (const char *)&inc->mapped[used],
+			inc->mapped_len - used);
+		inc->mapped = NULL;
+		inc->mapped_len = 0;
 	}
 
-	if ((unsigned int)offset < in->buf->len) {
+	used = process_data(in, (const uint8_t *)in->buf->str, in->buf->len);
+	if (used < in->buf->len) {
 		/*
 		 * The incoming buffer wasn't processed completely. Stash
 		 * the leftover data for next time.
 		 */
-		g_string_erase(in->buf, 0, offset);
+		g_string_erase(in->buf, 0, used);
 	} else
 		g_string_truncate(in->buf, 0);
 
 	return SR_OK;
 }
 
-static int receive(struct sr_input *in, GString *buf)
+/* Parse the header, and create the channels when it was seen. */
+static int check_header(struct sr_input *in, const uint8_t *data,
+	size_t length)
 {
 	struct context *inc;
 	int ret;
 	char channelname[16];
 
+	inc = in->priv;
+	if ((ret = parse_wav_header(data, length, inc)) != SR_OK)
+		return ret;
+
+	if (inc->create_channels) {
+		for (int i = 0; i < inc->num_channels; i++) {
+			snprintf(channelname, sizeof(channelname), "CH%d", i + 1);
+			sr_channel_new(in->sdi, i, SR_CHANNEL_ANALOG, TRUE, channelname);
+		}
+	}
+
+	inc->create_channels = FALSE;
+
+	/* sdi is ready, notify frontend. */
+	in->sdi_ready = TRUE;
+
+	return SR_OK;
+}
+
+static int receive_mapped(struct sr_input *in,
+	const uint8_t *data, size_t length)
+{
+	struct context *inc;
+	int ret;
+
+	/* Keep the order of data which was received before. */
+	inc = in->priv;
+	if (in->buf->len) {
+		g_string_append_len(in->buf, (const char *)data, length);
+		if (in->sdi_ready)
+			return process_buffer(in);
+		ret = check_header(in, (const uint8_t *)in->buf->str, in->buf->len);
+		return ret == SR_ERR_NA ? SR_OK : ret;
+	}
+
+	inc->mapped = data;
+	inc->mapped_len = length;
+	if (in->sdi_ready)
+		return process_buffer(in);
+	ret = check_header(in, data, length);
+
+	return ret == SR_ERR_NA ? SR_OK : ret;
+}
+
+static int receive(struct sr_input *in, GString *buf)
+{
+	int ret;
+
 	g_string_append_len(in->buf, buf->str, buf->len);
 
 	if (in->buf->len < MIN_DATA_CHUNK_OFFSET) {
@@ -332,26 +595,12 @@ static int receive(struct sr_input *in, GString *buf)
 		return SR_OK;
 	}
 
-	inc = in->priv;
 	if (!in->sdi_ready) {
-		if ((ret = parse_wav_header(in->buf, inc)) == SR_ERR_NA)
+		ret = check_header(in, (const uint8_t *)in->buf->str, in->buf->len);
+		if (ret == SR_ERR_NA)
 			/* Not enough data yet. */
 			return SR_OK;
-		else if (ret != SR_OK)
-			return ret;
-
-		if (inc->create_channels) {
-			for (int i = 0; i < inc->num_channels; i++) {
-				snprintf(channelname, sizeof(channelname), "CH%d", i + 1);
-				sr_channel_new(in->sdi, i, SR_CHANNEL_ANALOG, TRUE, channelname);
-			}
-		}
-
-		inc->create_channels = FALSE;
-
-		/* sdi is ready, notify frontend. */
-		in->sdi_ready = TRUE;
-		return SR_OK;
+		return ret;
 	}
 
 	ret = process_buffer(in);
@@ -370,14 +619,31 @@ static int end(struct sr_input *in)
 		ret = SR_OK;
 
 	inc = in->priv;
+	if (ret == SR_OK && inc->started && !inc->found_data) {
+		sr_err("Couldn't find data chunk.");
+		ret = SR_ERR;
+	}
 	if (inc->started)
 		std_session_send_df_end(in->sdi);
 
 	return ret;
 }
 
+static void cleanup(struct sr_input *in)
+{
+	struct context *inc;
+
+	inc = in->priv;
+	g_free(inc->float_buffer);
+	inc->float_buffer = NULL;
+}
+
 static int reset(struct sr_input *in)
 {
+	struct context *inc;
+
+	inc = in->priv;
+	g_free(inc->float_buffer);
 	memset(in->priv, 0, sizeof(struct context));
 
 	/*
@@ -394,11 +660,13 @@ SR_PRIV struct sr_input_module input_wav = {
 	.id = "wav",
 	.name = "WAV",
 	.desc = "Microsoft WAV file format data",
-	.exts = (const char*[]){"wav", NULL},
+	.exts = (const char*[]){"wav", "w64", NULL},
 	.metadata = { SR_INPUT_META_HEADER | SR_INPUT_META_REQUIRED },
 	.format_match = format_match,
 	.init = init,
 	.receive = receive,
+	.receive_mapped = receive_mapped,
 	.end = end,
+	.cleanup = cleanup,
 	.reset = reset,
 };
@@ -377,6 +377,12 @@ struct sr_input {
 	struct sr_dev_inst *sdi;
 	gboolean sdi_ready;
 	void *priv;
+	/**
+	 * The file which sr_input_send_mapped() has mapped, and the amount
+	 * of its content which was passed to the module.
+	 */
+	GMappedFile *mapping;
+	size_t mapping_offset;
 };
 
 /** Input (file) module driver. */
@@ -450,6 +456,9 @@ struct sr_input_module {
 	 * and the application can pick the best match, or try fallbacks
 	 * in case of errors. This approach also copes with formats that
 	 * are unreliable to detect in the absence of magic signatures.
+	 * A confidence of 1 is definitive, format detection stops there
+	 * without asking the remaining modules. Modules should reject
+	 * mismatching input with cheap checks before parsing it.
 	 */
 	int (*format_match) (GHashTable *metadata, unsigned int *confidence);
 
@@ -478,6 +487,29 @@ struct sr_input_module {
 	 */
 	int (*receive) (struct sr_input *in, GString *buf);
 
+	/**
+	 * Send a range of stable input data to the specified input instance.
+	 *
+	 * This is used by sr_input_send_mapped(). The data remains valid
+	 * until the input instance gets reset or freed. Modules can keep
+	 * pointers to it, and can send packets which reference the data
+	 * instead of copying it to their receive buffer first. Like with
+	 * receive(), processing can get deferred until the device instance
+	 * is ready, or until end() gets called.
+	 *
+	 * The data is a read-only mapping. Packets which reference it
+	 * must be sent with sr_session_send_readonly(), which copies the
+	 * data when transforms would modify it in place.
+	 *
+	 * This function is optional. Without it, the data gets passed to
+	 * receive() in chunks.
+	 *
+	 * @retval SR_OK Success
+	 * @retval other Negative error code.
+	 */
+	int (*receive_mapped) (struct sr_input *in,
+		const uint8_t *data, size_t length);
+
 	/**
 	 * Signal the input module no more data will come.
 	 *
@@ -535,6 +567,12 @@ struct sr_output {
 	 * there, and only flush it when it reaches a certain size.
 	 */
 	void *priv;
+
+	/**
+	 * The background writer of outputs created by sr_output_new_file(),
+	 * NULL otherwise.
+	 */
+	struct sr_output_writer *writer;
 };
 
 /** Output module driver. */
@@ -617,6 +655,22 @@ struct sr_output_module {
 	int (*receive) (const struct sr_output *o,
 			const struct sr_datafeed_packet *packet, GString **out);
 
+	/**
+	 * Alternative to receive(), which appends any output generated
+	 * in response to the packet to the caller's buffer <code>out</code>.
+	 * This allows callers to reuse one buffer for all packets. Modules
+	 * implement either this or receive().
+	 *
+	 * @param o Pointer to the respective 'struct sr_output'.
+	 * @param packet The complete packet.
+	 * @param out The buffer to append output to. Must not be NULL.
+	 *
+	 * @retval SR_OK Success
+	 * @retval other Negative error code.
+	 */
+	int (*receive_into) (const struct sr_output *o,
+			const struct sr_datafeed_packet *packet, GString *out);
+
 	/**
 	 * This function is called after the caller is finished using
 	 * the output module, and can be used to free any internal
@@ -996,6 +1050,8 @@ SR_PRIV int sr_session_send_meta(const struct sr_dev_inst *sdi,
 		uint32_t key, GVariant *var);
 SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
 		const struct sr_datafeed_packet *packet);
+SR_PRIV int sr_session_send_readonly(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet);
 SR_PRIV int sr_sessionfile_check(const char *filename);
 SR_PRIV struct sr_dev_inst *sr_session_prepare_sdi(const char *filename,
 		struct sr_session **session);
@@ -1019,6 +1075,19 @@ SR_PRIV int sr_analog_init(struct sr_datafeed_analog *analog,
                            struct sr_analog_spec *spec,
                            int digits);
 
+/*--- output/output.c ------------------------------------------------------*/
+
+SR_PRIV void sr_output_flush_into(const struct sr_output *o, GString *out);
+SR_PRIV void sr_output_gather_bits(const uint8_t *data, unsigned int unitsize,
+		unsigned int count, unsigned int index, unsigned int offset,
+		uint8_t *bits);
+SR_PRIV uint64_t sr_output_sample_time(uint64_t sample, uint64_t samplerate,
+		uint64_t timescale);
+SR_PRIV void sr_output_bit_table(char table[256][8], char zero, char one);
+SR_PRIV void sr_output_append_u64(GString *out, uint64_t value);
+SR_PRIV size_t sr_output_skip_unchanged(const uint8_t *data, size_t pos,
+		size_t count, const uint8_t *prev, unsigned int unitsize);
+
 /*--- std.c -----------------------------------------------------------------*/
 
 typedef int (*dev_close_callback)(struct sr_dev_inst *sdi);
@@ -1121,12 +1190,37 @@ SR_PRIV void sr_hexdump_free(GString *s);
 
 /*--- soft-trigger.c --------------------------------------------------------*/
 
+/* A trigger stage, compiled into per-byte masks of the sample data. */
+struct soft_trigger_stage {
+	int num_matches;
+	gboolean valid;
+	gboolean has_edges;
+	/* Range of sample bytes which any of the masks refers to. */
+	int first_byte;
+	int last_byte;
+	uint8_t *level_mask;
+	uint8_t *level_value;
+	uint8_t *rising_mask;
+	uint8_t *falling_mask;
+	uint8_t *edge_mask;
+	int duration;
+	uint64_t duration_samples;
+};
+
 struct soft_trigger_logic {
 	const struct sr_dev_inst *sdi;
 	const struct sr_trigger *trigger;
-	int count;
+	gboolean have_prev_sample;
 	int unitsize;
 	int cur_stage;
+	int num_stages;
+	struct soft_trigger_stage *stages;
+	/* Samples the current stage's levels have held so far. */
+	uint64_t run_length;
+	/* Whether that run already held on the first acquired sample. */
+	gboolean run_from_start;
+	/* Position of the last stage 0 match, relative to the current buffer. */
+	int64_t first_match;
 	uint8_t *prev_sample;
 	uint8_t *pre_trigger_buffer;
 	uint8_t *pre_trigger_head;
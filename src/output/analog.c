@@ -72,8 +72,8 @@ static int init(struct sr_output *o, GHashTable *options)
 	return SR_OK;
 }
 
-static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
-		GString **out)
+static int receive_into(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *out)
 {
 	struct context *ctx;
 	const struct sr_datafeed_analog *analog;
@@ -87,17 +87,16 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 	int num_channels, c, ret, digits, actual_digits;
 	char *number, *suffix;
 
-	*out = NULL;
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 	ctx = o->priv;
 
 	switch (packet->type) {
 	case SR_DF_FRAME_BEGIN:
-		*out = g_string_new("FRAME-BEGIN\n");
+		g_string_append(out, "FRAME-BEGIN\n");
 		break;
 	case SR_DF_FRAME_END:
-		*out = g_string_new("FRAME-END\n");
+		g_string_append(out, "FRAME-END\n");
 		break;
 	case SR_DF_META:
 		meta = packet->payload;
@@ -105,24 +104,23 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 			src = l->data;
 			if (!(srci = sr_key_info_get(SR_KEY_CONFIG, src->key)))
 				return SR_ERR;
-			*out = g_string_sized_new(512);
-			g_string_append(*out, "META ");
-			g_string_append_printf(*out, "%s: ", srci->id);
+			g_string_append(out, "META ");
+			g_string_append_printf(out, "%s: ", srci->id);
 			if (srci->datatype == SR_T_BOOL) {
-				g_string_append_printf(*out, "%u",
+				g_string_append_printf(out, "%u",
 					g_variant_get_boolean(src->data));
 			} else if (srci->datatype == SR_T_FLOAT) {
-				g_string_append_printf(*out, "%f",
+				g_string_append_printf(out, "%f",
 					g_variant_get_double(src->data));
 			} else if (srci->datatype == SR_T_UINT64) {
-				g_string_append_printf(*out, "%"
+				g_string_append_printf(out, "%"
 					G_GUINT64_FORMAT,
 					g_variant_get_uint64(src->data));
 			} else if (srci->datatype == SR_T_STRING) {
-				g_string_append_printf(*out, "%s",
+				g_string_append_printf(out, "%s",
 					g_variant_get_string(src->data, NULL));
 			}
-			g_string_append(*out, "\n");
+			g_string_append(out, "\n");
 		}
 		break;
 	case SR_DF_ANALOG:
@@ -134,7 +132,6 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		ctx->fdata = fdata;
 		if ((ret = sr_analog_to_float(analog, fdata)) != SR_OK)
 			return ret;
-		*out = g_string_sized_new(512);
 		if (ctx->digits == DIGITS_ALL)
 			digits = analog->encoding->digits;
 		else
@@ -151,14 +148,14 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 				if (si_friendly)
 					prefix = sr_analog_si_prefix(&value, &actual_digits);
 				ch = l->data;
-				g_string_append_printf(*out, "%s: ", ch->name);
+				g_string_append_printf(out, "%s: ", ch->name);
 				number = g_strdup_printf("%.*f", MAX(actual_digits, 0), value);
-				g_string_append(*out, number);
+				g_string_append(out, number);
 				g_free(number);
-				g_string_append(*out, " ");
-				g_string_append(*out, prefix);
-				g_string_append(*out, suffix);
-				g_string_append(*out, "\n");
+				g_string_append(out, " ");
+				g_string_append(out, prefix);
+				g_string_append(out, suffix);
+				g_string_append(out, "\n");
 			}
 		}
 		g_free(suffix);
@@ -212,6 +209,6 @@ SR_PRIV struct sr_output_module output_analog = {
 	.flags = 0,
 	.options = get_options,
 	.init = init,
-	.receive = receive,
+	.receive_into = receive_into,
 	.cleanup = cleanup
 };
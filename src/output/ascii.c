@@ -29,6 +29,9 @@
 
 #define DEFAULT_SAMPLES_PER_LINE 74
 
+/* Samples which get expanded at once, per channel. */
+#define BLOCK_SAMPLES 4096
+
 /*
  * The string looks ugly with escape characters, here is the readable
  * version: Use . and " for low and high bits, use \ and / to draw
@@ -46,12 +49,14 @@ struct context {
 	int *channel_index;
 	char **channel_names;
 	char **line_values;
-	uint8_t *prev_sample;
+	uint8_t *prev_bits;
 	gboolean header_done;
 	GString **lines;
 	GString *header;
 	const char *charset;
 	gboolean edges;
+	uint8_t bits[BLOCK_SAMPLES / 8 + 1];
+	char table[256][8];
 };
 
 static int init(struct sr_output *o, GHashTable *options)
@@ -75,6 +80,7 @@ static int init(struct sr_output *o, GHashTable *options)
 		ctx->charset = g_strdup(DEFAULT_ASCII_CHARS);
 	}
 	ctx->edges = (strlen(ctx->charset) >= 4) ? TRUE : FALSE;
+	sr_output_bit_table(ctx->table, ctx->charset[0], ctx->charset[1]);
 
 	for (l = o->sdi->channels; l; l = l->next) {
 		ch = l->data;
@@ -87,7 +93,7 @@ static int init(struct sr_output *o, GHashTable *options)
 	ctx->channel_index = g_malloc(sizeof(int) * ctx->num_enabled_channels);
 	ctx->channel_names = g_malloc(sizeof(char *) * ctx->num_enabled_channels);
 	ctx->lines = g_malloc(sizeof(GString *) * ctx->num_enabled_channels);
-	ctx->prev_sample = g_malloc(g_slist_length(o->sdi->channels));
+	ctx->prev_bits = g_malloc0(ctx->num_enabled_channels);
 
 	j = 0;
 	for (i = 0, l = o->sdi->channels; l; l = l->next, i++) {
@@ -106,11 +112,10 @@ static int init(struct sr_output *o, GHashTable *options)
 	return SR_OK;
 }
 
-static GString *gen_header(const struct sr_output *o)
+static void gen_header(const struct sr_output *o, GString *header)
 {
 	struct context *ctx;
 	GVariant *gvar;
-	GString *header;
 	int num_channels;
 	char *samplerate_s;
 
@@ -123,8 +128,7 @@ static GString *gen_header(const struct sr_output *o)
 		}
 	}
 
-	header = g_string_sized_new(512);
-	g_string_printf(header, "%s %s\n", PACKAGE_NAME, sr_package_version_string_get());
+	g_string_append_printf(header, "%s %s\n", PACKAGE_NAME, sr_package_version_string_get());
 	num_channels = g_slist_length(o->sdi->channels);
 	g_string_append_printf(header, "Acquisition with %d/%d channels",
 			ctx->num_enabled_channels, num_channels);
@@ -134,24 +138,65 @@ static GString *gen_header(const struct sr_output *o)
 		g_free(samplerate_s);
 	}
 	g_string_append_printf(header, "\n");
+}
+
+/*
+ * Append the channel's bits of line positions start to start + count,
+ * as gathered in ctx->bits. Eight positions are expanded at once, the
+ * (usually few) edges are patched in afterwards. prevbit is the level
+ * of the sample before start.
+ */
+static void append_ascii(struct context *ctx, GString *line,
+		unsigned int start, unsigned int count, gboolean prevbit)
+{
+	const uint8_t *b;
+	unsigned int pos, end, n, first, bit;
+	uint8_t edges;
+	gsize len;
+	char *p;
 
-	return header;
+	len = line->len;
+	g_string_set_size(line, len + count);
+	p = line->str + len;
+	b = ctx->bits;
+	pos = start;
+	end = start + count;
+	while (pos < end) {
+		first = pos & 7;
+		n = MIN(8 - first, end - pos);
+		memcpy(p, ctx->table[*b] + first, n);
+		if (ctx->edges) {
+			/* Compare each bit with the one before it. */
+			edges = *b ^ ((*b >> 1) | ((prevbit << 7) >> first));
+			/* No edge before the line's first sample. */
+			if (pos == 0)
+				edges &= 0x7f;
+			edges &= (0xff >> first) & (0xff << (8 - first - n));
+			while (edges) {
+				bit = 7 - g_bit_nth_msf(edges, -1);
+				p[bit - first] = ctx->charset[2 + ((*b >> (7 - bit)) & 1)];
+				edges &= ~(0x80 >> bit);
+			}
+		}
+		prevbit = *b & 1;
+		p += n;
+		pos += n;
+		b++;
+	}
 }
 
-static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
-		GString **out)
+static int receive_into(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *out)
 {
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
 	const struct sr_config *src;
 	GSList *l;
 	struct context *ctx;
-	int idx, offset, curbit, prevbit;
-	uint64_t i, j;
-	gchar *p, c;
-	size_t charidx;
+	uint8_t *data, *last;
+	int idx, offset;
+	uint64_t i, j, num_samples, count;
 
-	*out = NULL;
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 	if (!(ctx = o->priv))
@@ -172,58 +217,55 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		break;
 	case SR_DF_LOGIC:
 		if (!ctx->header_done) {
-			*out = gen_header(o);
+			gen_header(o, out);
 			ctx->header_done = TRUE;
-		} else
-			*out = g_string_sized_new(512);
+		}
 
 		logic = packet->payload;
-		for (i = 0; i <= logic->length - logic->unitsize; i += logic->unitsize) {
-			ctx->spl_cnt++;
+		num_samples = logic->length / logic->unitsize;
+		for (i = 0; i < num_samples; i += count) {
+			count = ctx->spl ? ctx->spl - ctx->spl_cnt : BLOCK_SAMPLES;
+			count = MIN(count, MIN(num_samples - i, BLOCK_SAMPLES));
+			data = (uint8_t *)logic->data + i * logic->unitsize;
 			for (j = 0; j < ctx->num_enabled_channels; j++) {
 				idx = ctx->channel_index[j];
-				p = logic->data + i + idx / 8;
-				curbit = *p & (1 << (idx % 8));
-				prevbit = (ctx->prev_sample[idx / 8] & ((uint8_t) 1 << (idx % 8)));
-
-				charidx = curbit ? 1 : 0;
-				if (ctx->edges && ctx->spl_cnt > 1) {
-					if (curbit != prevbit)
-						charidx += 2;
-				}
-				c = ctx->charset[charidx];
-				g_string_append_c(ctx->lines[j], c);
-
-				if (ctx->spl_cnt == ctx->spl) {
-					/* Flush line buffers. */
-					g_string_append_len(*out, ctx->lines[j]->str, ctx->lines[j]->len);
-					g_string_append_c(*out, '\n');
-					if (j == ctx->num_enabled_channels - 1 && ctx->trigger > -1) {
-						/*
-						 * Sample data lines have one character per bit and
-						 * no separator between bytes. Align trigger marker
-						 * to this layout.
-						 */
-						offset = ctx->trigger;
-						g_string_append_printf(*out, "T:%*s^ %d\n", offset, "", ctx->trigger);
-						ctx->trigger = -1;
-					}
-					g_string_printf(ctx->lines[j], "%s:", ctx->channel_names[j]);
-				}
+				sr_output_gather_bits(data, logic->unitsize, count,
+					idx, ctx->spl_cnt & 7, ctx->bits);
+				append_ascii(ctx, ctx->lines[j], ctx->spl_cnt, count,
+					ctx->prev_bits[j]);
+				/* Keep the level of the block's last sample. */
+				last = data + (count - 1) * logic->unitsize;
+				ctx->prev_bits[j] = (last[idx / 8] >> (idx % 8)) & 1;
+			}
+			ctx->spl_cnt += count;
+			if (ctx->spl_cnt != ctx->spl)
+				continue;
+
+			/* Flush line buffers. */
+			for (j = 0; j < ctx->num_enabled_channels; j++) {
+				g_string_append_len(out, ctx->lines[j]->str, ctx->lines[j]->len);
+				g_string_append_c(out, '\n');
+				g_string_printf(ctx->lines[j], "%s:", ctx->channel_names[j]);
+			}
+			if (ctx->trigger > -1) {
+				/*
+				 * Sample data lines have one character per bit and
+				 * no separator between bytes. Align trigger marker
+				 * to this layout.
+				 */
+				offset = ctx->trigger;
+				g_string_append_printf(out, "T:%*s^ %d\n", offset, "", ctx->trigger);
+				ctx->trigger = -1;
 			}
-			if (ctx->spl_cnt == ctx->spl)
-				/* Line buffers were already flushed. */
-				ctx->spl_cnt = 0;
-			memcpy(ctx->prev_sample, logic->data + i, logic->unitsize);
+			ctx->spl_cnt = 0;
 		}
 		break;
 	case SR_DF_END:
 		if (ctx->spl_cnt) {
 			/* Line buffers need flushing. */
-			*out = g_string_sized_new(512);
 			for (i = 0; i < ctx->num_enabled_channels; i++) {
-				g_string_append_len(*out, ctx->lines[i]->str, ctx->lines[i]->len);
-				g_string_append_c(*out, '\n');
+				g_string_append_len(out, ctx->lines[i]->str, ctx->lines[i]->len);
+				g_string_append_c(out, '\n');
 			}
 		}
 		break;
@@ -244,7 +286,7 @@ static int cleanup(struct sr_output *o)
 		return SR_OK;
 
 	g_free(ctx->channel_index);
-	g_free(ctx->prev_sample);
+	g_free(ctx->prev_bits);
 	g_free(ctx->channel_names);
 	for (i = 0; i < ctx->num_enabled_channels; i++)
 		g_string_free(ctx->lines[i], TRUE);
@@ -282,6 +324,6 @@ SR_PRIV struct sr_output_module output_ascii = {
 	.flags = 0,
 	.options = get_options,
 	.init = init,
-	.receive = receive,
+	.receive_into = receive_into,
 	.cleanup = cleanup,
 };
@@ -28,6 +28,9 @@
 
 #define DEFAULT_SAMPLES_PER_LINE 64
 
+/* Samples which get expanded at once, per channel. */
+#define BLOCK_SAMPLES 4096
+
 struct context {
 	unsigned int num_enabled_channels;
 	int spl;
@@ -38,6 +41,8 @@ struct context {
 	char **channel_names;
 	gboolean header_done;
 	GString **lines;
+	uint8_t bits[BLOCK_SAMPLES / 8 + 1];
+	char table[256][8];
 };
 
 static int init(struct sr_output *o, GHashTable *options)
@@ -54,6 +59,7 @@ static int init(struct sr_output *o, GHashTable *options)
 	o->priv = ctx;
 	ctx->trigger = -1;
 	ctx->spl = g_variant_get_uint32(g_hash_table_lookup(options, "width"));
+	sr_output_bit_table(ctx->table, '0', '1');
 
 	for (l = o->sdi->channels; l; l = l->next) {
 		ch = l->data;
@@ -84,11 +90,10 @@ static int init(struct sr_output *o, GHashTable *options)
 	return SR_OK;
 }
 
-static GString *gen_header(const struct sr_output *o)
+static void gen_header(const struct sr_output *o, GString *header)
 {
 	struct context *ctx;
 	GVariant *gvar;
-	GString *header;
 	int num_channels;
 	char *samplerate_s;
 
@@ -101,8 +106,7 @@ static GString *gen_header(const struct sr_output *o)
 		}
 	}
 
-	header = g_string_sized_new(512);
-	g_string_printf(header, "%s %s\n", PACKAGE_NAME, sr_package_version_string_get());
+	g_string_append_printf(header, "%s %s\n", PACKAGE_NAME, sr_package_version_string_get());
 	num_channels = g_slist_length(o->sdi->channels);
 	g_string_append_printf(header, "Acquisition with %d/%d channels",
 			ctx->num_enabled_channels, num_channels);
@@ -112,23 +116,53 @@ static GString *gen_header(const struct sr_output *o)
 		g_free(samplerate_s);
 	}
 	g_string_append_printf(header, "\n");
+}
 
-	return header;
+/*
+ * Append the channel's bits of line positions start to start + count,
+ * as gathered in ctx->bits. Eight positions are expanded at once.
+ */
+static void append_bits(struct context *ctx, GString *line,
+		unsigned int start, unsigned int count)
+{
+	const uint8_t *b;
+	unsigned int pos, end, n;
+	gsize len;
+	char *p;
+
+	len = line->len;
+	g_string_set_size(line, len + count + count / 8 + 1);
+	p = line->str + len;
+	b = ctx->bits;
+	pos = start;
+	end = start + count;
+	while (pos < end) {
+		n = MIN(8 - (pos & 7), end - pos);
+		memcpy(p, ctx->table[*b] + (pos & 7), n);
+		p += n;
+		pos += n;
+		if (pos & 7)
+			break;
+		/* Add a space every 8th bit. */
+		if (pos != (unsigned int)ctx->spl)
+			*p++ = ' ';
+		b++;
+	}
+	g_string_truncate(line, p - line->str);
 }
 
-static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
-		GString **out)
+static int receive_into(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *out)
 {
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
 	const struct sr_config *src;
 	struct context *ctx;
 	GSList *l;
-	int idx, offset;
-	uint64_t i, j;
-	gchar *p, c;
+	uint8_t *data;
+	int offset;
+	uint64_t i, j, num_samples, count;
 
-	*out = NULL;
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 	if (!(ctx = o->priv))
@@ -149,52 +183,51 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		break;
 	case SR_DF_LOGIC:
 		if (!ctx->header_done) {
-			*out = gen_header(o);
+			gen_header(o, out);
 			ctx->header_done = TRUE;
-		} else
-			*out = g_string_sized_new(512);
+		}
 
 		logic = packet->payload;
-		for (i = 0; i <= logic->length - logic->unitsize; i += logic->unitsize) {
-			ctx->spl_cnt++;
+		num_samples = logic->length / logic->unitsize;
+		for (i = 0; i < num_samples; i += count) {
+			count = ctx->spl ? ctx->spl - ctx->spl_cnt : BLOCK_SAMPLES;
+			count = MIN(count, MIN(num_samples - i, BLOCK_SAMPLES));
+			data = (uint8_t *)logic->data + i * logic->unitsize;
+			for (j = 0; j < ctx->num_enabled_channels; j++) {
+				sr_output_gather_bits(data, logic->unitsize, count,
+					ctx->channel_index[j], ctx->spl_cnt & 7,
+					ctx->bits);
+				append_bits(ctx, ctx->lines[j], ctx->spl_cnt, count);
+			}
+			ctx->spl_cnt += count;
+			if (ctx->spl_cnt != ctx->spl)
+				continue;
+
+			/* Flush line buffers. */
 			for (j = 0; j < ctx->num_enabled_channels; j++) {
-				idx = ctx->channel_index[j];
-				p = logic->data + i + idx / 8;
-				c = (*p & (1 << (idx % 8))) ? '1' : '0';
-				g_string_append_c(ctx->lines[j], c);
-
-				if (ctx->spl_cnt == ctx->spl) {
-					/* Flush line buffers. */
-					g_string_append_len(*out, ctx->lines[j]->str, ctx->lines[j]->len);
-					g_string_append_c(*out, '\n');
-					if (j == ctx->num_enabled_channels - 1 && ctx->trigger > -1) {
-						/*
-						 * Sample data lines have one character per bit,
-						 * plus one separator per byte. Align trigger marker
-						 * to this layout.
-						 */
-						offset = ctx->trigger + ctx->trigger / 8;
-						g_string_append_printf(*out, "T:%*s^ %d\n", offset, "", ctx->trigger);
-						ctx->trigger = -1;
-					}
-					g_string_printf(ctx->lines[j], "%s:", ctx->channel_names[j]);
-				} else if ((ctx->spl_cnt & 7) == 0) {
-					/* Add a space every 8th bit. */
-					g_string_append_c(ctx->lines[j], ' ');
-				}
+				g_string_append_len(out, ctx->lines[j]->str, ctx->lines[j]->len);
+				g_string_append_c(out, '\n');
+				g_string_printf(ctx->lines[j], "%s:", ctx->channel_names[j]);
+			}
+			if (ctx->trigger > -1) {
+				/*
+				 * Sample data lines have one character per bit,
+				 * plus one separator per byte. Align trigger marker
+				 * to this layout.
+				 */
+				offset = ctx->trigger + ctx->trigger / 8;
+				g_string_append_printf(out, "T:%*s^ %d\n", offset, "", ctx->trigger);
+				ctx->trigger = -1;
 			}
-			if (ctx->spl_cnt == ctx->spl)
-				/* Line buffers were already flushed. */
-				ctx->spl_cnt = 0;
+			ctx->spl_cnt = 0;
 		}
 		break;
 	case SR_DF_END:
 		if (ctx->spl_cnt) {
 			/* Line buffers need flushing. */
-			*out = g_string_sized_new(512);
 			for (i = 0; i < ctx->num_enabled_channels; i++) {
-				g_string_append_len(*out, ctx->lines[i]->str, ctx->lines[i]->len);
-				g_string_append_c(*out, '\n');
+				g_string_append_len(out, ctx->lines[i]->str, ctx->lines[i]->len);
+				g_string_append_c(out, '\n');
 			}
 		}
 		break;
@@ -248,6 +281,6 @@ SR_PRIV struct sr_output_module output_bits = {
 	.flags = 0,
 	.options = get_options,
 	.init = init,
-	.receive = receive,
+	.receive_into = receive_into,
 	.cleanup = cleanup,
 };
@@ -49,8 +49,8 @@
  * trigger: Whether or not to add a "trigger" column as the last column.
  *          Defaults to FALSE.
  *
- * dedup:   Don't output duplicate rows. Defaults to FALSE. If time is off, then
- *          this is forced to be off.
+ * dedup:   Only output rows where any value changed, plus the last one.
+ *          Defaults to FALSE. Forces the time column on.
  */
 
 #include <config.h>
@@ -67,6 +67,10 @@ struct ctx_channel {
 	struct sr_channel *ch;
 	char *label;
 	float min, max;
+	/* Column of analog channels, bit location of logic channels. */
+	unsigned int analog_index;
+	unsigned int byte;
+	uint8_t mask;
 };
 
 struct context {
@@ -93,11 +97,26 @@ struct context {
 	uint32_t num_samples;
 	uint32_t channel_count, logic_channel_count;
 	uint32_t channels_seen;
-	uint64_t period;
-	uint64_t sample_time;
+	uint64_t samplerate;
+	uint64_t timescale;
+	uint64_t sample_count;
+	/* Change detection: enabled logic bits, last written and seen samples. */
+	uint8_t *logic_mask;
 	uint8_t *previous_sample;
+	float *previous_analog;
+	gboolean have_previous;
+	uint8_t *last_logic;
+	float *last_analog;
+	gboolean last_pending;
 	float *analog_samples;
 	uint8_t *logic_samples;
+	unsigned int logic_unitsize;
+	/*
+	 * Row template for captures without analog channels: the logic
+	 * columns with their separators, and the positions of the values.
+	 */
+	GString *logic_template;
+	size_t *logic_offsets;
 	const char *xlabel;	/* Don't free: will point to a static string. */
 	const char *title;	/* Don't free: will point into the driver struct. */
 };
@@ -140,7 +159,8 @@ static int init(struct sr_output *o, GHashTable *options)
 	label_string = g_variant_get_string(
 		g_hash_table_lookup(options, "label"), NULL);
 	ctx->dedup = g_variant_get_boolean(g_hash_table_lookup(options, "dedup"));
-	ctx->dedup &= ctx->time;
+	/* Rows which were left out need their time to be known. */
+	ctx->time |= ctx->dedup;
 
 	if (*ctx->gnuplot && g_strcmp0(ctx->record, "\n"))
 		sr_warn("gnuplot record separator must be newline.");
@@ -183,15 +203,19 @@ static int init(struct sr_output *o, GHashTable *options)
 
 	/* Once more to map the enabled channels. */
 	ctx->channel_count = g_slist_length(o->sdi->channels);
+	analog_channels = 0;
 	for (i = 0, l = o->sdi->channels; l; l = l->next) {
 		ch = l->data;
 		if (ch->enabled) {
 			if (ch->type == SR_CHANNEL_ANALOG) {
 				ctx->channels[i].min = FLT_MAX;
 				ctx->channels[i].max = FLT_MIN;
+				ctx->channels[i].analog_index = analog_channels++;
 			} else if (ch->type == SR_CHANNEL_LOGIC) {
 				ctx->channels[i].min = 0;
 				ctx->channels[i].max = 1;
+				ctx->channels[i].byte = ch->index / 8;
+				ctx->channels[i].mask = 1 << (ch->index % 8);
 			} else {
 				sr_warn("Unknown channel type %d.", ch->type);
 			}
@@ -201,6 +225,20 @@ static int init(struct sr_output *o, GHashTable *options)
 		}
 	}
 
+	/* Pure logic rows all look the same, except for the values. */
+	if (ctx->num_logic_channels && !ctx->num_analog_channels) {
+		ctx->logic_template = g_string_sized_new(
+			ctx->num_logic_channels * (1 + strlen(ctx->value)));
+		ctx->logic_offsets = g_malloc(sizeof(size_t)
+			* ctx->num_logic_channels);
+		for (i = 0; i < ctx->num_logic_channels; i++) {
+			if (i)
+				g_string_append(ctx->logic_template, ctx->value);
+			ctx->logic_offsets[i] = ctx->logic_template->len;
+			g_string_append_c(ctx->logic_template, '0');
+		}
+	}
+
 	return SR_OK;
 }
 
@@ -209,22 +247,20 @@ static const char *xlabels[] = {
 	"femtoseconds", "attoseconds",
 };
 
-static GString *gen_header(const struct sr_output *o,
-			   const struct sr_datafeed_header *hdr)
+static void gen_header(const struct sr_output *o,
+		       const struct sr_datafeed_header *hdr, GString *header)
 {
 	struct context *ctx;
 	struct sr_channel *ch;
 	GVariant *gvar;
-	GString *header;
 	GSList *channels, *l;
 	unsigned int num_channels, i;
 	uint64_t samplerate = 0, sr;
 	char *samplerate_s;
 
 	ctx = o->priv;
-	header = g_string_sized_new(512);
 
-	if (ctx->period == 0) {
+	if (ctx->timescale == 0) {
 		if (sr_config_get(o->sdi->driver, o->sdi, NULL,
 				  SR_CONF_SAMPLERATE, &gvar) == SR_OK) {
 			samplerate = g_variant_get_uint64(gvar);
@@ -237,12 +273,11 @@ static GString *gen_header(const struct sr_output *o,
 			i++;
 			sr *= 1000;
 		}
-		if (samplerate)
-			ctx->period = sr / samplerate;
+		ctx->samplerate = samplerate;
+		ctx->timescale = sr;
 		if (i < ARRAY_SIZE(xlabels))
 			ctx->xlabel = xlabels[i];
-		sr_info("Set sample period to %" PRIu64 " %s",
-			ctx->period, ctx->xlabel);
+		sr_info("Set time unit to %s", ctx->xlabel);
 	}
 	ctx->title = (o->sdi && o->sdi->driver) ? o->sdi->driver->longname : "unknown";
 
@@ -279,8 +314,6 @@ static GString *gen_header(const struct sr_output *o,
 		}
 		ctx->did_header = TRUE;
 	}
-
-	return header;
 }
 
 /*
@@ -364,45 +397,262 @@ static void process_analog(struct context *ctx,
 /*
  * We treat logic packets the same as analog packets, though it's not
  * strictly required. This allows us to process mixed signals properly.
+ * The packet's data image is kept as is, values get extracted while
+ * the rows are written.
  */
 static void process_logic(struct context *ctx,
 			  const struct sr_datafeed_logic *logic)
 {
-	unsigned int i, j, ch, num_samples;
-	int idx;
-	uint8_t *sample;
+	unsigned int i, num_samples;
 
 	num_samples = logic->length / logic->unitsize;
 	ctx->channels_seen += ctx->logic_channel_count;
 	sr_dbg("Logic packet had %d channels", logic->unitsize * 8);
 	if (!ctx->logic_samples) {
-		ctx->logic_samples = g_malloc(num_samples * ctx->num_logic_channels);
+		ctx->logic_samples = g_malloc(num_samples * logic->unitsize);
+		ctx->logic_unitsize = logic->unitsize;
 		if (!ctx->num_samples)
 			ctx->num_samples = num_samples;
 	}
 	if (ctx->num_samples != num_samples)
 		sr_warn("Expecting %u samples, got %u",
 			ctx->num_samples, num_samples);
+	num_samples = MIN(num_samples, ctx->num_samples);
+	memcpy(ctx->logic_samples, logic->data, num_samples * logic->unitsize);
 
-	for (j = ch = 0; ch < ctx->num_logic_channels; j++) {
-		if (ctx->channels[j].ch->type == SR_CHANNEL_LOGIC) {
-			for (i = 0; i < num_samples; i++) {
-				sample = logic->data + i * logic->unitsize;
-				idx = ctx->channels[j].ch->index;
-				if (ctx->label_do && !ctx->label_names)
-					ctx->channels[j].label = "logic";
-				ctx->logic_samples[i * ctx->num_logic_channels + ch] = sample[idx / 8] & (1 << (idx % 8));
+	if (ctx->label_do && !ctx->label_names) {
+		for (i = 0; i < ctx->num_analog_channels + ctx->num_logic_channels; i++) {
+			if (ctx->channels[i].ch->type == SR_CHANNEL_LOGIC)
+				ctx->channels[i].label = "logic";
+		}
+	}
+}
+
+/*
+ * Append the shortest decimal representation which reads back as the
+ * same float. Values in the range which the power of ten table covers
+ * exactly get converted in integer arithmetic, all others (and those
+ * special cases which would need more than 9 digits) use printf.
+ */
+static void append_float(GString *out, float value)
+{
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+	};
+	char buf[32];
+	double v;
+	uint64_t mant;
+	int exp10, digits, scale, len, point, i;
+
+	v = value;
+	if (v == 0 || v != v || v < -1e9 || (v > -1e-6 && v < 1e-6) || v >= 1e9) {
+		g_string_append_printf(out, "%.9g", value);
+		return;
+	}
+	if (v < 0) {
+		g_string_append_c(out, '-');
+		v = -v;
+	}
+
+	/* Decimal exponent of the leading digit, -6 <= exp10 <= 8. */
+	exp10 = 0;
+	while (exp10 < 8 && v >= pow10[exp10 + 1])
+		exp10++;
+	while (exp10 <= 0 && exp10 > -6 && v < 1 / pow10[-exp10])
+		exp10--;
+
+	/* Find the least number of significant digits which round trips. */
+	mant = 0;
+	scale = 0;
+	for (digits = 1; digits <= 9; digits++) {
+		scale = exp10 - digits + 1;
+		if (scale >= 0)
+			mant = llround(v / pow10[scale]);
+		else
+			mant = llround(v * pow10[-scale]);
+		if (scale >= 0 && (float)(mant * pow10[scale]) == (float)v)
+			break;
+		if (scale < 0 && (float)(mant / pow10[-scale]) == (float)v)
+			break;
+	}
+	if (digits > 9) {
+		g_string_append_printf(out, "%.9g", (float)v);
+		return;
+	}
+	while (mant && mant % 10 == 0) {
+		mant /= 10;
+		scale++;
+	}
+
+	/* Digits of the mantissa, with a decimal point or trailing zeros. */
+	len = 0;
+	do {
+		buf[len++] = '0' + mant % 10;
+		mant /= 10;
+	} while (mant);
+	point = -scale;
+	if (point >= len) {
+		g_string_append(out, "0.");
+		for (i = 0; i < point - len; i++)
+			g_string_append_c(out, '0');
+		point = 0;
+	}
+	for (i = len - 1; i >= 0; i--) {
+		g_string_append_c(out, buf[i]);
+		if (i && i == point)
+			g_string_append_c(out, '.');
+	}
+	for (i = 0; i < scale; i++)
+		g_string_append_c(out, '0');
+}
+
+static void write_row(struct context *ctx, GString *out,
+		const uint8_t *logic_sample, const float *analog_sample,
+		uint64_t sample)
+{
+	struct ctx_channel *channel;
+	unsigned int j, num_channels;
+	float value;
+	char *row;
+
+	num_channels = ctx->num_logic_channels + ctx->num_analog_channels;
+
+	if (ctx->time) {
+		/* Without a samplerate, the time is the sample number. */
+		sr_output_append_u64(out, sr_output_sample_time(sample,
+			ctx->samplerate, ctx->timescale));
+		if (num_channels)
+			g_string_append(out, ctx->value);
+	}
+
+	if (ctx->logic_template) {
+		/* Copy the template, then fill in the values. */
+		g_string_append_len(out, ctx->logic_template->str,
+			ctx->logic_template->len);
+		row = out->str + out->len - ctx->logic_template->len;
+		for (j = 0; j < num_channels; j++) {
+			channel = &ctx->channels[j];
+			if (logic_sample[channel->byte] & channel->mask)
+				row[ctx->logic_offsets[j]] = '1';
+		}
+	} else {
+		for (j = 0; j < num_channels; j++) {
+			if (j)
+				g_string_append(out, ctx->value);
+			channel = &ctx->channels[j];
+			if (channel->ch->type == SR_CHANNEL_ANALOG) {
+				value = analog_sample[channel->analog_index];
+				channel->max = fmax(value, channel->max);
+				channel->min = fmin(value, channel->min);
+				append_float(out, value);
+			} else if (channel->ch->type == SR_CHANNEL_LOGIC) {
+				g_string_append_c(out,
+					logic_sample[channel->byte]
+					& channel->mask ? '1' : '0');
+			} else {
+				sr_warn("Unexpected channel type: %d",
+					channel->ch->type);
 			}
-			ch++;
 		}
 	}
+
+	if (ctx->do_trigger) {
+		if (num_channels || ctx->time)
+			g_string_append(out, ctx->value);
+		g_string_append_c(out, ctx->trigger ? '1' : '0');
+		ctx->trigger = FALSE;
+	}
+	g_string_append(out, ctx->record);
 }
 
-static void dump_saved_values(struct context *ctx, GString **out)
+/* Does a sample differ from the last one written, in enabled channels? */
+static gboolean sample_changed(const struct context *ctx,
+		const uint8_t *logic_sample, const float *analog_sample)
 {
-	unsigned int i, j, analog_size, num_channels;
-	float *analog_sample, value;
+	unsigned int i;
+
+	for (i = 0; i < ctx->logic_unitsize; i++) {
+		if ((logic_sample[i] & ctx->logic_mask[i]) != ctx->previous_sample[i])
+			return TRUE;
+	}
+
+	return ctx->num_analog_channels && memcmp(analog_sample,
+		ctx->previous_analog, ctx->num_analog_channels * sizeof(float));
+}
+
+/*
+ * Find the first sample at or after 'pos' which differs from the last
+ * one written. Pure logic data with unit sizes which divide a machine
+ * word gets compared a word at a time.
+ */
+static unsigned int find_change(const struct context *ctx, unsigned int pos)
+{
+	uint64_t pattern, mask, word;
+	unsigned int unitsize, per_word, i;
+
+	unitsize = ctx->logic_unitsize;
+	if (!ctx->num_analog_channels && unitsize
+			&& sizeof(pattern) % unitsize == 0) {
+		for (i = 0; i < sizeof(pattern); i += unitsize) {
+			memcpy((uint8_t *)&pattern + i, ctx->previous_sample, unitsize);
+			memcpy((uint8_t *)&mask + i, ctx->logic_mask, unitsize);
+		}
+		per_word = sizeof(pattern) / unitsize;
+		while (pos + per_word <= ctx->num_samples) {
+			memcpy(&word, ctx->logic_samples + pos * unitsize,
+				sizeof(word));
+			if ((word & mask) != pattern)
+				break;
+			pos += per_word;
+		}
+	}
+	while (pos < ctx->num_samples && !sample_changed(ctx,
+			ctx->logic_samples + pos * unitsize,
+			ctx->analog_samples + pos * ctx->num_analog_channels))
+		pos++;
+
+	return pos;
+}
+
+/* Remember a sample, to compare the following ones against. */
+static void save_sample(struct context *ctx, const uint8_t *logic_sample,
+		const float *analog_sample)
+{
+	unsigned int i;
+
+	for (i = 0; i < ctx->logic_unitsize; i++)
+		ctx->previous_sample[i] = logic_sample[i] & ctx->logic_mask[i];
+	memcpy(ctx->previous_analog, analog_sample,
+		ctx->num_analog_channels * sizeof(float));
+	ctx->have_previous = TRUE;
+}
+
+/* Set up change detection, once the logic unit size is known. */
+static void init_dedup(struct context *ctx)
+{
+	unsigned int i;
+
+	ctx->previous_sample = g_malloc0(ctx->logic_unitsize);
+	ctx->logic_mask = g_malloc0(ctx->logic_unitsize);
+	for (i = 0; i < ctx->num_analog_channels + ctx->num_logic_channels; i++) {
+		if (ctx->channels[i].ch->type == SR_CHANNEL_LOGIC
+				&& ctx->channels[i].byte < ctx->logic_unitsize)
+			ctx->logic_mask[ctx->channels[i].byte] |=
+				ctx->channels[i].mask;
+	}
+	ctx->previous_analog = g_malloc0(ctx->num_analog_channels * sizeof(float));
+	ctx->last_logic = g_malloc0(ctx->logic_unitsize);
+	ctx->last_analog = g_malloc0(ctx->num_analog_channels * sizeof(float));
+}
+
+static void dump_saved_values(struct context *ctx, GString *out)
+{
+	unsigned int i, num_channels;
+	float *analog_sample;
 	uint8_t *logic_sample;
+	gboolean wrote_last;
+	gsize len;
 
 	/* If we haven't seen samples we're expecting, skip them. */
 	if ((ctx->num_analog_channels && !ctx->analog_samples) ||
@@ -411,102 +661,98 @@ static void dump_saved_values(struct context *ctx, GString **out)
 	} else {
 		sr_info("Dumping %u samples", ctx->num_samples);
 
-		*out = g_string_sized_new(512);
 		num_channels =
 		    ctx->num_logic_channels + ctx->num_analog_channels;
+		/*
+		 * Grow the block once, sized for typical rows. Deduplicated
+		 * output only grows by the rows which actually get written.
+		 */
+		if (!ctx->dedup) {
+			len = out->len;
+			g_string_set_size(out, len + 512 + ctx->num_samples
+				* (num_channels * (2 + strlen(ctx->value))
+				+ strlen(ctx->record) + (ctx->time ? 12 : 0)));
+			g_string_truncate(out, len);
+		}
 
 		if (ctx->label_do) {
 			if (ctx->time)
-				g_string_append_printf(*out, "%s%s",
+				g_string_append_printf(out, "%s%s",
 					ctx->label_names ? "Time" :
 					ctx->xlabel, ctx->value);
 			for (i = 0; i < num_channels; i++) {
-				g_string_append_printf(*out, "%s%s",
+				g_string_append_printf(out, "%s%s",
 					ctx->channels[i].label, ctx->value);
 				if (ctx->channels[i].ch->type == SR_CHANNEL_ANALOG
 						&& ctx->label_names)
 					g_free(ctx->channels[i].label);
 			}
 			if (ctx->do_trigger)
-				g_string_append_printf(*out, "Trigger%s",
+				g_string_append_printf(out, "Trigger%s",
 						       ctx->value);
 			/* Drop last separator. */
-			g_string_truncate(*out, (*out)->len - 1);
-			g_string_append(*out, ctx->record);
+			g_string_truncate(out, out->len - 1);
+			g_string_append(out, ctx->record);
 
 			ctx->label_do = FALSE;
 		}
 
-		analog_size = ctx->num_analog_channels * sizeof(float);
 		if (ctx->dedup && !ctx->previous_sample)
-			ctx->previous_sample = g_malloc0(analog_size + ctx->num_logic_channels);
+			init_dedup(ctx);
 
+		wrote_last = FALSE;
 		for (i = 0; i < ctx->num_samples; i++) {
-			ctx->sample_time += ctx->period;
-			analog_sample =
-			    &ctx->analog_samples[i * ctx->num_analog_channels];
-			logic_sample =
-			    &ctx->logic_samples[i * ctx->num_logic_channels];
-
-			if (ctx->dedup) {
-				if (i > 0 && i < ctx->num_samples - 1 &&
-				    !memcmp(logic_sample, ctx->previous_sample,
-					    ctx->num_logic_channels) &&
-				    !memcmp(analog_sample,
-					    ctx->previous_sample +
-					    ctx->num_logic_channels,
-					    analog_size))
-					continue;
-				memcpy(ctx->previous_sample, logic_sample,
-				       ctx->num_logic_channels);
-				memcpy(ctx->previous_sample
-				       + ctx->num_logic_channels,
-				       analog_sample, analog_size);
-			}
-
-			if (ctx->time)
-				g_string_append_printf(*out, "%" PRIu64 "%s",
-					ctx->sample_time, ctx->value);
-
-			for (j = 0; j < num_channels; j++) {
-				if (ctx->channels[j].ch->type == SR_CHANNEL_ANALOG) {
-					value = ctx->analog_samples[i * ctx->num_analog_channels + j];
-					ctx->channels[j].max =
-					    fmax(value, ctx->channels[j].max);
-					ctx->channels[j].min =
-					    fmin(value, ctx->channels[j].min);
-					g_string_append_printf(*out, "%g%s",
-						value, ctx->value);
-				} else if (ctx->channels[j].ch->type == SR_CHANNEL_LOGIC) {
-					g_string_append_printf(*out, "%c%s",
-							       ctx->logic_samples[i * ctx->num_logic_channels + j] ? '1' : '0', ctx->value);
-				} else {
-					sr_warn("Unexpected channel type: %d",
-						ctx->channels[i].ch->type);
-				}
+			/* Only rows with changes, or with the trigger. */
+			if (ctx->dedup && ctx->have_previous && !ctx->trigger) {
+				i = find_change(ctx, i);
+				if (i >= ctx->num_samples)
+					break;
 			}
+			logic_sample = ctx->logic_samples + i * ctx->logic_unitsize;
+			analog_sample = ctx->analog_samples
+				+ i * ctx->num_analog_channels;
+			write_row(ctx, out, logic_sample, analog_sample,
+				ctx->sample_count + i);
+			if (ctx->dedup)
+				save_sample(ctx, logic_sample, analog_sample);
+			wrote_last = i == ctx->num_samples - 1;
+		}
 
-			if (ctx->do_trigger) {
-				g_string_append_printf(*out, "%d%s",
-					ctx->trigger, ctx->value);
-				ctx->trigger = FALSE;
-			}
-			g_string_truncate(*out, (*out)->len - 1);
-			g_string_append(*out, ctx->record);
+		/*
+		 * Keep the last sample, so the end of the capture can
+		 * be written when it didn't change.
+		 */
+		if (ctx->dedup && ctx->num_samples) {
+			i = ctx->num_samples - 1;
+			memcpy(ctx->last_logic, ctx->logic_samples
+				+ i * ctx->logic_unitsize, ctx->logic_unitsize);
+			memcpy(ctx->last_analog, ctx->analog_samples
+				+ i * ctx->num_analog_channels,
+				ctx->num_analog_channels * sizeof(float));
+			ctx->last_pending = !wrote_last;
 		}
+		ctx->sample_count += ctx->num_samples;
 	}
 
 	/* Discard all of the working space. */
-	g_free(ctx->previous_sample);
 	g_free(ctx->analog_samples);
 	g_free(ctx->logic_samples);
 	ctx->channels_seen = 0;
 	ctx->num_samples = 0;
-	ctx->previous_sample = NULL;
 	ctx->analog_samples = NULL;
 	ctx->logic_samples = NULL;
 }
 
+/* Write the last sample of a deduplicated capture, unless it was already. */
+static void dump_last_sample(struct context *ctx, GString *out)
+{
+	if (!ctx->last_pending)
+		return;
+	write_row(ctx, out, ctx->last_logic, ctx->last_analog,
+		ctx->sample_count - 1);
+	ctx->last_pending = FALSE;
+}
+
 static void save_gnuplot(struct context *ctx)
 {
 	float offset, max, sum;
@@ -559,12 +805,11 @@ static void save_gnuplot(struct context *ctx)
 	g_string_free(script, TRUE);
 }
 
-static int receive(const struct sr_output *o,
-		   const struct sr_datafeed_packet *packet, GString **out)
+static int receive_into(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *out)
 {
 	struct context *ctx;
 
-	*out = NULL;
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 	if (!(ctx = o->priv))
@@ -573,7 +818,7 @@ static int receive(const struct sr_output *o,
 	sr_dbg("Got packet of type %d", packet->type);
 	switch (packet->type) {
 	case SR_DF_HEADER:
-		*out = gen_header(o, packet->payload);
+		gen_header(o, packet->payload, out);
 		break;
 	case SR_DF_TRIGGER:
 		ctx->trigger = TRUE;
@@ -585,7 +830,7 @@ static int receive(const struct sr_output *o,
 		process_analog(ctx, packet->payload);
 		break;
 	case SR_DF_FRAME_BEGIN:
-		*out = g_string_new(ctx->frame);
+		g_string_append(out, ctx->frame);
 		/* Fallthrough */
 	case SR_DF_END:
 		/* Got to end of frame/session with part of the data. */
@@ -599,6 +844,8 @@ static int receive(const struct sr_output *o,
 	/* If we've got them all, dump the values. */
 	if (ctx->channels_seen >= ctx->channel_count)
 		dump_saved_values(ctx, out);
+	if (packet->type == SR_DF_END)
+		dump_last_sample(ctx, out);
 
 	return SR_OK;
 }
@@ -618,6 +865,13 @@ static int cleanup(struct sr_output *o)
 		g_free((gpointer)ctx->gnuplot);
 		g_free((gpointer)ctx->value);
 		g_free(ctx->previous_sample);
+		g_free(ctx->previous_analog);
+		g_free(ctx->logic_mask);
+		g_free(ctx->last_logic);
+		g_free(ctx->last_analog);
+		g_free(ctx->logic_offsets);
+		if (ctx->logic_template)
+			g_string_free(ctx->logic_template, TRUE);
 		g_free(ctx->channels);
 		g_free(o->priv);
 		o->priv = NULL;
@@ -637,7 +891,7 @@ static struct sr_option options[] = {
 	{"label", "Label values", "Type of column labels", NULL, NULL},
 	{"time", "Time column", "Output sample time as column 1", NULL, NULL},
 	{"trigger", "Trigger column", "Output trigger indicator as last column ", NULL, NULL},
-	{"dedup", "Dedup rows", "Set to false to output duplicate rows", NULL, NULL},
+	{"dedup", "Dedup rows", "Only output rows where any value changed", NULL, NULL},
 	ALL_ZERO
 };
 
@@ -674,6 +928,6 @@ SR_PRIV struct sr_output_module output_csv = {
 	.flags = 0,
 	.options = get_options,
 	.init = init,
-	.receive = receive,
+	.receive_into = receive_into,
 	.cleanup = cleanup,
 };
@@ -28,6 +28,9 @@
 
 #define DEFAULT_SAMPLES_PER_LINE 192
 
+/* Samples which get expanded at once, per channel. */
+#define BLOCK_SAMPLES 4096
+
 struct context {
 	unsigned int num_enabled_channels;
 	int spl;
@@ -41,6 +44,7 @@ struct context {
 	uint8_t *sample_buf;
 	gboolean header_done;
 	GString **lines;
+	uint8_t bits[BLOCK_SAMPLES / 8 + 1];
 };
 
 static int init(struct sr_output *o, GHashTable *options)
@@ -89,11 +93,10 @@ static int init(struct sr_output *o, GHashTable *options)
 	return SR_OK;
 }
 
-static GString *gen_header(const struct sr_output *o)
+static void gen_header(const struct sr_output *o, GString *header)
 {
 	struct context *ctx;
 	GVariant *gvar;
-	GString *header;
 	int num_channels;
 	char *samplerate_s;
 
@@ -106,8 +109,7 @@ static GString *gen_header(const struct sr_output *o)
 		}
 	}
 
-	header = g_string_sized_new(512);
-	g_string_printf(header, "%s %s\n", PACKAGE_NAME, sr_package_version_string_get());
+	g_string_append_printf(header, "%s %s\n", PACKAGE_NAME, sr_package_version_string_get());
 	num_channels = g_slist_length(o->sdi->channels);
 	g_string_append_printf(header, "Acquisition with %d/%d channels",
 			ctx->num_enabled_channels, num_channels);
@@ -117,23 +119,53 @@ static GString *gen_header(const struct sr_output *o)
 		g_free(samplerate_s);
 	}
 	g_string_append_printf(header, "\n");
+}
+
+/*
+ * Append the channel's bits of line positions start to start + count,
+ * as gathered in ctx->bits, as hex bytes. The bits of an incomplete
+ * byte are kept in ctx->sample_buf until the byte is complete.
+ */
+static void append_hex(struct context *ctx, unsigned int j,
+		unsigned int start, unsigned int count)
+{
+	static const char hex[] = "0123456789abcdef";
+	const uint8_t *b;
+	unsigned int pos, end;
+	GString *line;
+	gsize len;
+	char *p;
 
-	return header;
+	line = ctx->lines[j];
+	len = line->len;
+	g_string_set_size(line, len + 3 * (count / 8 + 1));
+	p = line->str + len;
+	b = ctx->bits;
+	ctx->bits[0] |= ctx->sample_buf[j];
+	end = start + count;
+	for (pos = (start | 7) + 1; pos <= end; pos += 8) {
+		/* Buffered a byte's worth, output hex. */
+		*p++ = hex[*b >> 4];
+		*p++ = hex[*b & 0xf];
+		*p++ = ' ';
+		b++;
+	}
+	ctx->sample_buf[j] = (end & 7) ? *b : 0;
+	g_string_truncate(line, p - line->str);
 }
 
-static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
-		GString **out)
+static int receive_into(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *out)
 {
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
 	const struct sr_config *src;
 	GSList *l;
 	struct context *ctx;
-	int idx, pos, offset;
-	uint64_t i, j;
-	gchar *p;
+	uint8_t *data;
+	int offset;
+	uint64_t i, j, num_samples, count;
 
-	*out = NULL;
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 	if (!(ctx = o->priv))
@@ -154,60 +186,59 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		break;
 	case SR_DF_LOGIC:
 		if (!ctx->header_done) {
-			*out = gen_header(o);
+			gen_header(o, out);
 			ctx->header_done = TRUE;
-		} else
-			*out = g_string_sized_new(512);
+		}
 
 		logic = packet->payload;
-		for (i = 0; i <= logic->length - logic->unitsize; i += logic->unitsize) {
-			ctx->spl_cnt++;
-			pos = ctx->spl_cnt & 7;
+		num_samples = logic->length / logic->unitsize;
+		for (i = 0; i < num_samples; i += count) {
+			count = ctx->spl ? ctx->spl - ctx->spl_cnt : BLOCK_SAMPLES;
+			count = MIN(count, MIN(num_samples - i, BLOCK_SAMPLES));
+			data = (uint8_t *)logic->data + i * logic->unitsize;
 			for (j = 0; j < ctx->num_enabled_channels; j++) {
-				idx = ctx->channel_index[j];
-				p = logic->data + i + idx / 8;
-				ctx->sample_buf[j] <<= 1;
-				if (*p & (1 << (idx % 8)))
-					ctx->sample_buf[j] |= 1;
-				if (ctx->spl_cnt && pos == 0) {
-					/* Buffered a byte's worth, output hex. */
+				sr_output_gather_bits(data, logic->unitsize, count,
+					ctx->channel_index[j], ctx->spl_cnt & 7,
+					ctx->bits);
+				append_hex(ctx, j, ctx->spl_cnt, count);
+			}
+			ctx->spl_cnt += count;
+			if (ctx->spl_cnt != ctx->spl)
+				continue;
+
+			/* Flush line buffers. */
+			for (j = 0; j < ctx->num_enabled_channels; j++) {
+				/* A partial byte does not carry into the next line. */
+				if (ctx->spl_cnt & 7)
 					g_string_append_printf(ctx->lines[j], "%.2x ",
 							ctx->sample_buf[j]);
-					ctx->sample_buf[j] = 0;
-				}
-
-				if (ctx->spl_cnt == ctx->spl) {
-					/* Flush line buffers. */
-					g_string_append_len(*out, ctx->lines[j]->str, ctx->lines[j]->len);
-					g_string_append_c(*out, '\n');
-					if (j == ctx->num_enabled_channels - 1 && ctx->trigger > -1) {
-						/*
-						 * Sample data lines have one character per nibble,
-						 * plus one separator per byte. Align trigger marker
-						 * to this layout.
-						 */
-						offset = ctx->trigger / 4 + ctx->trigger / 8;
-						g_string_append_printf(*out, "T:%*s^ %d\n", offset, "", ctx->trigger);
-						ctx->trigger = -1;
-					}
-					g_string_printf(ctx->lines[j], "%s:", ctx->channel_names[j]);
-				}
+				g_string_append_len(out, ctx->lines[j]->str, ctx->lines[j]->len);
+				g_string_append_c(out, '\n');
+				g_string_printf(ctx->lines[j], "%s:", ctx->channel_names[j]);
+				ctx->sample_buf[j] = 0;
+			}
+			if (ctx->trigger > -1) {
+				/*
+				 * Sample data lines have one character per nibble,
+				 * plus one separator per byte. Align trigger marker
+				 * to this layout.
+				 */
+				offset = ctx->trigger / 4 + ctx->trigger / 8;
+				g_string_append_printf(out, "T:%*s^ %d\n", offset, "", ctx->trigger);
+				ctx->trigger = -1;
 			}
-			if (ctx->spl_cnt == ctx->spl)
-				/* Line buffers were already flushed. */
-				ctx->spl_cnt = 0;
+			ctx->spl_cnt = 0;
 		}
 		break;
 	case SR_DF_END:
 		if (ctx->spl_cnt) {
 			/* Line buffers need flushing. */
-			*out = g_string_sized_new(512);
 			for (i = 0; i < ctx->num_enabled_channels; i++) {
 				if (ctx->spl_cnt & 7)
 					g_string_append_printf(ctx->lines[i], "%.2x ",
-							ctx->sample_buf[i] << (8 - (ctx->spl_cnt & 7)));
-				g_string_append_len(*out, ctx->lines[i]->str, ctx->lines[i]->len);
-				g_string_append_c(*out, '\n');
+							ctx->sample_buf[i]);
+				g_string_append_len(out, ctx->lines[i]->str, ctx->lines[i]->len);
+				g_string_append_c(out, '\n');
 			}
 		}
 		break;
@@ -262,6 +293,6 @@ SR_PRIV struct sr_output_module output_hex = {
 	.flags = 0,
 	.options = get_options,
 	.init = init,
-	.receive = receive,
+	.receive_into = receive_into,
 	.cleanup = cleanup,
 };
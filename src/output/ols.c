@@ -36,6 +36,11 @@
 struct context {
 	uint64_t samplerate;
 	uint64_t num_samples;
+	/* The previous sample, only changes are written. */
+	uint8_t *prev_sample;
+	unsigned int unitsize;
+	/* Index of the last sample which was written. */
+	uint64_t last_written;
 };
 
 static int init(struct sr_output *o, GHashTable *options)
@@ -52,11 +57,11 @@ static int init(struct sr_output *o, GHashTable *options)
 	return SR_OK;
 }
 
-static GString *gen_header(const struct sr_dev_inst *sdi, struct context *ctx)
+static void gen_header(const struct sr_dev_inst *sdi, struct context *ctx,
+		GString *s)
 {
 	struct sr_channel *ch;
 	GSList *l;
-	GString *s;
 	GVariant *gvar;
 	int num_enabled_channels;
 
@@ -76,28 +81,46 @@ static GString *gen_header(const struct sr_dev_inst *sdi, struct context *ctx)
 		num_enabled_channels++;
 	}
 
-	s = g_string_sized_new(512);
 	g_string_append_printf(s, ";Rate: %"PRIu64"\n", ctx->samplerate);
 	g_string_append_printf(s, ";Channels: %d\n", num_enabled_channels);
 	g_string_append_printf(s, ";EnabledChannels: -1\n");
 	g_string_append_printf(s, ";Compressed: true\n");
 	g_string_append_printf(s, ";CursorEnabled: false\n");
+}
 
-	return s;
+/* Write a sample as "<hex value>@<index>". */
+static void append_sample(GString *out, const uint8_t *sample,
+		unsigned int unitsize, uint64_t index)
+{
+	static const char hex[] = "0123456789abcdef";
+	unsigned int j;
+	gsize len;
+	char *p;
+
+	len = out->len;
+	g_string_set_size(out, len + 2 * unitsize + 1);
+	p = out->str + len;
+	/* The OLS format wants the samples presented MSB first. */
+	for (j = unitsize; j > 0; j--) {
+		*p++ = hex[sample[j - 1] >> 4];
+		*p++ = hex[sample[j - 1] & 0xf];
+	}
+	*p = '@';
+	sr_output_append_u64(out, index);
+	g_string_append_c(out, '\n');
 }
 
-static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
-		GString **out)
+static int receive_into(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *out)
 {
 	struct context *ctx;
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
 	const struct sr_config *src;
 	GSList *l;
-	unsigned int i, j;
-	uint8_t c;
+	const uint8_t *data, *sample;
+	size_t pos, count;
 
-	*out = NULL;
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 	ctx = o->priv;
@@ -115,16 +138,41 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		logic = packet->payload;
 		if (ctx->num_samples == 0) {
 			/* First logic packet in the feed. */
-			*out = gen_header(o->sdi, ctx);
-		} else
-			*out = g_string_sized_new(512);
-		for (i = 0; i <= logic->length - logic->unitsize; i += logic->unitsize) {
-			for (j = 0; j < logic->unitsize; j++) {
-				/* The OLS format wants the samples presented MSB first. */
-				c = *((uint8_t *)logic->data + i + logic->unitsize - 1 - j);
-				g_string_append_printf(*out, "%02x", c);
-			}
-			g_string_append_printf(*out, "@%"PRIu64"\n", ctx->num_samples++);
+			gen_header(o->sdi, ctx, out);
+		}
+		if (logic->unitsize != ctx->unitsize) {
+			g_free(ctx->prev_sample);
+			ctx->prev_sample = g_malloc0(logic->unitsize);
+			ctx->unitsize = logic->unitsize;
+		}
+		data = logic->data;
+		count = logic->length / logic->unitsize;
+		pos = 0;
+		if (ctx->num_samples == 0 && count) {
+			/* The first sample is always written. */
+			append_sample(out, data, ctx->unitsize, 0);
+			memcpy(ctx->prev_sample, data, ctx->unitsize);
+			ctx->last_written = 0;
+			pos++;
+		}
+		/* Only write changes, the index tells their position. */
+		while ((pos = sr_output_skip_unchanged(data, pos, count,
+				ctx->prev_sample, ctx->unitsize)) < count) {
+			sample = data + pos * ctx->unitsize;
+			append_sample(out, sample, ctx->unitsize,
+				ctx->num_samples + pos);
+			memcpy(ctx->prev_sample, sample, ctx->unitsize);
+			ctx->last_written = ctx->num_samples + pos;
+			pos++;
+		}
+		ctx->num_samples += count;
+		break;
+	case SR_DF_END:
+		/* The last sample tells the capture's length. */
+		if (ctx->num_samples && ctx->last_written != ctx->num_samples - 1) {
+			append_sample(out, ctx->prev_sample, ctx->unitsize,
+				ctx->num_samples - 1);
+			ctx->last_written = ctx->num_samples - 1;
 		}
 		break;
 	}
@@ -140,6 +188,7 @@ static int cleanup(struct sr_output *o)
 		return SR_ERR_ARG;
 
 	ctx = o->priv;
+	g_free(ctx->prev_sample);
 	g_free(ctx);
 	o->priv = NULL;
 
@@ -154,6 +203,6 @@ SR_PRIV struct sr_output_module output_ols = {
 	.flags = 0,
 	.options = NULL,
 	.init = init,
-	.receive = receive,
+	.receive_into = receive_into,
 	.cleanup = cleanup
 };
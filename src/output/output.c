@@ -18,7 +18,10 @@
  */
 
 #include <config.h>
+#include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <glib/gstdio.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
@@ -49,6 +52,10 @@
  * Output modules generate a newly allocated GString. The caller is then
  * expected to free this with g_string_free() when finished with it.
  *
+ * Alternatively, sr_output_new_file() lets the library write the output
+ * to a file. Output is then collected in large buffers, which a
+ * background thread writes while the next packets are being formatted.
+ *
  * @{
  */
 
@@ -68,6 +75,24 @@ extern SR_PRIV struct sr_output_module output_wavedrom;
 extern SR_PRIV struct sr_output_module output_null;
 /* @endcond */
 
+/* Output collected before a buffer is handed to the writer thread. */
+#define WRITER_BUFSIZE (1024 * 1024)
+/* Number of buffers: one being filled, the rest queued or being written. */
+#define WRITER_BUFFERS 3
+
+struct sr_output_writer {
+	FILE *file;
+	/* The buffer being filled with output. */
+	GString *buf;
+	/* Buffers waiting to be written. */
+	GAsyncQueue *full;
+	/* Written buffers, ready to be filled again. */
+	GAsyncQueue *empty;
+	GThread *thread;
+	/* Write error, set by the writer thread. */
+	gint error;
+};
+
 static const struct sr_output_module *output_module_list[] = {
 	&output_ascii,
 	&output_binary,
@@ -271,7 +296,7 @@ SR_API const struct sr_output *sr_output_new(const struct sr_output_module *omod
 	gpointer key, value;
 	int i;
 
-	op = g_malloc(sizeof(struct sr_output));
+	op = g_malloc0(sizeof(struct sr_output));
 	op->module = omod;
 	op->sdi = sdi;
 	op->filename = g_strdup(filename);
@@ -325,18 +350,428 @@ SR_API const struct sr_output *sr_output_new(const struct sr_output_module *omod
 	return op;
 }
 
+static int send_into(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *out)
+{
+	GString *buf;
+	int ret;
+
+	if (o->module->receive_into)
+		return o->module->receive_into(o, packet, out);
+
+	buf = NULL;
+	ret = o->module->receive(o, packet, &buf);
+	if (buf) {
+		g_string_append_len(out, buf->str, buf->len);
+		g_string_free(buf, TRUE);
+	}
+
+	return ret;
+}
+
+static gpointer writer_thread(gpointer data)
+{
+	struct sr_output_writer *w;
+	GString *buf;
+
+	w = data;
+	/* An empty buffer terminates the thread. */
+	while ((buf = g_async_queue_pop(w->full))->len) {
+		if (!g_atomic_int_get(&w->error)
+				&& fwrite(buf->str, 1, buf->len, w->file) != buf->len) {
+			sr_err("Error writing output file: %s.", g_strerror(errno));
+			g_atomic_int_set(&w->error, SR_ERR_IO);
+		}
+		g_string_truncate(buf, 0);
+		g_async_queue_push(w->empty, buf);
+	}
+	g_async_queue_push(w->empty, buf);
+
+	return NULL;
+}
+
+/* Queue the current buffer for writing and continue in an empty one. */
+static void writer_flush(struct sr_output_writer *w)
+{
+	if (!w->buf->len)
+		return;
+	g_async_queue_push(w->full, w->buf);
+	w->buf = g_async_queue_pop(w->empty);
+}
+
+static int writer_send(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet)
+{
+	struct sr_output_writer *w;
+	int ret;
+
+	w = o->writer;
+	if ((ret = g_atomic_int_get(&w->error)) != SR_OK)
+		return ret;
+
+	ret = send_into(o, packet, w->buf);
+	if (w->buf->len >= WRITER_BUFSIZE || packet->type == SR_DF_END)
+		writer_flush(w);
+
+	return ret;
+}
+
+static int writer_close(struct sr_output_writer *w)
+{
+	GString *buf;
+	int ret;
+
+	writer_flush(w);
+	/* Terminate the thread with the (empty) current buffer. */
+	g_async_queue_push(w->full, w->buf);
+	g_thread_join(w->thread);
+
+	while ((buf = g_async_queue_try_pop(w->empty)))
+		g_string_free(buf, TRUE);
+	g_async_queue_unref(w->empty);
+	g_async_queue_unref(w->full);
+
+	ret = g_atomic_int_get(&w->error);
+	if (fclose(w->file) != 0 && ret == SR_OK) {
+		sr_err("Error closing output file: %s.", g_strerror(errno));
+		ret = SR_ERR_IO;
+	}
+	g_free(w);
+
+	return ret;
+}
+
+/**
+ * Create a new output instance which writes to a file.
+ *
+ * This works like sr_output_new(), but the library writes the output to
+ * the specified file, for every output module. sr_output_send() then
+ * returns no output to the caller. Output is collected in large buffers,
+ * which are written by a background thread. sr_output_free() writes the
+ * remaining output and closes the file.
+ *
+ * Modules with the SR_OUTPUT_INTERNAL_IO_HANDLING flag write the file
+ * themselves, for those this is the same as sr_output_new().
+ *
+ * @param omod The output module to use. Must not be NULL.
+ * @param options The module options, as for sr_output_new(). Can be NULL.
+ * @param sdi The device which generates the data.
+ * @param filename The name of the file to write to. Must not be NULL.
+ *
+ * @return A newly allocated output instance, or NULL on error.
+ *
+ * @since 0.6.0
+ */
+SR_API const struct sr_output *sr_output_new_file(
+		const struct sr_output_module *omod, GHashTable *options,
+		const struct sr_dev_inst *sdi, const char *filename)
+{
+	struct sr_output *op;
+	struct sr_output_writer *w;
+	FILE *file;
+	int i;
+
+	if (!omod || !filename || !*filename) {
+		sr_err("Output file needs a module and a file name.");
+		return NULL;
+	}
+
+	op = (struct sr_output *)sr_output_new(omod, options, sdi, filename);
+	if (!op || sr_output_test_flag(omod, SR_OUTPUT_INTERNAL_IO_HANDLING))
+		return op;
+
+	if (!(file = g_fopen(filename, "wb"))) {
+		sr_err("Cannot open output file '%s': %s.",
+			filename, g_strerror(errno));
+		sr_output_free(op);
+		return NULL;
+	}
+	/* Buffering is done here, write the blocks directly. */
+	setvbuf(file, NULL, _IONBF, 0);
+
+	w = g_malloc0(sizeof(*w));
+	w->file = file;
+	w->full = g_async_queue_new();
+	w->empty = g_async_queue_new();
+	w->buf = g_string_sized_new(WRITER_BUFSIZE);
+	for (i = 1; i < WRITER_BUFFERS; i++)
+		g_async_queue_push(w->empty, g_string_sized_new(WRITER_BUFSIZE));
+	w->thread = g_thread_new("output-writer", writer_thread, w);
+	op->writer = w;
+
+	return op;
+}
+
 /**
  * Send a packet to the specified output instance.
  *
  * The instance's output is returned as a newly allocated GString,
- * which must be freed by the caller.
+ * which must be freed by the caller. Instances created with
+ * sr_output_new_file() write the output to their file instead, and
+ * return NULL.
  *
  * @since 0.4.0
  */
 SR_API int sr_output_send(const struct sr_output *o,
 		const struct sr_datafeed_packet *packet, GString **out)
 {
-	return o->module->receive(o, packet, out);
+	int ret;
+
+	if (o->writer) {
+		*out = NULL;
+		return writer_send(o, packet);
+	}
+
+	if (!o->module->receive_into)
+		return o->module->receive(o, packet, out);
+
+	*out = g_string_sized_new(512);
+	ret = o->module->receive_into(o, packet, *out);
+	if (ret != SR_OK || !(*out)->len) {
+		g_string_free(*out, TRUE);
+		*out = NULL;
+	}
+
+	return ret;
+}
+
+/**
+ * Send a packet to the specified output instance, appending the output
+ * to a caller provided buffer.
+ *
+ * This avoids an allocation per packet when the caller reuses the
+ * buffer, e.g. by truncating it after the output was written.
+ *
+ * @param o The output instance. Must not be NULL.
+ * @param packet The packet to send. Must not be NULL.
+ * @param out The buffer to append the instance's output to. Must not
+ *            be NULL. Instances created with sr_output_new_file() write
+ *            the output to their file instead.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval other Error code of the output module.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_output_send_into(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *out)
+{
+	if (!o || !packet || !out)
+		return SR_ERR_ARG;
+
+	if (o->writer)
+		return writer_send(o, packet);
+
+	return send_into(o, packet, out);
+}
+
+/**
+ * Pass output which a module collected so far to the writer thread.
+ *
+ * Modules which produce a lot of output for a single packet can call
+ * this while appending to the buffer of their receive_into() routine.
+ * For instances created with sr_output_new_file(), a full buffer gets
+ * written while the module continues in an empty one, so the output
+ * never has to be kept in memory as a whole. For other instances, or
+ * when the buffer is not full yet, nothing happens.
+ *
+ * @param o The output instance.
+ * @param out The buffer which was passed to receive_into().
+ *
+ * @private
+ */
+SR_PRIV void sr_output_flush_into(const struct sr_output *o, GString *out)
+{
+	struct sr_output_writer *w;
+	GString *buf, tmp;
+
+	w = o->writer;
+	if (!w || out != w->buf || out->len < WRITER_BUFSIZE)
+		return;
+
+	/* Exchange the contents, the module keeps appending to out. */
+	buf = g_async_queue_pop(w->empty);
+	tmp = *buf;
+	*buf = *out;
+	*out = tmp;
+	g_async_queue_push(w->full, buf);
+}
+
+/**
+ * Collect the bits of one logic channel from a block of samples.
+ *
+ * The bits are packed MSB first: bit 7 of bits[0] is the first sample
+ * when offset is 0. A non-zero offset starts the first sample at that
+ * bit position instead, so the packed bytes can be kept aligned to a
+ * position in an output line. Bits outside the samples are cleared.
+ *
+ * @param data The sample data.
+ * @param unitsize The size of one sample in bytes.
+ * @param count The number of samples.
+ * @param index The channel's bit index within a sample.
+ * @param offset The bit position of the first sample, 0 to 7.
+ * @param bits Receives (offset + count + 7) / 8 bytes of packed bits.
+ *
+ * @private
+ */
+SR_PRIV void sr_output_gather_bits(const uint8_t *data, unsigned int unitsize,
+		unsigned int count, unsigned int index, unsigned int offset,
+		uint8_t *bits)
+{
+	const uint8_t *p, *end;
+	unsigned int acc, n;
+	uint8_t mask;
+
+	p = data + index / 8;
+	end = p + count * unitsize;
+	mask = 1 << (index % 8);
+	acc = 0;
+	n = offset;
+	/* Leading samples up to the first full byte. */
+	while (n && p < end) {
+		acc = (acc << 1) | !!(*p & mask);
+		p += unitsize;
+		if (++n == 8) {
+			*bits++ = acc;
+			acc = 0;
+			n = 0;
+		}
+	}
+	/* Full bytes, eight samples at a time. */
+	while (end - p > 7 * unitsize) {
+		*bits++ = (!!(p[0] & mask) << 7)
+			| (!!(p[unitsize] & mask) << 6)
+			| (!!(p[2 * unitsize] & mask) << 5)
+			| (!!(p[3 * unitsize] & mask) << 4)
+			| (!!(p[4 * unitsize] & mask) << 3)
+			| (!!(p[5 * unitsize] & mask) << 2)
+			| (!!(p[6 * unitsize] & mask) << 1)
+			| !!(p[7 * unitsize] & mask);
+		p += 8 * unitsize;
+	}
+	/* Trailing samples, less than a byte. */
+	while (p < end) {
+		acc = (acc << 1) | !!(*p & mask);
+		p += unitsize;
+		n++;
+	}
+	if (n)
+		*bits = acc << (8 - n);
+}
+
+/**
+ * Get the time of a sample in units of a timescale, rounded to the
+ * nearest unit. The product of sample number and timescale can exceed
+ * 64 bits, so it gets split into the parts of whole seconds and of the
+ * remaining samples.
+ *
+ * @param sample The sample number.
+ * @param samplerate The samplerate. Without it, the sample number is
+ *                   returned.
+ * @param timescale The number of time units per second.
+ *
+ * @return The time of the sample.
+ *
+ * @private
+ */
+SR_PRIV uint64_t sr_output_sample_time(uint64_t sample, uint64_t samplerate,
+		uint64_t timescale)
+{
+	uint64_t quot, rem;
+
+	if (!samplerate)
+		return sample;
+	if (timescale % samplerate == 0)
+		return sample * (timescale / samplerate);
+
+	quot = sample / samplerate;
+	rem = sample % samplerate;
+	if (rem > UINT64_MAX / timescale)
+		return (double)sample / samplerate * timescale + 0.5;
+
+	return quot * timescale + (rem * timescale + samplerate / 2) / samplerate;
+}
+
+/**
+ * Fill a table which expands a byte of packed bits (MSB first) to
+ * eight characters.
+ *
+ * @param table The table to fill.
+ * @param zero The character for low bits.
+ * @param one The character for high bits.
+ *
+ * @private
+ */
+SR_PRIV void sr_output_bit_table(char table[256][8], char zero, char one)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < 256; i++) {
+		for (j = 0; j < 8; j++)
+			table[i][j] = (i & (0x80 >> j)) ? one : zero;
+	}
+}
+
+/**
+ * Append an unsigned decimal number, without going through printf.
+ *
+ * @param out The string to append to.
+ * @param value The number.
+ *
+ * @private
+ */
+SR_PRIV void sr_output_append_u64(GString *out, uint64_t value)
+{
+	char buf[20];
+	size_t pos;
+
+	pos = sizeof(buf);
+	do {
+		buf[--pos] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	g_string_append_len(out, buf + pos, sizeof(buf) - pos);
+}
+
+/**
+ * Find the first sample at or after a position which differs from a
+ * previous sample. Unit sizes which divide a machine word get compared
+ * a word at a time.
+ *
+ * @param data The sample data.
+ * @param pos The number of the first sample to check.
+ * @param count The number of samples in the data.
+ * @param prev The previous sample, unitsize bytes.
+ * @param unitsize The size of one sample in bytes.
+ *
+ * @return The number of the first changed sample, or count when all
+ *         samples from pos on are unchanged.
+ *
+ * @private
+ */
+SR_PRIV size_t sr_output_skip_unchanged(const uint8_t *data, size_t pos,
+		size_t count, const uint8_t *prev, unsigned int unitsize)
+{
+	uint64_t pattern, word;
+	size_t per_word;
+	unsigned int i;
+
+	if (sizeof(pattern) % unitsize == 0) {
+		for (i = 0; i < sizeof(pattern); i += unitsize)
+			memcpy((uint8_t *)&pattern + i, prev, unitsize);
+		per_word = sizeof(pattern) / unitsize;
+		while (pos + per_word <= count) {
+			memcpy(&word, data + pos * unitsize, sizeof(word));
+			if (word != pattern)
+				break;
+			pos += per_word;
+		}
+	}
+	while (pos < count && !memcmp(data + pos * unitsize, prev, unitsize))
+		pos++;
+
+	return pos;
 }
 
 /**
@@ -346,7 +781,7 @@ SR_API int sr_output_send(const struct sr_output *o,
  */
 SR_API int sr_output_free(const struct sr_output *o)
 {
-	int ret;
+	int ret, err;
 
 	if (!o)
 		return SR_ERR_ARG;
@@ -354,6 +789,8 @@ SR_API int sr_output_free(const struct sr_output *o)
 	ret = SR_OK;
 	if (o->module->cleanup)
 		ret = o->module->cleanup((struct sr_output *)o);
+	if (o->writer && (err = writer_close(o->writer)) != SR_OK)
+		ret = err;
 	g_free((char *)o->filename);
 	g_free((gpointer)o);
 
@@ -21,52 +21,221 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <zip.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
 #define LOG_PREFIX "output/srzip"
 
+/*
+ * Logic data and analog data (converted to float) get accumulated in
+ * memory and are written as separate archive entries when a chunk is
+ * complete. Completed chunks are appended to a spool file next to the
+ * output file, and the archive entries refer to ranges in that spool
+ * file. The archive itself is kept open for the whole capture, and only
+ * gets written (once) when the end of the data feed is seen.
+ *
+ * The spool file needs as much disk space as the chunks it holds (after
+ * compression when the worker threads are used), on top of the archive
+ * which libzip writes when closing. Chunks which were not compressed by
+ * the workers get compressed by libzip in that final step, in a single
+ * thread. Until then the output file does not exist. The spool file is
+ * removed when the archive got written, and on every error path.
+ */
+#define LOGIC_CHUNK_SIZE	(16 * 1024 * 1024)
+#define ANALOG_CHUNK_SAMPLES	(1024 * 1024)
+
+/*
+ * With zlib and a libzip which accepts user provided sources (1.0 and
+ * later), completed chunks get deflated by a pool of worker threads,
+ * and are handed to libzip in their compressed form. They are written
+ * to the spool file in the order of their submission.
+ */
+#if defined(HAVE_ZLIB) && defined(HAVE_ZIP_SOURCE_MAKE_COMMAND_BITMAP)
+#define HAVE_COMPRESS_WORKERS 1
+#endif
+
+enum {
+	COMPRESS_DEFLATE,
+	COMPRESS_STORE,
+	COMPRESS_ZSTD,
+};
+
+static const char *compress_names[] = {
+	[COMPRESS_DEFLATE] = "deflate",
+	[COMPRESS_STORE] = "store",
+	[COMPRESS_ZSTD] = "zstd",
+};
+
+#ifdef HAVE_COMPRESS_WORKERS
+struct compress_job {
+	char *name;
+	uint8_t *data;
+	size_t length;
+	uint8_t *comp_data;
+	size_t comp_length;
+	uint32_t crc;
+	int level;
+	gboolean done;
+};
+
+/* A precompressed range of the spool file, as a libzip source. */
+struct spool_source {
+	const char *filename;
+	uint64_t offset;
+	uint64_t comp_size;
+	uint64_t size;
+	uint32_t crc;
+	uint64_t pos;
+	FILE *file;
+	zip_error_t error;
+};
+#endif
+
+struct chunk_buff {
+	/* Archive entry name, without the chunk number. */
+	char *name;
+	uint8_t *data;
+	size_t alloc_size;
+	size_t fill_size;
+	/* Number of chunks which were written so far. */
+	unsigned int chunk_count;
+};
+
 struct out_context {
 	gboolean zip_created;
 	uint64_t samplerate;
 	char *filename;
+	struct zip *archive;
+	GKeyFile *meta;
+	char *spool_filename;
+	FILE *spool;
+	uint64_t spool_size;
+	int unitsize;
+	struct chunk_buff logic_buff;
 	gint first_analog_index;
 	gint *analog_index_map;
+	guint num_analog_channels;
+	struct chunk_buff *analog_buffs;
+	int compression;
+	int level;
+	int num_threads;
+#ifdef HAVE_COMPRESS_WORKERS
+	GThreadPool *pool;
+	GQueue *jobs;
+	guint max_jobs;
+	GMutex jobs_mutex;
+	GCond jobs_cond;
+#endif
 };
 
 static int init(struct sr_output *o, GHashTable *options)
 {
 	struct out_context *outc;
-
-	(void)options;
+	const char *compression;
+	int i, level, threads;
 
 	if (!o->filename || o->filename[0] == '\0') {
 		sr_info("srzip output module requires a file name, cannot save.");
 		return SR_ERR_ARG;
 	}
 
+	compression = g_variant_get_string(g_hash_table_lookup(options,
+		"compression"), NULL);
+	for (i = 0; i < (int)ARRAY_SIZE(compress_names); i++) {
+		if (g_ascii_strcasecmp(compression, compress_names[i]) == 0)
+			break;
+	}
+	if (i == (int)ARRAY_SIZE(compress_names)) {
+		sr_err("Unknown compression method '%s'.", compression);
+		return SR_ERR_ARG;
+	}
+	if (i == COMPRESS_ZSTD) {
+		/*
+		 * The session file reader decompresses entries through
+		 * libzip as well. Don't write archives which this very
+		 * libsigrok cannot read back.
+		 */
+#if defined(ZIP_CM_ZSTD) && defined(HAVE_ZIP_COMPRESSION_METHOD_SUPPORTED)
+		if (!zip_compression_method_supported(ZIP_CM_ZSTD, 1)
+				|| !zip_compression_method_supported(ZIP_CM_ZSTD, 0)) {
+			sr_err("libzip was built without zstd support.");
+			return SR_ERR_ARG;
+		}
+#else
+		sr_err("zstd compression needs libzip 1.8 or later.");
+		return SR_ERR_ARG;
+#endif
+	}
+	level = g_variant_get_int32(g_hash_table_lookup(options, "level"));
+	threads = g_variant_get_int32(g_hash_table_lookup(options, "threads"));
+	if (level < 0 || threads < 0) {
+		sr_err("Compression level and thread count must not be negative.");
+		return SR_ERR_ARG;
+	}
+
 	outc = g_malloc0(sizeof(struct out_context));
 	outc->filename = g_strdup(o->filename);
+	outc->compression = i;
+	outc->level = level;
+	outc->num_threads = threads ? threads : (int)g_get_num_processors();
 	o->priv = outc;
 
 	return SR_OK;
 }
 
+static int spool_open(struct out_context *outc)
+{
+	int fd;
+
+	/* Keep the spool file on the same file system as the output. */
+	outc->spool_filename = g_strdup_printf("%s.XXXXXX", outc->filename);
+	fd = g_mkstemp(outc->spool_filename);
+	if (fd < 0) {
+		sr_err("Cannot create spool file '%s': %s",
+			outc->spool_filename, g_strerror(errno));
+		return SR_ERR_IO;
+	}
+	outc->spool = fdopen(fd, "w+b");
+	if (!outc->spool) {
+		close(fd);
+		g_unlink(outc->spool_filename);
+		return SR_ERR_IO;
+	}
+	outc->spool_size = 0;
+
+	return SR_OK;
+}
+
+static void spool_close(struct out_context *outc)
+{
+	if (outc->spool) {
+		fclose(outc->spool);
+		outc->spool = NULL;
+		g_unlink(outc->spool_filename);
+	}
+	g_free(outc->spool_filename);
+	outc->spool_filename = NULL;
+}
+
 static int zip_create(const struct sr_output *o)
 {
 	struct out_context *outc;
 	struct zip *zipfile;
-	struct zip_source *versrc, *metasrc;
+	struct zip_source *versrc;
 	struct sr_channel *ch;
 	GVariant *gvar;
 	GKeyFile *meta;
 	GSList *l;
 	const char *devgroup;
-	char *s, *metabuf;
-	gsize metalen;
+	char *s;
+	int ret;
 	guint logic_channels = 0, enabled_logic_channels = 0;
 	guint enabled_analog_channels = 0;
 	guint index;
@@ -85,8 +254,15 @@ static int zip_create(const struct sr_output *o)
 	if (!zipfile)
 		return SR_ERR;
 
-	/* "version" */
-	versrc = zip_source_buffer(zipfile, "2", 1, FALSE);
+	/*
+	 * "version": Archives with entries which are compressed by other
+	 * methods than deflate are version 3, older readers cannot read
+	 * them anyway.
+	 */
+	if (outc->compression == COMPRESS_ZSTD)
+		versrc = zip_source_buffer(zipfile, "3", 1, FALSE);
+	else
+		versrc = zip_source_buffer(zipfile, "2", 1, FALSE);
 	if (zip_add(zipfile, "version", versrc) < 0) {
 		sr_err("Error saving version into zipfile: %s",
 			zip_strerror(zipfile));
@@ -167,146 +343,486 @@ static int zip_create(const struct sr_output *o)
 		}
 	}
 
-	metabuf = g_key_file_to_data(meta, &metalen, NULL);
-	g_key_file_free(meta);
+	outc->logic_buff.name = g_strdup("logic-1");
+	outc->num_analog_channels = enabled_analog_channels;
+	outc->analog_buffs = g_malloc0(sizeof(struct chunk_buff)
+		* enabled_analog_channels);
+	for (index = 0; index < enabled_analog_channels; index++) {
+		outc->analog_buffs[index].name = g_strdup_printf("analog-1-%u",
+			outc->first_analog_index + index);
+		outc->analog_buffs[index].alloc_size =
+			sizeof(float) * ANALOG_CHUNK_SAMPLES;
+	}
 
-	metasrc = zip_source_buffer(zipfile, metabuf, metalen, FALSE);
-	if (zip_add(zipfile, "metadata", metasrc) < 0) {
-		sr_err("Error saving metadata into zipfile: %s",
-			zip_strerror(zipfile));
-		zip_source_free(metasrc);
+	/* The metadata only gets written when the archive gets closed. */
+	if ((ret = spool_open(outc)) != SR_OK) {
+		g_key_file_free(meta);
 		zip_discard(zipfile);
-		g_free(metabuf);
-		return SR_ERR;
+		return ret;
 	}
+	outc->meta = meta;
+	outc->archive = zipfile;
 
-	if (zip_close(zipfile) < 0) {
-		sr_err("Error saving zipfile: %s", zip_strerror(zipfile));
-		zip_discard(zipfile);
-		g_free(metabuf);
-		return SR_ERR;
+	return SR_OK;
+}
+
+static int spool_write(struct out_context *outc, const uint8_t *data,
+		size_t length)
+{
+	if (fwrite(data, 1, length, outc->spool) != length
+			|| fflush(outc->spool) != 0) {
+		sr_err("Cannot write spool file: %s", g_strerror(errno));
+		return SR_ERR_IO;
 	}
-	g_free(metabuf);
+	outc->spool_size += length;
 
 	return SR_OK;
 }
 
-static int zip_append(const struct sr_output *o, unsigned char *buf,
-		int unitsize, int length)
+static int set_compression(struct out_context *outc, zip_int64_t index,
+		int compression)
 {
-	struct out_context *outc;
-	struct zip *archive;
-	struct zip_source *logicsrc;
-	int64_t i, num_files;
-	struct zip_stat zs;
-	struct zip_source *metasrc;
-	GKeyFile *kf;
-	GError *error;
-	uint64_t chunk_num;
-	const char *entry_name;
-	char *metabuf;
-	gsize metalen;
-	char *chunkname;
-	unsigned int next_chunk_num;
+#ifdef HAVE_ZIP_SET_FILE_COMPRESSION
+	int method;
 
-	outc = o->priv;
-	if (!(archive = zip_open(outc->filename, 0, NULL)))
+	switch (compression) {
+	case COMPRESS_STORE:
+		method = ZIP_CM_STORE;
+		break;
+#ifdef ZIP_CM_ZSTD
+	case COMPRESS_ZSTD:
+		method = ZIP_CM_ZSTD;
+		break;
+#endif
+	default:
+		method = ZIP_CM_DEFLATE;
+		break;
+	}
+	if (zip_set_file_compression(outc->archive, index, method,
+			outc->level) < 0) {
+		sr_err("Failed to set compression: %s",
+			zip_strerror(outc->archive));
 		return SR_ERR;
+	}
+#else
+	(void)outc;
+	(void)index;
+	(void)compression;
+#endif
 
-	if (zip_stat(archive, "metadata", 0, &zs) < 0) {
-		sr_err("Failed to open metadata: %s", zip_strerror(archive));
-		zip_discard(archive);
+	return SR_OK;
+}
+
+/* Have libzip compress a chunk from the spool file when the archive gets closed. */
+static int add_spooled_chunk(struct out_context *outc, const char *name,
+		const uint8_t *data, size_t length, int compression)
+{
+	struct zip_source *src;
+	zip_int64_t index;
+	uint64_t offset;
+	int ret;
+
+	offset = outc->spool_size;
+	if ((ret = spool_write(outc, data, length)) != SR_OK)
+		return ret;
+
+	src = zip_source_file(outc->archive, outc->spool_filename,
+		offset, length);
+	if (!src || (index = zip_add(outc->archive, name, src)) < 0) {
+		sr_err("Failed to add chunk '%s': %s", name,
+			zip_strerror(outc->archive));
+		if (src)
+			zip_source_free(src);
 		return SR_ERR;
 	}
-	kf = sr_sessionfile_read_metadata(archive, &zs);
-	if (!kf) {
-		zip_discard(archive);
-		return SR_ERR_DATA;
-	}
-	/*
-	 * If the file was only initialized but doesn't yet have any
-	 * data it in, it won't have a unitsize field in metadata yet.
-	 */
-	error = NULL;
-	metabuf = NULL;
-	if (!g_key_file_has_key(kf, "device 1", "unitsize", &error)) {
-		if (error && error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
-			sr_err("Failed to check unitsize key: %s", error->message);
-			g_error_free(error);
-			g_key_file_free(kf);
-			zip_discard(archive);
-			return SR_ERR;
+
+	return set_compression(outc, index, compression);
+}
+
+#ifdef HAVE_COMPRESS_WORKERS
+static zip_int64_t spool_source_cb(void *userdata, void *data,
+		zip_uint64_t len, enum zip_source_cmd cmd)
+{
+	struct spool_source *ss;
+	struct zip_stat *st;
+	size_t count;
+
+	ss = userdata;
+
+	switch (cmd) {
+	case ZIP_SOURCE_OPEN:
+		ss->file = g_fopen(ss->filename, "rb");
+		if (!ss->file || fseeko(ss->file, ss->offset, SEEK_SET) != 0) {
+			zip_error_set(&ss->error, ZIP_ER_OPEN, errno);
+			return -1;
 		}
-		g_clear_error(&error);
-
-		/* Add unitsize field. */
-		g_key_file_set_integer(kf, "device 1", "unitsize", unitsize);
-		metabuf = g_key_file_to_data(kf, &metalen, NULL);
-		metasrc = zip_source_buffer(archive, metabuf, metalen, FALSE);
-
-		if (zip_replace(archive, zs.index, metasrc) < 0) {
-			sr_err("Failed to replace metadata: %s",
-				zip_strerror(archive));
-			g_key_file_free(kf);
-			zip_source_free(metasrc);
-			zip_discard(archive);
-			g_free(metabuf);
-			return SR_ERR;
+		ss->pos = 0;
+		return 0;
+	case ZIP_SOURCE_READ:
+		count = MIN(len, ss->comp_size - ss->pos);
+		if (count && fread(data, 1, count, ss->file) != count) {
+			zip_error_set(&ss->error, ZIP_ER_READ, errno);
+			return -1;
 		}
+		ss->pos += count;
+		return count;
+	case ZIP_SOURCE_CLOSE:
+		if (ss->file)
+			fclose(ss->file);
+		ss->file = NULL;
+		return 0;
+	case ZIP_SOURCE_STAT:
+		st = data;
+		zip_stat_init(st);
+		st->valid = ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE
+			| ZIP_STAT_COMP_METHOD | ZIP_STAT_CRC;
+		st->size = ss->size;
+		st->comp_size = ss->comp_size;
+		st->comp_method = ZIP_CM_DEFLATE;
+		st->crc = ss->crc;
+		return sizeof(*st);
+	case ZIP_SOURCE_ERROR:
+		return zip_error_to_data(&ss->error, data, len);
+	case ZIP_SOURCE_FREE:
+		if (ss->file)
+			fclose(ss->file);
+		zip_error_fini(&ss->error);
+		g_free(ss);
+		return 0;
+	case ZIP_SOURCE_SUPPORTS:
+		return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN,
+			ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT,
+			ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, -1);
+	default:
+		zip_error_set(&ss->error, ZIP_ER_INVAL, 0);
+		return -1;
 	}
-	g_key_file_free(kf);
+}
 
-	next_chunk_num = 1;
-	num_files = zip_get_num_entries(archive, 0);
-	for (i = 0; i < num_files; i++) {
-		entry_name = zip_get_name(archive, i, 0);
-		if (!entry_name || strncmp(entry_name, "logic-1", 7) != 0)
-			continue;
-		if (entry_name[7] == '\0') {
-			/*
-			 * This file has no extra chunks, just a single
-			 * "logic-1". Rename it to "logic-1-1" and continue
-			 * with chunk 2.
-			 */
-			if (zip_rename(archive, i, "logic-1-1") < 0) {
-				sr_err("Failed to rename 'logic-1' to 'logic-1-1': %s",
-					zip_strerror(archive));
-				zip_discard(archive);
-				g_free(metabuf);
-				return SR_ERR;
-			}
-			next_chunk_num = 2;
-			break;
-		} else if (entry_name[7] == '-') {
-			chunk_num = g_ascii_strtoull(entry_name + 8, NULL, 10);
-			if (chunk_num < G_MAXINT && chunk_num >= next_chunk_num)
-				next_chunk_num = chunk_num + 1;
+/* Worker thread: raw deflate the chunk, as it is stored in zip archives. */
+static void compress_chunk(gpointer data, gpointer user_data)
+{
+	struct out_context *outc;
+	struct compress_job *job;
+	z_stream zs;
+	uLong bound;
+
+	job = data;
+	outc = user_data;
+
+	job->crc = crc32(0L, job->data, job->length);
+	memset(&zs, 0, sizeof(zs));
+	if (deflateInit2(&zs, job->level ? job->level : Z_DEFAULT_COMPRESSION,
+			Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK) {
+		bound = deflateBound(&zs, job->length);
+		job->comp_data = g_try_malloc(bound);
+		if (job->comp_data) {
+			zs.next_in = job->data;
+			zs.avail_in = job->length;
+			zs.next_out = job->comp_data;
+			zs.avail_out = bound;
+			if (deflate(&zs, Z_FINISH) == Z_STREAM_END)
+				job->comp_length = zs.total_out;
 		}
+		deflateEnd(&zs);
 	}
 
-	if (length % unitsize != 0) {
-		sr_warn("Chunk size %d not a multiple of the"
-			" unit size %d.", length, unitsize);
+	/* Incompressible (or failed) chunks get stored as they are. */
+	if (!job->comp_length || job->comp_length >= job->length) {
+		g_free(job->comp_data);
+		job->comp_data = NULL;
+		job->comp_length = 0;
 	}
-	logicsrc = zip_source_buffer(archive, buf, length, FALSE);
-	chunkname = g_strdup_printf("logic-1-%u", next_chunk_num);
-	i = zip_add(archive, chunkname, logicsrc);
-	g_free(chunkname);
-	if (i < 0) {
-		sr_err("Failed to add chunk 'logic-1-%u': %s",
-			next_chunk_num, zip_strerror(archive));
-		zip_source_free(logicsrc);
-		zip_discard(archive);
-		g_free(metabuf);
+
+	g_mutex_lock(&outc->jobs_mutex);
+	job->done = TRUE;
+	g_cond_broadcast(&outc->jobs_cond);
+	g_mutex_unlock(&outc->jobs_mutex);
+}
+
+static void compress_job_free(struct compress_job *job)
+{
+	g_free(job->name);
+	g_free(job->data);
+	g_free(job->comp_data);
+	g_free(job);
+}
+
+static int write_compressed_chunk(struct out_context *outc,
+		struct compress_job *job)
+{
+	struct spool_source *ss;
+	struct zip_source *src;
+	uint64_t offset;
+	int ret;
+
+	if (!job->comp_data) {
+		/* libzip must not try to deflate this chunk again. */
+		return add_spooled_chunk(outc, job->name, job->data,
+			job->length, COMPRESS_STORE);
+	}
+
+	offset = outc->spool_size;
+	if ((ret = spool_write(outc, job->comp_data, job->comp_length)) != SR_OK)
+		return ret;
+
+	ss = g_malloc0(sizeof(*ss));
+	ss->filename = outc->spool_filename;
+	ss->offset = offset;
+	ss->comp_size = job->comp_length;
+	ss->size = job->length;
+	ss->crc = job->crc;
+	zip_error_init(&ss->error);
+	src = zip_source_function(outc->archive, spool_source_cb, ss);
+	if (!src) {
+		g_free(ss);
+		sr_err("Failed to create source for chunk '%s': %s",
+			job->name, zip_strerror(outc->archive));
 		return SR_ERR;
 	}
-	if (zip_close(archive) < 0) {
-		sr_err("Error saving session file: %s", zip_strerror(archive));
-		zip_discard(archive);
-		g_free(metabuf);
+	if (zip_add(outc->archive, job->name, src) < 0) {
+		sr_err("Failed to add chunk '%s': %s", job->name,
+			zip_strerror(outc->archive));
+		zip_source_free(src);
 		return SR_ERR;
 	}
+
+	return SR_OK;
+}
+
+/*
+ * Write the completed chunks at the head of the job queue, in order.
+ * Blocks while too many chunks are in flight, or until all chunks
+ * are written when wait_all is set.
+ */
+static int drain_jobs(struct out_context *outc, gboolean wait_all)
+{
+	struct compress_job *job;
+	int ret;
+
+	ret = SR_OK;
+	for (;;) {
+		g_mutex_lock(&outc->jobs_mutex);
+		job = g_queue_peek_head(outc->jobs);
+		while (job && !job->done && (wait_all
+				|| g_queue_get_length(outc->jobs) > outc->max_jobs))
+			g_cond_wait(&outc->jobs_cond, &outc->jobs_mutex);
+		if (job && !job->done)
+			job = NULL;
+		if (job)
+			g_queue_pop_head(outc->jobs);
+		g_mutex_unlock(&outc->jobs_mutex);
+		if (!job)
+			break;
+		if (ret == SR_OK)
+			ret = write_compressed_chunk(outc, job);
+		compress_job_free(job);
+	}
+
+	return ret;
+}
+
+static void stop_workers(struct out_context *outc)
+{
+	struct compress_job *job;
+
+	if (!outc->pool)
+		return;
+
+	/* Wait for all pending jobs, then discard what was not written. */
+	g_thread_pool_free(outc->pool, FALSE, TRUE);
+	outc->pool = NULL;
+	while ((job = g_queue_pop_head(outc->jobs)))
+		compress_job_free(job);
+	g_queue_free(outc->jobs);
+	outc->jobs = NULL;
+	g_mutex_clear(&outc->jobs_mutex);
+	g_cond_clear(&outc->jobs_cond);
+}
+#endif
+
+/*
+ * Write a completed chunk as an archive entry. Takes ownership of the
+ * name and the data.
+ */
+static int write_chunk(struct out_context *outc, char *name,
+		uint8_t *data, size_t length)
+{
+	int ret;
+#ifdef HAVE_COMPRESS_WORKERS
+	struct compress_job *job;
+	GError *error;
+
+	if (outc->compression == COMPRESS_DEFLATE && outc->num_threads > 0
+			&& !outc->pool) {
+		error = NULL;
+		outc->pool = g_thread_pool_new(compress_chunk, outc,
+			outc->num_threads, FALSE, &error);
+		if (!outc->pool) {
+			sr_warn("Cannot start compression threads: %s",
+				error ? error->message : "unknown error");
+			g_clear_error(&error);
+			outc->num_threads = 0;
+		} else {
+			outc->jobs = g_queue_new();
+			outc->max_jobs = 2 * outc->num_threads;
+			g_mutex_init(&outc->jobs_mutex);
+			g_cond_init(&outc->jobs_cond);
+		}
+	}
+
+	if (outc->pool) {
+		job = g_malloc0(sizeof(*job));
+		job->name = name;
+		job->data = data;
+		job->length = length;
+		job->level = outc->level;
+		g_mutex_lock(&outc->jobs_mutex);
+		g_queue_push_tail(outc->jobs, job);
+		g_mutex_unlock(&outc->jobs_mutex);
+		g_thread_pool_push(outc->pool, job, NULL);
+
+		return drain_jobs(outc, FALSE);
+	}
+#endif
+
+	ret = add_spooled_chunk(outc, name, data, length, outc->compression);
+	g_free(name);
+	g_free(data);
+
+	return ret;
+}
+
+static int chunk_buff_alloc(struct chunk_buff *buff)
+{
+	if (!buff->data && !(buff->data = g_try_malloc(buff->alloc_size)))
+		return SR_ERR_MALLOC;
+
+	return SR_OK;
+}
+
+/* Hand the buffered data over as the stream's next archive entry. */
+static int flush_chunk(struct out_context *outc, struct chunk_buff *buff)
+{
+	char *chunkname;
+	int ret;
+
+	if (!buff->fill_size)
+		return SR_OK;
+
+	chunkname = g_strdup_printf("%s-%u", buff->name, ++buff->chunk_count);
+	ret = write_chunk(outc, chunkname, buff->data, buff->fill_size);
+	buff->data = NULL;
+	buff->fill_size = 0;
+
+	return ret;
+}
+
+/* Flush pending data, write the metadata, and close the archive. */
+static int zip_finish(struct out_context *outc)
+{
+	struct zip_source *metasrc;
+	struct chunk_buff *buff;
+	char *metabuf;
+	gsize metalen;
+	guint i;
+	int ret;
+
+	if (!outc->archive)
+		return SR_OK;
+
+	metabuf = NULL;
+	ret = flush_chunk(outc, &outc->logic_buff);
+	for (i = 0; ret == SR_OK && i < outc->num_analog_channels; i++) {
+		buff = &outc->analog_buffs[i];
+		ret = flush_chunk(outc, buff);
+	}
+#ifdef HAVE_COMPRESS_WORKERS
+	if (outc->pool) {
+		if (ret == SR_OK)
+			ret = drain_jobs(outc, TRUE);
+		stop_workers(outc);
+	}
+#endif
+	if (ret != SR_OK)
+		goto err_discard;
+
+	if (outc->unitsize)
+		g_key_file_set_integer(outc->meta, "device 1", "unitsize",
+			outc->unitsize);
+	metabuf = g_key_file_to_data(outc->meta, &metalen, NULL);
+	metasrc = zip_source_buffer(outc->archive, metabuf, metalen, FALSE);
+	if (zip_add(outc->archive, "metadata", metasrc) < 0) {
+		sr_err("Error saving metadata into zipfile: %s",
+			zip_strerror(outc->archive));
+		zip_source_free(metasrc);
+		ret = SR_ERR;
+		goto err_discard;
+	}
+
+	if (zip_close(outc->archive) < 0) {
+		sr_err("Error saving session file: %s",
+			zip_strerror(outc->archive));
+		ret = SR_ERR;
+		goto err_discard;
+	}
+	outc->archive = NULL;
 	g_free(metabuf);
+	spool_close(outc);
+
+	return SR_OK;
+
+err_discard:
+#ifdef HAVE_COMPRESS_WORKERS
+	stop_workers(outc);
+#endif
+	zip_discard(outc->archive);
+	outc->archive = NULL;
+	g_free(metabuf);
+	spool_close(outc);
+
+	return ret;
+}
+
+static int zip_append(const struct sr_output *o, unsigned char *buf,
+		int unitsize, int length)
+{
+	struct out_context *outc;
+	struct chunk_buff *buff;
+	size_t count;
+	int ret;
+
+	outc = o->priv;
+	buff = &outc->logic_buff;
+
+	if (!outc->unitsize) {
+		/* Chunks always hold whole samples. */
+		outc->unitsize = unitsize;
+		buff->alloc_size = LOGIC_CHUNK_SIZE / unitsize * unitsize;
+	} else if (unitsize != outc->unitsize) {
+		sr_err("Unit size changed from %d to %d.",
+			outc->unitsize, unitsize);
+		return SR_ERR_DATA;
+	}
+
+	if (length % unitsize != 0) {
+		sr_warn("Chunk size %d not a multiple of the"
+			" unit size %d.", length, unitsize);
+	}
+
+	while (length > 0) {
+		if ((ret = chunk_buff_alloc(buff)) != SR_OK)
+			return ret;
+		count = MIN(buff->alloc_size - buff->fill_size, (size_t)length);
+		memcpy(buff->data + buff->fill_size, buf, count);
+		buff->fill_size += count;
+		buf += count;
+		length -= count;
+		if (buff->fill_size == buff->alloc_size) {
+			if ((ret = flush_chunk(outc, buff)) != SR_OK)
+				return ret;
+		}
+	}
 
 	return SR_OK;
 }
@@ -315,19 +831,12 @@ static int zip_append_analog(const struct sr_output *o,
 		const struct sr_datafeed_analog *analog)
 {
 	struct out_context *outc;
-	struct zip *archive;
-	struct zip_source *analogsrc;
-	int64_t i, num_files;
-	struct zip_stat zs;
-	uint64_t chunk_num;
-	const char *entry_name;
-	char *basename;
-	gsize baselen;
+	struct chunk_buff *buff;
 	struct sr_channel *channel;
 	float *chunkbuf;
 	gsize chunksize;
-	char *chunkname;
-	unsigned int next_chunk_num, index;
+	unsigned int index;
+	int ret;
 
 	outc = o->priv;
 
@@ -347,66 +856,32 @@ static int zip_append_analog(const struct sr_output *o,
 	if (outc->analog_index_map[index] == -1)
 		return SR_ERR_ARG; /* Channel index was not in the list */
 
-	index += outc->first_analog_index;
-
-	if (!(archive = zip_open(outc->filename, 0, NULL)))
-		return SR_ERR;
-
-	if (zip_stat(archive, "metadata", 0, &zs) < 0) {
-		sr_err("Failed to open metadata: %s", zip_strerror(archive));
-		goto err_zip_discard;
-	}
-
-	basename = g_strdup_printf("analog-1-%u", index);
-	baselen = strlen(basename);
-	next_chunk_num = 1;
-	num_files = zip_get_num_entries(archive, 0);
-	for (i = 0; i < num_files; i++) {
-		entry_name = zip_get_name(archive, i, 0);
-		if (!entry_name || strncmp(entry_name, basename, baselen) != 0) {
-			continue;
-		} else if (entry_name[baselen] == '-') {
-			chunk_num = g_ascii_strtoull(entry_name + baselen + 1, NULL, 10);
-			if (chunk_num < G_MAXINT && chunk_num >= next_chunk_num)
-				next_chunk_num = chunk_num + 1;
-		}
-	}
-
+	buff = &outc->analog_buffs[index];
 	chunksize = sizeof(float) * analog->num_samples;
-	if (!(chunkbuf = g_try_malloc(chunksize)))
-		goto err_free_basename;
-
-	if (sr_analog_to_float(analog, chunkbuf) != SR_OK)
-		goto err_free_chunkbuf;
-
-	analogsrc = zip_source_buffer(archive, chunkbuf, chunksize, FALSE);
-	chunkname = g_strdup_printf("%s-%u", basename, next_chunk_num);
-	i = zip_add(archive, chunkname, analogsrc);
-	if (i < 0) {
-		sr_err("Failed to add chunk '%s': %s", chunkname, zip_strerror(archive));
-		g_free(chunkname);
-		zip_source_free(analogsrc);
-		goto err_free_chunkbuf;
+	if (buff->fill_size + chunksize > buff->alloc_size) {
+		if ((ret = flush_chunk(outc, buff)) != SR_OK)
+			return ret;
 	}
-	g_free(chunkname);
-	if (zip_close(archive) < 0) {
-		sr_err("Error saving session file: %s", zip_strerror(archive));
-		goto err_free_chunkbuf;
+
+	if (chunksize > buff->alloc_size) {
+		/* Packets which exceed the chunk size become a chunk of their own. */
+		if (!(chunkbuf = g_try_malloc(chunksize)))
+			return SR_ERR_MALLOC;
+		buff->data = (uint8_t *)chunkbuf;
+		if ((ret = sr_analog_to_float(analog, chunkbuf)) != SR_OK)
+			return ret;
+		buff->fill_size = chunksize;
+		return flush_chunk(outc, buff);
 	}
 
-	g_free(basename);
-	g_free(chunkbuf);
+	if ((ret = chunk_buff_alloc(buff)) != SR_OK)
+		return ret;
+	chunkbuf = (float *)(buff->data + buff->fill_size);
+	if ((ret = sr_analog_to_float(analog, chunkbuf)) != SR_OK)
+		return ret;
+	buff->fill_size += chunksize;
 
 	return SR_OK;
-
-err_free_chunkbuf:
-	g_free(chunkbuf);
-err_free_basename:
-	g_free(basename);
-err_zip_discard:
-	zip_discard(archive);
-
-	return SR_ERR;
 }
 
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
@@ -457,25 +932,60 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		if (ret != SR_OK)
 			return ret;
 		break;
+	case SR_DF_END:
+		if (outc->zip_created)
+			return zip_finish(outc);
+		break;
 	}
 
 	return SR_OK;
 }
 
 static struct sr_option options[] = {
+	{"compression", "Compression", "Compression method of data entries", NULL, NULL},
+	{"level", "Compression level", "Compression level (0 for the method's default)", NULL, NULL},
+	{"threads", "Compression threads", "Number of compression threads (0 for one per CPU)", NULL, NULL},
 	ALL_ZERO
 };
 
 static const struct sr_option *get_options(void)
 {
+	GSList *l = NULL;
+	unsigned int i;
+
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_string(
+			compress_names[COMPRESS_DEFLATE]));
+		for (i = 0; i < ARRAY_SIZE(compress_names); i++)
+			l = g_slist_append(l, g_variant_ref_sink(
+				g_variant_new_string(compress_names[i])));
+		options[0].values = l;
+		options[1].def = g_variant_ref_sink(g_variant_new_int32(0));
+		options[2].def = g_variant_ref_sink(g_variant_new_int32(0));
+	}
+
 	return options;
 }
 
 static int cleanup(struct sr_output *o)
 {
 	struct out_context *outc;
+	guint i;
 
 	outc = o->priv;
+
+	/* Don't lose the data when the feed did not end regularly. */
+	zip_finish(outc);
+
+	if (outc->meta)
+		g_key_file_free(outc->meta);
+	g_free(outc->logic_buff.name);
+	g_free(outc->logic_buff.data);
+	for (i = 0; i < outc->num_analog_channels; i++) {
+		g_free(outc->analog_buffs[i].name);
+		g_free(outc->analog_buffs[i].data);
+	}
+	g_free(outc->analog_buffs);
 	g_free(outc->analog_index_map);
 	g_free(outc->filename);
 	g_free(outc);
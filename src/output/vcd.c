@@ -27,6 +27,19 @@
 
 #define LOG_PREFIX "output/vcd"
 
+/* Longest identifier for a 32bit signal number, in base 94. */
+#define MAX_ID_LEN 5
+
+/* A VCD variable: a single channel, or a vector of channels. */
+struct signal {
+	char *name;
+	char id[MAX_ID_LEN + 1];
+	int width;
+	/* Data image positions of the signal's bits, LSB first. */
+	int *bits;
+	uint64_t dirty;
+};
+
 struct context {
 	int num_enabled_channels;
 	uint8_t *prevsample;
@@ -35,16 +48,225 @@ struct context {
 	int *channel_index;
 	uint64_t samplerate;
 	uint64_t samplecount;
+	int num_signals;
+	struct signal *signals;
+	/* Signal for each data image position. */
+	int *bit_signal;
+	/* Vectors which changed in the current sample. */
+	int *changed;
+	uint64_t change_count;
 };
 
-static int init(struct sr_output *o, GHashTable *options)
+/*
+ * Generate a compact identifier from the printable ASCII range. The
+ * first 94 signals get single character identifiers, as before.
+ */
+static void gen_identifier(char *id, unsigned int num)
+{
+	size_t len;
+
+	len = 0;
+	while (1) {
+		id[len++] = '!' + num % 94;
+		if (num < 94)
+			break;
+		num = num / 94 - 1;
+	}
+	id[len] = '\0';
+}
+
+/* Find a channel's data image position, or -1 if it's not enabled. */
+static int channel_position(const struct context *ctx, int index)
+{
+	int p;
+
+	for (p = 0; p < ctx->num_enabled_channels; p++) {
+		if (ctx->channel_index[p] == index)
+			return p;
+	}
+
+	return -1;
+}
+
+/* Collect not yet assigned positions into a new vector. */
+static void add_vector(GArray *vectors, int *vector_of, const char *name,
+		const int *positions, int count)
+{
+	struct signal sig;
+	int i;
+
+	memset(&sig, 0, sizeof(sig));
+	sig.name = g_strdup(name);
+	sig.bits = g_malloc(sizeof(int) * count);
+	for (i = 0; i < count; i++) {
+		if (vector_of[positions[i]] >= 0)
+			continue;
+		vector_of[positions[i]] = vectors->len;
+		sig.bits[sig.width++] = positions[i];
+	}
+	if (!sig.width) {
+		g_free(sig.name);
+		g_free(sig.bits);
+		return;
+	}
+	g_array_append_val(vectors, sig);
+}
+
+/* Use the device's channel groups of logic channels as vectors. */
+static void add_group_vectors(const struct sr_output *o, GArray *vectors,
+		int *vector_of)
+{
+	struct context *ctx;
+	struct sr_channel_group *cg;
+	struct sr_channel *ch;
+	GSList *l, *m;
+	int *positions, count, p;
+
+	ctx = o->priv;
+	positions = g_malloc(sizeof(int) * ctx->num_enabled_channels);
+	for (l = o->sdi->channel_groups; l; l = l->next) {
+		cg = l->data;
+		count = 0;
+		for (m = cg->channels; m; m = m->next) {
+			ch = m->data;
+			if (ch->type != SR_CHANNEL_LOGIC || !ch->enabled)
+				continue;
+			if ((p = channel_position(ctx, ch->index)) >= 0)
+				positions[count++] = p;
+		}
+		if (count > 1)
+			add_vector(vectors, vector_of, cg->name, positions, count);
+	}
+	g_free(positions);
+}
+
+/* Parse a channel index range "first-last", or a single index. */
+static gboolean parse_range(const char *str, uint64_t *first, uint64_t *last)
+{
+	char *end;
+
+	*first = g_ascii_strtoull(str, &end, 10);
+	if (end == str)
+		return FALSE;
+	*last = *first;
+	if (*end == '-') {
+		str = end + 1;
+		*last = g_ascii_strtoull(str, &end, 10);
+		if (end == str)
+			return FALSE;
+	}
+
+	return !*end && *first <= *last;
+}
+
+/*
+ * Parse vector specs of the form "name=first-last;name=first-last",
+ * where first and last are channel indices, and first is the LSB.
+ */
+static int add_spec_vectors(struct context *ctx, const char *spec,
+		GArray *vectors, int *vector_of)
+{
+	char **specs, **name_range;
+	uint64_t first, last, index;
+	int *positions, count, p, i, ret;
+
+	ret = SR_OK;
+	positions = g_malloc(sizeof(int) * ctx->num_enabled_channels);
+	specs = g_strsplit(spec, ";", 0);
+	for (i = 0; specs[i] && ret == SR_OK; i++) {
+		if (!*g_strstrip(specs[i]))
+			continue;
+		name_range = g_strsplit(specs[i], "=", 2);
+		if (!name_range[0] || !name_range[1] || !*name_range[0]
+				|| !parse_range(name_range[1], &first, &last)) {
+			sr_err("Invalid vector specification '%s'.", specs[i]);
+			ret = SR_ERR_ARG;
+		} else {
+			count = 0;
+			for (index = first; index <= last && index <= G_MAXINT; index++) {
+				if ((p = channel_position(ctx, index)) >= 0)
+					positions[count++] = p;
+			}
+			if (count)
+				add_vector(vectors, vector_of, name_range[0],
+					positions, count);
+		}
+		g_strfreev(name_range);
+	}
+	g_strfreev(specs);
+	g_free(positions);
+
+	return ret;
+}
+
+/*
+ * Set up the list of signals: vectors take the place of their lowest
+ * bit, all other channels are single bit signals.
+ */
+static int init_signals(const struct sr_output *o, gboolean groups,
+		const char *spec)
 {
 	struct context *ctx;
 	struct sr_channel *ch;
+	struct signal *sig;
+	GArray *vectors;
 	GSList *l;
-	int num_enabled_channels, i;
+	int *vector_of, p, v, ret;
+
+	ctx = o->priv;
+	vector_of = g_malloc(sizeof(int) * ctx->num_enabled_channels);
+	for (p = 0; p < ctx->num_enabled_channels; p++)
+		vector_of[p] = -1;
+	vectors = g_array_new(FALSE, FALSE, sizeof(struct signal));
+	if (groups)
+		add_group_vectors(o, vectors, vector_of);
+	ret = SR_OK;
+	if (spec && *spec)
+		ret = add_spec_vectors(ctx, spec, vectors, vector_of);
+
+	ctx->signals = g_malloc0(sizeof(struct signal)
+		* ctx->num_enabled_channels);
+	ctx->bit_signal = g_malloc(sizeof(int) * ctx->num_enabled_channels);
+	ctx->changed = g_malloc(sizeof(int) * ctx->num_enabled_channels);
+	for (p = 0, l = o->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type != SR_CHANNEL_LOGIC || !ch->enabled)
+			continue;
+		if ((v = vector_of[p]) < 0) {
+			sig = &ctx->signals[ctx->num_signals];
+			sig->name = g_strdup(ch->name);
+			sig->width = 1;
+			sig->bits = g_malloc(sizeof(int));
+			sig->bits[0] = p;
+			ctx->bit_signal[p] = ctx->num_signals;
+			gen_identifier(sig->id, ctx->num_signals++);
+		} else if (g_array_index(vectors, struct signal, v).bits) {
+			sig = &ctx->signals[ctx->num_signals];
+			*sig = g_array_index(vectors, struct signal, v);
+			g_array_index(vectors, struct signal, v).bits = NULL;
+			gen_identifier(sig->id, ctx->num_signals++);
+		}
+		p++;
+	}
+	for (p = 0; p < ctx->num_signals; p++) {
+		sig = &ctx->signals[p];
+		for (v = 0; v < sig->width; v++)
+			ctx->bit_signal[sig->bits[v]] = p;
+	}
+	g_array_free(vectors, TRUE);
+	g_free(vector_of);
+
+	return ret;
+}
 
-	(void)options;
+static int cleanup(struct sr_output *o);
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+	struct context *ctx;
+	struct sr_channel *ch;
+	GSList *l;
+	int num_enabled_channels, i, ret;
 
 	num_enabled_channels = 0;
 	for (l = o->sdi->channels; l; l = l->next) {
@@ -55,10 +277,6 @@ static int init(struct sr_output *o, GHashTable *options)
 			continue;
 		num_enabled_channels++;
 	}
-	if (num_enabled_channels > 94) {
-		sr_err("VCD only supports 94 channels.");
-		return SR_ERR;
-	}
 
 	ctx = g_malloc0(sizeof(struct context));
 	o->priv = ctx;
@@ -75,7 +293,13 @@ static int init(struct sr_output *o, GHashTable *options)
 		ctx->channel_index[i++] = ch->index;
 	}
 
-	return SR_OK;
+	ret = init_signals(o,
+		g_variant_get_boolean(g_hash_table_lookup(options, "groups")),
+		g_variant_get_string(g_hash_table_lookup(options, "vectors"), NULL));
+	if (ret != SR_OK)
+		cleanup(o);
+
+	return ret;
 }
 
 /*
@@ -110,26 +334,23 @@ static uint64_t get_timescale_freq(uint64_t samplerate)
 	return timescale;
 }
 
-static GString *gen_header(const struct sr_output *o)
+static void gen_header(const struct sr_output *o, GString *header)
 {
 	struct context *ctx;
-	struct sr_channel *ch;
+	struct signal *sig;
 	GVariant *gvar;
-	GString *header;
-	GSList *l;
 	time_t t;
 	int num_channels, i;
 	char *samplerate_s, *frequency_s, *timestamp;
 
 	ctx = o->priv;
-	header = g_string_sized_new(512);
 	num_channels = g_slist_length(o->sdi->channels);
 
 	/* timestamp */
 	t = time(NULL);
 	timestamp = g_strdup(ctime(&t));
 	timestamp[strlen(timestamp) - 1] = 0;
-	g_string_printf(header, "$date %s $end\n", timestamp);
+	g_string_append_printf(header, "$date %s $end\n", timestamp);
 	g_free(timestamp);
 
 	/* generator */
@@ -161,37 +382,115 @@ static GString *gen_header(const struct sr_output *o)
 	/* scope */
 	g_string_append_printf(header, "$scope module %s $end\n", PACKAGE_NAME);
 
-	/* Wires / channels */
-	for (i = 0, l = o->sdi->channels; l; l = l->next) {
-		ch = l->data;
-		if (ch->type != SR_CHANNEL_LOGIC)
-			continue;
-		if (!ch->enabled)
-			continue;
-		g_string_append_printf(header, "$var wire 1 %c %s $end\n",
-				(char)('!' + i), ch->name);
-		i++;
+	/* Wires / channels, and vectors of them */
+	for (i = 0; i < ctx->num_signals; i++) {
+		sig = &ctx->signals[i];
+		g_string_append_printf(header, "$var wire %d %s %s $end\n",
+				sig->width, sig->id, sig->name);
 	}
 
 	g_string_append(header, "$upscope $end\n$enddefinitions $end\n");
+}
+
+/* Output timestamp of subsequent signal changes. */
+static void write_timestamp(const struct context *ctx, GString *out,
+		gboolean *timestamp_written)
+{
+	if (*timestamp_written)
+		return;
+	g_string_append_c(out, '#');
+	sr_output_append_u64(out, sr_output_sample_time(ctx->samplecount,
+		ctx->samplerate, ctx->period));
+	*timestamp_written = TRUE;
+}
+
+/*
+ * Emit the changes between two samples. Only set bits of the difference
+ * get visited. With 'all' set, the values of all channels are written.
+ */
+static void write_changes(struct context *ctx, GString *out,
+		const uint8_t *prev, const uint8_t *sample, unsigned int unitsize,
+		gboolean all)
+{
+	struct signal *sig;
+	gulong diff, cur;
+	unsigned int offset, len, i;
+	int bit, index, num_changed, b;
+	gboolean timestamp_written;
+
+	timestamp_written = FALSE;
+	num_changed = 0;
+	ctx->change_count++;
+	for (offset = 0; offset < unitsize; offset += sizeof(diff)) {
+		len = MIN(sizeof(diff), unitsize - offset);
+		if (offset * 8 >= (unsigned int)ctx->num_enabled_channels)
+			break;
+		diff = cur = 0;
+		for (i = 0; i < len; i++) {
+			cur |= (gulong)sample[offset + i] << (8 * i);
+			diff |= (gulong)prev[offset + i] << (8 * i);
+		}
+		diff = all ? ~0UL : diff ^ cur;
+
+		/*
+		 * The data image "is dense", it packs bits of enabled
+		 * channels, and leaves no room for positions of disabled
+		 * channels.
+		 */
+		bit = -1;
+		while ((bit = g_bit_nth_lsf(diff, bit)) >= 0) {
+			index = offset * 8 + bit;
+			if (index >= ctx->num_enabled_channels)
+				break;
+			sig = &ctx->signals[ctx->bit_signal[index]];
+			if (sig->width > 1) {
+				/* Vectors get written once, after all bits. */
+				if (sig->dirty != ctx->change_count) {
+					sig->dirty = ctx->change_count;
+					ctx->changed[num_changed++] =
+						ctx->bit_signal[index];
+				}
+				continue;
+			}
 
-	return header;
+			/* Output which signal changed to which value. */
+			write_timestamp(ctx, out, &timestamp_written);
+			g_string_append_c(out, ' ');
+			g_string_append_c(out, '0' + ((cur >> bit) & 1));
+			g_string_append(out, sig->id);
+		}
+	}
+
+	for (i = 0; i < (unsigned int)num_changed; i++) {
+		sig = &ctx->signals[ctx->changed[i]];
+		write_timestamp(ctx, out, &timestamp_written);
+		g_string_append(out, " b");
+		for (b = sig->width - 1; b >= 0; b--) {
+			index = sig->bits[b];
+			g_string_append_c(out,
+				'0' + ((sample[index / 8] >> (index % 8)) & 1));
+		}
+		g_string_append_c(out, ' ');
+		g_string_append(out, sig->id);
+	}
+
+	if (timestamp_written)
+		g_string_append_c(out, '\n');
 }
 
-static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
-		GString **out)
+static int receive_into(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *out)
 {
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
 	const struct sr_config *src;
 	GSList *l;
 	struct context *ctx;
-	unsigned int i;
-	int p, curbit, prevbit, index;
-	uint8_t *sample;
-	gboolean timestamp_written;
+	const uint8_t *data, *prev;
+	uint64_t base;
+	size_t pos, count;
+	unsigned int unitsize;
 
-	*out = NULL;
 	if (!o || !o->priv)
 		return SR_ERR_BUG;
 	ctx = o->priv;
@@ -210,68 +509,48 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		logic = packet->payload;
 
 		if (!ctx->header_done) {
-			*out = gen_header(o);
+			gen_header(o, out);
 			ctx->header_done = TRUE;
-		} else {
-			*out = g_string_sized_new(512);
 		}
 
+		unitsize = logic->unitsize;
+		if (!unitsize)
+			break;
 		if (!ctx->prevsample) {
 			/* Can't allocate this until we know the stream's unitsize. */
-			ctx->prevsample = g_malloc0(logic->unitsize);
+			ctx->prevsample = g_malloc0(unitsize);
 		}
 
-		for (i = 0; i <= logic->length - logic->unitsize; i += logic->unitsize) {
-			sample = logic->data + i;
-			timestamp_written = FALSE;
-
-			for (p = 0; p < ctx->num_enabled_channels; p++) {
-				/*
-				 * TODO Check whether the mapping from
-				 * data image positions to channel numbers
-				 * is required. Experiments suggest that
-				 * the data image "is dense", and packs
-				 * bits of enabled channels, and leaves no
-				 * room for positions of disabled channels.
-				 */
-				/* index = ctx->channel_index[p]; */
-				index = p;
-
-				curbit = ((unsigned)sample[index / 8]
-						>> (index % 8)) & 1;
-				prevbit = ((unsigned)ctx->prevsample[index / 8]
-						>> (index % 8)) & 1;
-
-				/* VCD only contains deltas/changes of signals. */
-				if (prevbit == curbit && ctx->samplecount > 0)
-					continue;
-
-				/* Output timestamp of subsequent signal changes. */
-				if (!timestamp_written)
-					g_string_append_printf(*out, "#%.0f",
-						(double)ctx->samplecount /
-							ctx->samplerate * ctx->period);
-
-				/* Output which signal changed to which value. */
-				g_string_append_c(*out, ' ');
-				g_string_append_c(*out, '0' + curbit);
-				g_string_append_c(*out, '!' + p);
-
-				timestamp_written = TRUE;
-			}
-
-			if (timestamp_written)
-				g_string_append_c(*out, '\n');
-
-			ctx->samplecount++;
-			memcpy(ctx->prevsample, sample, logic->unitsize);
+		data = logic->data;
+		count = logic->length / unitsize;
+		base = ctx->samplecount;
+		prev = ctx->prevsample;
+		pos = 0;
+		if (count && base == 0) {
+			/* The very first sample has all signals' values. */
+			write_changes(ctx, out, prev, data, unitsize, TRUE);
+			prev = data;
+			pos++;
+		}
+		/* VCD only contains deltas/changes of signals. */
+		while ((pos = sr_output_skip_unchanged(data, pos, count,
+				prev, unitsize)) < count) {
+			ctx->samplecount = base + pos;
+			write_changes(ctx, out, prev, data + pos * unitsize,
+				unitsize, FALSE);
+			prev = data + pos * unitsize;
+			pos++;
 		}
+		ctx->samplecount = base + count;
+		if (prev != ctx->prevsample)
+			memcpy(ctx->prevsample, prev, unitsize);
 		break;
 	case SR_DF_END:
 		/* Write final timestamp as length indicator. */
-		*out = g_string_sized_new(512);
-		g_string_printf(*out, "#%.0f\n",
-				(double)ctx->samplecount / ctx->samplerate * ctx->period);
+		g_string_append_c(out, '#');
+		sr_output_append_u64(out, sr_output_sample_time(ctx->samplecount,
+			ctx->samplerate, ctx->period));
+		g_string_append_c(out, '\n');
 		break;
 	}
 
@@ -281,26 +560,51 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 static int cleanup(struct sr_output *o)
 {
 	struct context *ctx;
+	int i;
 
 	if (!o || !o->priv)
 		return SR_ERR_ARG;
 
 	ctx = o->priv;
+	for (i = 0; i < ctx->num_signals; i++) {
+		g_free(ctx->signals[i].name);
+		g_free(ctx->signals[i].bits);
+	}
+	g_free(ctx->signals);
+	g_free(ctx->bit_signal);
+	g_free(ctx->changed);
 	g_free(ctx->prevsample);
 	g_free(ctx->channel_index);
 	g_free(ctx);
+	o->priv = NULL;
 
 	return SR_OK;
 }
 
+static struct sr_option options[] = {
+	{"groups", "Channel group vectors", "Output channel groups as multi-bit vectors", NULL, NULL},
+	{"vectors", "Vectors", "Channels to output as multi-bit vectors, e.g. \"data=0-7;addr=8-15\" (channel indices, LSB first)", NULL, NULL},
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
+		options[1].def = g_variant_ref_sink(g_variant_new_string(""));
+	}
+
+	return options;
+}
+
 struct sr_output_module output_vcd = {
 	.id = "vcd",
 	.name = "VCD",
 	.desc = "Value Change Dump data",
 	.exts = (const char*[]){"vcd", NULL},
 	.flags = 0,
-	.options = NULL,
+	.options = get_options,
 	.init = init,
-	.receive = receive,
+	.receive_into = receive_into,
 	.cleanup = cleanup,
 };
@@ -18,6 +18,7 @@
  */
 
 #include <config.h>
+#include <math.h>
 #include <string.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
@@ -29,14 +30,20 @@
 
 struct out_context {
 	double scale;
+	gboolean pcm16;
 	gboolean header_done;
 	uint64_t samplerate;
 	int num_channels;
 	GSList *channels;
 	int chanbuf_size;
 	int *chanbuf_used;
-	uint8_t **chanbuf;
+	float **chanbuf;
 	float *fdata;
+	/* Position of a packet's channels in the output. */
+	int *chan_idx;
+	/* Channel buffers get interleaved here, reused across flushes. */
+	float *ibuf;
+	int ibuf_size;
 };
 
 static int realloc_chanbufs(const struct sr_output *o, int size)
@@ -50,37 +57,101 @@ static int realloc_chanbufs(const struct sr_output *o, int size)
 			sr_err("Unable to allocate enough output buffer memory.");
 			return SR_ERR;
 		}
-		outc->chanbuf_used[i] = 0;
 	}
 	outc->chanbuf_size = size;
 
 	return SR_OK;
 }
 
+/*
+ * Stores the float in little-endian BINARY32 IEEE-754 2008 format.
+ */
+static void float_to_le(uint8_t *buf, float value)
+{
+	uint8_t *old;
+
+	old = (uint8_t *)&value;
+#ifdef WORDS_BIGENDIAN
+	buf[0] = old[3];
+	buf[1] = old[2];
+	buf[2] = old[1];
+	buf[3] = old[0];
+#else
+	buf[0] = old[0];
+	buf[1] = old[1];
+	buf[2] = old[2];
+	buf[3] = old[3];
+#endif
+}
+
+/*
+ * Append interleaved samples of all channels in the output format.
+ * Values get divided by the scale factor. 16-bit PCM maps the range
+ * -1 to 1 to the full integer range, and clips values outside it.
+ */
+static void append_samples(const struct out_context *outc, GString *out,
+		const float *data, int num_samples)
+{
+	size_t count, i, len;
+	uint8_t *p;
+	float f;
+
+	count = (size_t)num_samples * outc->num_channels;
+	len = out->len;
+	g_string_set_size(out, len + count * (outc->pcm16 ? 2 : 4));
+	p = (uint8_t *)out->str + len;
+
+	if (outc->pcm16) {
+		for (i = 0; i < count; i++) {
+			f = data[i];
+			if (outc->scale != 1.0)
+				f /= outc->scale;
+			f = CLAMP(f, -1.0f, 1.0f);
+			WL16(p + 2 * i, (int16_t)lrintf(f * 32767));
+		}
+	} else if (outc->scale != 1.0) {
+		for (i = 0; i < count; i++) {
+			f = data[i];
+			f /= outc->scale;
+			float_to_le(p + 4 * i, f);
+		}
+	} else {
+#ifdef WORDS_BIGENDIAN
+		for (i = 0; i < count; i++)
+			float_to_le(p + 4 * i, data[i]);
+#else
+		memcpy(p, data, count * sizeof(float));
+#endif
+	}
+}
+
 static int flush_chanbufs(const struct sr_output *o, GString *out)
 {
 	struct out_context *outc;
 	int num_samples, i, j;
-	char *buf, *bufp;
+	float *buf;
 
 	outc = o->priv;
 
 	/* Any one of them will do. */
 	num_samples = outc->chanbuf_used[0];
-	if (!(buf = g_try_malloc(4 * num_samples * outc->num_channels))) {
-		sr_err("Unable to allocate enough interleaved output buffer memory.");
-		return SR_ERR;
+	if (num_samples > outc->ibuf_size) {
+		buf = g_try_realloc(outc->ibuf,
+			sizeof(float) * num_samples * outc->num_channels);
+		if (!buf) {
+			sr_err("Unable to allocate enough interleaved output buffer memory.");
+			return SR_ERR;
+		}
+		outc->ibuf = buf;
+		outc->ibuf_size = num_samples;
 	}
 
-	bufp = buf;
-	for (i = 0; i < num_samples; i++) {
-		for (j = 0; j < outc->num_channels; j++) {
-			memcpy(bufp, outc->chanbuf[j] + i * 4, 4);
-			bufp += 4;
-		}
+	for (j = 0; j < outc->num_channels; j++) {
+		buf = outc->ibuf + j;
+		for (i = 0; i < num_samples; i++, buf += outc->num_channels)
+			*buf = outc->chanbuf[j][i];
 	}
-	g_string_append_len(out, buf, 4 * num_samples * outc->num_channels);
-	g_free(buf);
+	append_samples(outc, out, outc->ibuf, num_samples);
 
 	for (i = 0; i < outc->num_channels; i++)
 		outc->chanbuf_used[i] = 0;
@@ -92,11 +163,19 @@ static int init(struct sr_output *o, GHashTable *options)
 {
 	struct out_context *outc;
 	struct sr_channel *ch;
+	const char *format;
 	GSList *l;
 
+	format = g_variant_get_string(g_hash_table_lookup(options, "format"), NULL);
+	if (strcmp(format, "float") && strcmp(format, "pcm16")) {
+		sr_err("Unsupported sample format '%s'.", format);
+		return SR_ERR_ARG;
+	}
+
 	outc = g_malloc0(sizeof(struct out_context));
 	o->priv = outc;
 	outc->scale = g_variant_get_double(g_hash_table_lookup(options, "scale"));
+	outc->pcm16 = !strcmp(format, "pcm16");
 
 	for (l = o->sdi->channels; l; l = l->next) {
 		ch = l->data;
@@ -110,6 +189,7 @@ static int init(struct sr_output *o, GHashTable *options)
 
 	outc->chanbuf = g_malloc0(sizeof(float *) * outc->num_channels);
 	outc->chanbuf_used = g_malloc0(sizeof(int) * outc->num_channels);
+	outc->chan_idx = g_malloc0(sizeof(int) * outc->num_channels);
 
 	/* Start off the interleaved buffer with 100 samples/channel. */
 	realloc_chanbufs(o, 100);
@@ -121,14 +201,16 @@ static void add_data_chunk(const struct sr_output *o, GString *gs)
 {
 	struct out_context *outc;
 	char tmp[4];
+	int sample_size;
 
 	outc = o->priv;
+	sample_size = outc->pcm16 ? 2 : 4;
 	g_string_append(gs, "fmt ");
 	/* Remaining chunk size */
 	WL32(tmp, 0x12);
 	g_string_append_len(gs, tmp, 4);
-	/* Format code 3 = IEEE float */
-	WL16(tmp, 0x0003);
+	/* Format code 1 = PCM, 3 = IEEE float */
+	WL16(tmp, outc->pcm16 ? 0x0001 : 0x0003);
 	g_string_append_len(gs, tmp, 2);
 	/* Number of channels */
 	WL16(tmp, outc->num_channels);
@@ -136,14 +218,14 @@ static void add_data_chunk(const struct sr_output *o, GString *gs)
 	/* Samplerate */
 	WL32(tmp, outc->samplerate);
 	g_string_append_len(gs, tmp, 4);
-	/* Byterate, using 32-bit floats. */
-	WL32(tmp, outc->samplerate * outc->num_channels * 4);
+	/* Byterate */
+	WL32(tmp, outc->samplerate * outc->num_channels * sample_size);
 	g_string_append_len(gs, tmp, 4);
 	/* Blockalign */
-	WL16(tmp, outc->num_channels * 4);
+	WL16(tmp, outc->num_channels * sample_size);
 	g_string_append_len(gs, tmp, 2);
 	/* Bits per sample */
-	WL16(tmp, 32);
+	WL16(tmp, sample_size * 8);
 	g_string_append_len(gs, tmp, 2);
 	WL16(tmp, 0);
 	g_string_append_len(gs, tmp, 2);
@@ -154,11 +236,10 @@ static void add_data_chunk(const struct sr_output *o, GString *gs)
 	g_string_append_len(gs, tmp, 4);
 }
 
-static GString *gen_header(const struct sr_output *o)
+static void gen_header(const struct sr_output *o, GString *header)
 {
 	struct out_context *outc;
 	GVariant *gvar;
-	GString *header;
 	char tmp[4];
 
 	outc = o->priv;
@@ -170,36 +251,12 @@ static GString *gen_header(const struct sr_output *o)
 		}
 	}
 
-	header = g_string_sized_new(512);
 	g_string_append(header, "RIFF");
 	/* Total size. Max out the field. */
 	WL32(tmp, 0xffffffff);
 	g_string_append_len(header, tmp, 4);
 	g_string_append(header, "WAVE");
 	add_data_chunk(o, header);
-
-	return header;
-}
-
-/*
- * Stores the float in little-endian BINARY32 IEEE-754 2008 format.
- */
-static void float_to_le(uint8_t *buf, float value)
-{
-	uint8_t *old;
-
-	old = (uint8_t *)&value;
-#ifdef WORDS_BIGENDIAN
-	buf[0] = old[3];
-	buf[1] = old[2];
-	buf[2] = old[1];
-	buf[3] = old[0];
-#else
-	buf[0] = old[0];
-	buf[1] = old[1];
-	buf[2] = old[2];
-	buf[3] = old[3];
-#endif
 }
 
 /*
@@ -233,8 +290,27 @@ static int check_chanbuf_size(const struct sr_output *o)
 	return size;
 }
 
-static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
-		GString **out)
+/*
+ * Whether a packet can be written without going through the channel
+ * buffers: it has all channels in output order, and nothing is buffered.
+ */
+static gboolean is_complete_packet(const struct out_context *outc,
+		int num_channels)
+{
+	int i;
+
+	if (num_channels != outc->num_channels)
+		return FALSE;
+	for (i = 0; i < num_channels; i++) {
+		if (outc->chan_idx[i] != i || outc->chanbuf_used[i])
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static int receive_into(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *out)
 {
 	struct out_context *outc;
 	const struct sr_datafeed_meta *meta;
@@ -243,12 +319,9 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 	struct sr_channel *ch;
 	GSList *l;
 	const GSList *channels;
-	float f;
-	int num_channels, num_samples, size, *chan_idx, idx, i, j, ret;
-	float *data;
-	uint8_t *buf;
+	int num_channels, num_samples, size, idx, i, j, ret;
+	float *data, *buf;
 
-	*out = NULL;
 	if (!o || !o->sdi || !(outc = o->priv))
 		return SR_ERR_ARG;
 
@@ -264,10 +337,8 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		break;
 	case SR_DF_ANALOG:
 		if (!outc->header_done) {
-			*out = gen_header(o);
+			gen_header(o, out);
 			outc->header_done = TRUE;
-		} else {
-			*out = g_string_sized_new(512);
 		}
 
 		analog = packet->payload;
@@ -290,40 +361,46 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 			return SR_ERR;
 		}
 
-		if (num_samples > outc->chanbuf_size) {
-			if (realloc_chanbufs(o, analog->num_samples) != SR_OK)
-				return SR_ERR_MALLOC;
+		/* Index the channels in this packet, so we can interleave quicker. */
+		size = 0;
+		for (i = 0, l = (GSList *)channels; i < num_channels; i++, l = l->next) {
+			ch = l->data;
+			if ((idx = g_slist_index(outc->channels, ch)) < 0) {
+				sr_err("Packet has data for a disabled channel.");
+				return SR_ERR;
+			}
+			outc->chan_idx[i] = idx;
+			size = MAX(size, outc->chanbuf_used[idx]);
 		}
 
-		/* Index the channels in this packet, so we can interleave quicker. */
-		chan_idx = g_malloc(sizeof(int) * outc->num_channels);
-		for (i = 0; i < num_channels; i++) {
-			ch = g_slist_nth_data((GSList *) channels, i);
-			chan_idx[i] = g_slist_index(outc->channels, ch);
+		/* Packets with all channels are already interleaved. */
+		if (is_complete_packet(outc, num_channels)) {
+			append_samples(outc, out, data, num_samples);
+			break;
 		}
 
-		for (i = 0; i < num_samples; i++) {
-			for (j = 0; j < num_channels; j++) {
-				idx = chan_idx[j];
-				buf = outc->chanbuf[idx] + outc->chanbuf_used[idx]++ * 4;
-				f = data[i * num_channels + j];
-				if (outc->scale != 1.0)
-					f /= outc->scale;
-				float_to_le(buf, f);
-			}
+		if (size + num_samples > outc->chanbuf_size) {
+			if (realloc_chanbufs(o, size + num_samples) != SR_OK)
+				return SR_ERR_MALLOC;
+		}
+
+		for (j = 0; j < num_channels; j++) {
+			idx = outc->chan_idx[j];
+			buf = outc->chanbuf[idx] + outc->chanbuf_used[idx];
+			for (i = 0; i < num_samples; i++)
+				buf[i] = data[i * num_channels + j];
+			outc->chanbuf_used[idx] += num_samples;
 		}
-		g_free(chan_idx);
 
 		size = check_chanbuf_size(o);
 		if (size > MIN_DATA_CHUNK_SAMPLES)
-			if (flush_chanbufs(o, *out) != SR_OK)
+			if (flush_chanbufs(o, out) != SR_OK)
 				return SR_ERR;
 		break;
 	case SR_DF_END:
 		size = check_chanbuf_size(o);
 		if (size > 0) {
-			*out = g_string_sized_new(4 * size * outc->num_channels);
-			if (flush_chanbufs(o, *out) != SR_OK)
+			if (flush_chanbufs(o, out) != SR_OK)
 				return SR_ERR;
 		}
 		break;
@@ -334,13 +411,21 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 
 static struct sr_option options[] = {
 	{ "scale", "Scale", "Scale values by factor", NULL, NULL },
+	{ "format", "Sample format", "32-bit float, or 16-bit PCM (values from -1 to 1)", NULL, NULL },
 	ALL_ZERO
 };
 
 static const struct sr_option *get_options(void)
 {
-	if (!options[0].def)
+	GSList *l = NULL;
+
+	if (!options[0].def) {
 		options[0].def = g_variant_ref_sink(g_variant_new_double(1.0));
+		options[1].def = g_variant_ref_sink(g_variant_new_string("float"));
+		l = g_slist_append(l, g_variant_ref_sink(g_variant_new_string("float")));
+		l = g_slist_append(l, g_variant_ref_sink(g_variant_new_string("pcm16")));
+		options[1].values = l;
+	}
 
 	return options;
 }
@@ -352,11 +437,12 @@ static int cleanup(struct sr_output *o)
 
 	outc = o->priv;
 	g_slist_free(outc->channels);
-	g_variant_unref(options[0].def);
 	for (i = 0; i < outc->num_channels; i++)
 		g_free(outc->chanbuf[i]);
 	g_free(outc->chanbuf_used);
 	g_free(outc->chanbuf);
+	g_free(outc->chan_idx);
+	g_free(outc->ibuf);
 	g_free(outc->fdata);
 	g_free(outc);
 	o->priv = NULL;
@@ -372,6 +458,6 @@ SR_PRIV struct sr_output_module output_wav = {
 	.flags = 0,
 	.options = get_options,
 	.init = init,
-	.receive = receive,
+	.receive_into = receive_into,
 	.cleanup = cleanup,
 };
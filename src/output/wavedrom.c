@@ -24,107 +24,204 @@
 
 #define LOG_PREFIX "output/wavedrom"
 
+/* Samples which get gathered at once, per channel. */
+#define BLOCK_SAMPLES 4096
+
+/*
+ * The rendered output has one character per sample and channel. Runs
+ * get expanded in pieces of this size, and output files are written
+ * while rendering, see sr_output_flush_into().
+ */
+#define RENDER_CHUNK (64 * 1024)
+
+/*
+ * Logic levels alternate, so a channel's wave is fully described by
+ * its first level and the lengths of the runs of equal levels. The
+ * completed runs are kept as variable length integers (7 bits per
+ * byte, least significant first), most runs take a single byte.
+ */
+struct channel_wave {
+	int first_level;
+	int level;
+	uint64_t run;
+	GByteArray *runs;
+};
+
 struct context {
 	uint32_t channel_count;
 	struct sr_channel **channels;
-	GString **channel_outputs; /* output strings */
+	struct channel_wave *waves; /* run-length state, NULL if disabled */
+	uint64_t max_samples;
+	uint64_t decimate;
+	uint64_t num_samples;
+	gboolean truncated;
+	/* Input samples to skip before the next decimated sample. */
+	uint64_t skip;
+	uint8_t bits[BLOCK_SAMPLES / 8 + 1];
 };
 
+static void push_run(struct channel_wave *wave)
+{
+	uint8_t buf[10];
+	size_t len;
+	uint64_t run;
+
+	run = wave->run;
+	len = 0;
+	while (run >= 0x80) {
+		buf[len++] = (run & 0x7f) | 0x80;
+		run >>= 7;
+	}
+	buf[len++] = run;
+	g_byte_array_append(wave->runs, buf, len);
+}
+
+static uint64_t pop_run(const uint8_t **p)
+{
+	uint64_t run;
+	unsigned int shift;
+
+	run = 0;
+	shift = 0;
+	do {
+		run |= (uint64_t)(**p & 0x7f) << shift;
+		shift += 7;
+	} while (*(*p)++ & 0x80);
+
+	return run;
+}
+
+/* Appends a level and the run's repetitions in WaveDrom syntax. */
+static void append_run(const struct sr_output *o, GString *output,
+		int level, uint64_t run)
+{
+	gsize len, count;
+
+	g_string_append_c(output, level ? '1' : '0');
+	for (run--; run; run -= count) {
+		count = MIN(run, RENDER_CHUNK);
+		len = output->len;
+		g_string_set_size(output, len + count);
+		memset(output->str + len, '.', count);
+		sr_output_flush_into(o, output);
+	}
+}
+
 /* Converts accumulated output data to a JSON string. */
-static GString *wavedrom_render(const struct context *ctx)
+static void wavedrom_render(const struct sr_output *o,
+		const struct context *ctx, GString *output)
 {
-	GString *output;
-	size_t ch, i;
-	char last_char, curr_char;
+	const struct channel_wave *wave;
+	const uint8_t *p, *end;
+	size_t ch;
+	int level;
+	gboolean first;
 
-	output = g_string_new("{ \"signal\": [");
+	g_string_append(output, "{ \"signal\": [");
+	first = TRUE;
 	for (ch = 0; ch < ctx->channel_count; ch++) {
-		if (!ctx->channel_outputs[ch])
+		if (!ctx->channels[ch])
 			continue;
+		wave = &ctx->waves[ch];
 
 		/* Channel strip. */
 		g_string_append_printf(output,
-			"{ \"name\": \"%s\", \"wave\": \"", ctx->channels[ch]->name);
-
-		last_char = 0;
-		for (i = 0; i < ctx->channel_outputs[ch]->len; i++) {
-			curr_char = ctx->channel_outputs[ch]->str[i];
-			/* Data point. */
-			if (curr_char == last_char) {
-				g_string_append_c(output, '.');
-			} else {
-				g_string_append_c(output, curr_char);
-				last_char = curr_char;
-			}
-		}
-		if (ch < ctx->channel_count - 1) {
-			g_string_append(output, "\" },");
-		} else {
-			/* Last channel, no comma. */
-			g_string_append(output, "\" }");
+			"%s{ \"name\": \"%s\", \"wave\": \"",
+			first ? "" : ",", ctx->channels[ch]->name);
+		first = FALSE;
+
+		level = wave->first_level;
+		p = wave->runs->data;
+		end = p + wave->runs->len;
+		while (p < end) {
+			append_run(o, output, level, pop_run(&p));
+			level = !level;
 		}
+		if (wave->run)
+			append_run(o, output, level, wave->run);
+		g_string_append(output, "\" }");
 	}
 	g_string_append(output, "], \"config\": { \"skin\": \"narrow\" }}");
+}
+
+/* Adds gathered bits (MSB first) to a channel's runs. */
+static void add_bits(struct channel_wave *wave, const uint8_t *bits,
+		size_t count)
+{
+	size_t i;
+	int bit;
 
-	return output;
+	if (count && wave->level < 0)
+		wave->first_level = wave->level = bits[0] >> 7;
+
+	for (i = 0; i < count; ) {
+		/* Whole bytes which continue the current run. */
+		if (!(i & 7) && count - i >= 8
+				&& bits[i / 8] == (wave->level ? 0xff : 0x00)) {
+			wave->run += 8;
+			i += 8;
+			continue;
+		}
+		bit = (bits[i / 8] >> (7 - (i & 7))) & 1;
+		if (bit != wave->level) {
+			push_run(wave);
+			wave->level = bit;
+			wave->run = 0;
+		}
+		wave->run++;
+		i++;
+	}
 }
 
-static void process_logic(const struct context *ctx,
+static void process_logic(struct context *ctx,
 	const struct sr_datafeed_logic *logic)
 {
-	size_t sample_count, ch, i;
-	uint8_t *sample, bit;
-	GString *accu;
+	size_t sample_count, ch, pos, count;
+	uint8_t *data;
 
 	if (!ctx->channel_count)
 		return;
 
 	/*
-	 * Extract the logic bits for each channel and store them
-	 * as wavedrom letters (1/0) in each channel's text string.
-	 * This transforms the input which consists of sample sets
-	 * that span multiple channels into output stripes per logic
-	 * channel which consist of bits for that individual channel.
-	 *
-	 * TODO Reduce memory consumption during accumulation of
-	 * output data.
-	 *
-	 * Ideally we'd accumulate binary chunks, and defer conversion
-	 * to the text format. Analog data already won't get here, only
-	 * logic data does. When the per-channel transformation also
-	 * gets deferred until later, then the only overhead would be
-	 * for disabled logic channels. Which may be acceptable or even
-	 * negligable.
-	 *
-	 * An optional addition to the above mentioned accumulation of
-	 * binary data is RLE compression. Mark both the position in the
-	 * accumulated data as well as a repetition counter, instead of
-	 * repeatedly storing the same sample set. The efficiency of
-	 * this approach of course depends on the change rate of input
-	 * data. But the approach perfectly matches the WaveDrom syntax
-	 * for repeated bit patterns, and thus is easily handled in the
-	 * text rendering stage of the output module.
+	 * Extract the logic bits for each channel, and only keep the
+	 * lengths of the runs of equal levels. Memory use depends on
+	 * the number of level changes, not on the number of samples.
+	 * The runs perfectly match the WaveDrom syntax for repeated
+	 * bit patterns, and are expanded when the output is rendered.
 	 */
 	sample_count = logic->length / logic->unitsize;
-	for (i = 0; i < sample_count; i++) {
-		sample = logic->data + i * logic->unitsize;
+	pos = ctx->skip;
+	while (pos < sample_count) {
+		if (ctx->max_samples && ctx->num_samples >= ctx->max_samples) {
+			if (!ctx->truncated)
+				sr_warn("Only rendering the first %" PRIu64
+					" samples.", ctx->max_samples);
+			ctx->truncated = TRUE;
+			return;
+		}
+		count = (sample_count - pos + ctx->decimate - 1) / ctx->decimate;
+		count = MIN(count, BLOCK_SAMPLES);
+		if (ctx->max_samples)
+			count = MIN(count, ctx->max_samples - ctx->num_samples);
+		data = (uint8_t *)logic->data + pos * logic->unitsize;
 		for (ch = 0; ch < ctx->channel_count; ch++) {
-			accu = ctx->channel_outputs[ch];
-			if (!accu)
+			if (!ctx->channels[ch])
 				continue;
-			bit = sample[ch / 8] & (1 << (ch % 8));
-			g_string_append_c(accu, bit ? '1' : '0');
+			sr_output_gather_bits(data, logic->unitsize * ctx->decimate,
+				count, ch, 0, ctx->bits);
+			add_bits(&ctx->waves[ch], ctx->bits, count);
 		}
+		ctx->num_samples += count;
+		pos += count * ctx->decimate;
 	}
+	ctx->skip = pos - sample_count;
 }
 
-static int receive(const struct sr_output *o,
-	const struct sr_datafeed_packet *packet, GString **out)
+static int receive_into(const struct sr_output *o,
+	const struct sr_datafeed_packet *packet, GString *out)
 {
 	struct context *ctx;
 
-	*out = NULL;
-
 	if (!o || !o->sdi || !o->priv)
 		return SR_ERR_ARG;
 
@@ -135,7 +232,7 @@ static int receive(const struct sr_output *o,
 		process_logic(ctx, packet->payload);
 		break;
 	case SR_DF_END:
-		*out = wavedrom_render(ctx);
+		wavedrom_render(o, ctx, out);
 		break;
 	}
 
@@ -149,24 +246,30 @@ static int init(struct sr_output *o, GHashTable *options)
 	GSList *l;
 	size_t i;
 
-	(void)options;
-
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 
 	o->priv = ctx = g_malloc0(sizeof(*ctx));
 
+	ctx->max_samples = g_variant_get_uint64(
+		g_hash_table_lookup(options, "max_samples"));
+	ctx->decimate = g_variant_get_uint64(
+		g_hash_table_lookup(options, "decimate"));
+	if (!ctx->decimate)
+		ctx->decimate = 1;
+
 	ctx->channel_count = g_slist_length(o->sdi->channels);
 	ctx->channels = g_malloc0(
 		sizeof(ctx->channels[0]) * ctx->channel_count);
-	ctx->channel_outputs = g_malloc0(
-		sizeof(ctx->channel_outputs[0]) * ctx->channel_count);
+	ctx->waves = g_malloc0(
+		sizeof(ctx->waves[0]) * ctx->channel_count);
 
 	for (i = 0, l = o->sdi->channels; l; l = l->next, i++) {
 		channel = l->data;
 		if (channel->enabled && channel->type == SR_CHANNEL_LOGIC) {
 			ctx->channels[i] = channel;
-			ctx->channel_outputs[i] = g_string_new(NULL);
+			ctx->waves[i].level = -1;
+			ctx->waves[i].runs = g_byte_array_new();
 		}
 	}
 
@@ -176,7 +279,7 @@ static int init(struct sr_output *o, GHashTable *options)
 static int cleanup(struct sr_output *o)
 {
 	struct context *ctx;
-	GString *s;
+	uint32_t i;
 
 	if (!o)
 		return SR_ERR_ARG;
@@ -185,12 +288,11 @@ static int cleanup(struct sr_output *o)
 	o->priv = NULL;
 
 	if (ctx) {
-		while (--ctx->channel_count) {
-			s = ctx->channel_outputs[ctx->channel_count];
-			if (s)
-				g_string_free(s, TRUE);
+		for (i = 0; i < ctx->channel_count; i++) {
+			if (ctx->waves[i].runs)
+				g_byte_array_free(ctx->waves[i].runs, TRUE);
 		}
-		g_free(ctx->channel_outputs);
+		g_free(ctx->waves);
 		g_free(ctx->channels);
 		g_free(ctx);
 	}
@@ -198,14 +300,31 @@ static int cleanup(struct sr_output *o)
 	return SR_OK;
 }
 
+static struct sr_option options[] = {
+	{ "max_samples", "Maximum samples", "Only render the first samples (0 for all)", NULL, NULL },
+	{ "decimate", "Decimation", "Only render every Nth sample", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(
+			g_variant_new_uint64(0));
+		options[1].def = g_variant_ref_sink(g_variant_new_uint64(1));
+	}
+
+	return options;
+}
+
 SR_PRIV struct sr_output_module output_wavedrom = {
 	.id = "wavedrom",
 	.name = "WaveDrom",
 	.desc = "WaveDrom.com file format",
 	.exts = (const char *[]){"wavedrom", "json", NULL},
 	.flags = 0,
-	.options = NULL,
+	.options = get_options,
 	.init = init,
-	.receive = receive,
+	.receive_into = receive_into,
 	.cleanup = cleanup,
 };
@@ -1189,6 +1189,64 @@ SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
 	return SR_OK;
 }
 
+/**
+ * Send a packet which references read-only data, like a mapped file.
+ *
+ * Transform modules modify packet data in place. When the session has
+ * transforms, the packet's data is copied first. Otherwise the packet
+ * is sent as it is.
+ *
+ * @param sdi The device instance which sends the packet.
+ * @param packet The datafeed packet to send to the session bus.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_send_readonly(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	struct sr_datafeed_packet copy;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_analog analog;
+	size_t size;
+	int ret;
+
+	if (!sdi || !sdi->session || !sdi->session->transforms || !packet)
+		return sr_session_send(sdi, packet);
+
+	copy.type = packet->type;
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		logic = *(const struct sr_datafeed_logic *)packet->payload;
+		size = logic.length;
+		logic.data = g_malloc(size);
+		memcpy(logic.data, ((const struct sr_datafeed_logic *)
+			packet->payload)->data, size);
+		copy.payload = &logic;
+		ret = sr_session_send(sdi, &copy);
+		g_free(logic.data);
+		break;
+	case SR_DF_ANALOG:
+		analog = *(const struct sr_datafeed_analog *)packet->payload;
+		size = analog.num_samples * analog.encoding->unitsize
+			* g_slist_length(analog.meaning->channels);
+		analog.data = g_malloc(size);
+		memcpy(analog.data, ((const struct sr_datafeed_analog *)
+			packet->payload)->data, size);
+		copy.payload = &analog;
+		ret = sr_session_send(sdi, &copy);
+		g_free(analog.data);
+		break;
+	default:
+		ret = sr_session_send(sdi, packet);
+		break;
+	}
+
+	return ret;
+}
+
 /**
  * Add an event source for a file descriptor.
  *
@@ -21,6 +21,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/time.h>
 #include <zip.h>
@@ -34,22 +35,70 @@
 #define CHUNKSIZE (4 * 1024 * 1024)
 /** @endcond */
 
+/*
+ * Number of payload buffers between the reader thread (which inflates
+ * archive entries) and the main loop (which sends them as packets).
+ */
+#define RING_SIZE 4
+
+/* How long the main loop waits for the reader thread per dispatch. */
+#define RING_WAIT_US 10000
+
 SR_PRIV struct sr_dev_driver session_driver_info;
 
+/* An archive entry to replay, in playback order. */
+struct replay_entry {
+	char *name;
+	/* 0 for logic data, else the 1-based index of the analog channel. */
+	int analog_index;
+	/* Location of stored (uncompressed) entries in the mapped file. */
+	gboolean mapped;
+	uint64_t offset;
+	uint64_t size;
+	/* Seek index: the entry's samples within its channel's data. */
+	uint64_t first_sample;
+	uint64_t num_samples;
+	/* Part of the (uncompressed) entry which gets replayed. */
+	uint64_t skip;
+	uint64_t length;
+};
+
+struct replay_block {
+	/* Reusable buffer of CHUNKSIZE bytes. */
+	uint8_t *buf;
+	/* Either buf, or a range of the mapped session file. */
+	const uint8_t *data;
+	size_t length;
+	int analog_index;
+};
+
 struct session_vdev {
 	char *sessionfile;
 	char *capturefile;
 	struct zip *archive;
-	struct zip_file *capfile;
-	int bytes_read;
+	GMappedFile *mapped_file;
+	/* Transforms modify packets in place, the mapping is read-only. */
+	gboolean copy_mapped;
+	GArray *entries;
+	uint64_t bytes_read;
 	uint64_t samplerate;
-	int unitsize;
+	unsigned int unitsize;
 	int num_logic_channels;
 	int num_analog_channels;
-	int cur_analog_channel;
 	GArray *analog_channels;
-	int cur_chunk;
 	gboolean finished;
+	gboolean have_range;
+	uint64_t range_start;
+	uint64_t range_end;
+
+	GThread *reader;
+	GMutex ring_mutex;
+	GCond ring_cond;
+	struct replay_block ring[RING_SIZE];
+	unsigned int ring_tail;
+	unsigned int ring_count;
+	gboolean reader_done;
+	gboolean reader_stop;
 };
 
 static const uint32_t devopts[] = {
@@ -59,145 +108,498 @@ static const uint32_t devopts[] = {
 	SR_CONF_NUM_ANALOG_CHANNELS | SR_CONF_SET,
 	SR_CONF_SAMPLERATE | SR_CONF_GET | SR_CONF_SET,
 	SR_CONF_SESSIONFILE | SR_CONF_SET,
+	SR_CONF_CAPTURE_RANGE | SR_CONF_GET | SR_CONF_SET,
 };
 
-static gboolean stream_session_data(struct sr_dev_inst *sdi)
-{
-	struct session_vdev *vdev;
-	struct sr_datafeed_packet packet;
-	struct sr_datafeed_logic logic;
-	struct sr_datafeed_analog analog;
-	struct sr_analog_encoding encoding;
-	struct sr_analog_meaning meaning;
-	struct sr_analog_spec spec;
-	struct zip_stat zs;
-	int ret, got_data;
-	char capturefile[128];
-	void *buf;
-
-	got_data = FALSE;
-	vdev = sdi->priv;
+/* Zip archive record signatures and sizes. */
+#define ZIP_SIG_LOCAL		0x04034b50
+#define ZIP_SIG_CENTRAL		0x02014b50
+#define ZIP_SIG_EOCD		0x06054b50
+#define ZIP_SIG_EOCD64_LOC	0x07064b50
+#define ZIP_SIG_EOCD64		0x06064b50
+#define ZIP_LOCAL_SIZE		30
+#define ZIP_CENTRAL_SIZE	46
+#define ZIP_EOCD_SIZE		22
+#define ZIP_EOCD64_LOC_SIZE	20
+#define ZIP_EOCD64_SIZE		56
+
+/* Location of a stored (uncompressed) entry's data in the mapped file. */
+struct stored_entry {
+	uint64_t offset;
+	uint64_t size;
+};
 
-	if (!vdev->capfile) {
-		/* No capture file opened yet, or finished with the last
-		 * chunked one. */
-		if (vdev->capturefile && (vdev->cur_chunk == 0)) {
-			/* capturefile is always the unchunked base name. */
-			if (zip_stat(vdev->archive, vdev->capturefile, 0, &zs) != -1) {
-				/* No chunks, just a single capture file. */
-				vdev->cur_chunk = 0;
-				if (!(vdev->capfile = zip_fopen(vdev->archive,
-						vdev->capturefile, 0)))
-					return FALSE;
-				sr_dbg("Opened %s.", vdev->capturefile);
-			} else {
-				/* Try as first chunk filename. */
-				snprintf(capturefile, sizeof(capturefile) - 1, "%s-1", vdev->capturefile);
-				if (zip_stat(vdev->archive, capturefile, 0, &zs) != -1) {
-					vdev->cur_chunk = 1;
-					if (!(vdev->capfile = zip_fopen(vdev->archive,
-							capturefile, 0)))
-						return FALSE;
-					sr_dbg("Opened %s.", capturefile);
-				} else {
-					sr_err("No capture file '%s' in " "session file '%s'.",
-							vdev->capturefile, vdev->sessionfile);
-					return FALSE;
+/*
+ * Collect the entries which are stored without compression (or
+ * encryption), and the location of their data in the mapped archive.
+ * Walks the archive's central directory once, with support for ZIP64
+ * extensions. Returns a table of entry names to struct stored_entry,
+ * or NULL when the archive's directory cannot be parsed.
+ */
+static GHashTable *index_stored_entries(const uint8_t *map, uint64_t map_size)
+{
+	GHashTable *table;
+	struct stored_entry *stored;
+	const uint8_t *p, *eocd, *extra, *end, *local;
+	char *name;
+	uint64_t num_entries, cd_offset, cd_size, i;
+	uint64_t comp_size, uncomp_size, local_offset;
+	unsigned int name_len, extra_len, comment_len, id, len;
+	size_t search;
+
+	if (map_size < ZIP_EOCD_SIZE)
+		return NULL;
+
+	/* The end of central directory record is followed by a comment. */
+	eocd = NULL;
+	search = MIN(map_size - ZIP_EOCD_SIZE, 0xffff);
+	for (p = map + map_size - ZIP_EOCD_SIZE; p >= map + map_size
+			- ZIP_EOCD_SIZE - search; p--) {
+		if (RL32(p) == ZIP_SIG_EOCD) {
+			eocd = p;
+			break;
+		}
+	}
+	if (!eocd)
+		return NULL;
+
+	num_entries = RL16(eocd + 10);
+	cd_size = RL32(eocd + 12);
+	cd_offset = RL32(eocd + 16);
+	p = eocd - ZIP_EOCD64_LOC_SIZE;
+	if (eocd - map >= ZIP_EOCD64_LOC_SIZE && RL32(p) == ZIP_SIG_EOCD64_LOC) {
+		if (map_size < ZIP_EOCD64_SIZE
+				|| RL64(p + 8) > map_size - ZIP_EOCD64_SIZE)
+			return NULL;
+		p = map + RL64(p + 8);
+		if (RL32(p) != ZIP_SIG_EOCD64)
+			return NULL;
+		num_entries = RL64(p + 32);
+		cd_size = RL64(p + 40);
+		cd_offset = RL64(p + 48);
+	}
+	if (cd_offset > map_size || cd_size > map_size - cd_offset)
+		return NULL;
+
+	table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	p = map + cd_offset;
+	end = p + cd_size;
+	for (i = 0; i < num_entries; i++) {
+		if (end - p < ZIP_CENTRAL_SIZE || RL32(p) != ZIP_SIG_CENTRAL)
+			break;
+		name_len = RL16(p + 28);
+		extra_len = RL16(p + 30);
+		comment_len = RL16(p + 32);
+		if ((uint64_t)(end - p) < ZIP_CENTRAL_SIZE + name_len
+				+ extra_len + comment_len)
+			break;
+
+		/* Only stored, unencrypted entries can be used as they are. */
+		if (RL16(p + 10) != 0 || (RL16(p + 8) & 0x0001)) {
+			p += ZIP_CENTRAL_SIZE + name_len + extra_len + comment_len;
+			continue;
+		}
+		comp_size = RL32(p + 20);
+		uncomp_size = RL32(p + 24);
+		local_offset = RL32(p + 42);
+
+		/* ZIP64 extended information, for the fields which overflowed. */
+		extra = p + ZIP_CENTRAL_SIZE + name_len;
+		while (extra + 4 <= p + ZIP_CENTRAL_SIZE + name_len + extra_len) {
+			id = RL16(extra);
+			len = RL16(extra + 2);
+			extra += 4;
+			if (id == 0x0001) {
+				if (uncomp_size == 0xffffffff && len >= 8) {
+					uncomp_size = RL64(extra);
+					extra += 8;
+					len -= 8;
+				}
+				if (comp_size == 0xffffffff && len >= 8) {
+					comp_size = RL64(extra);
+					extra += 8;
+					len -= 8;
 				}
+				if (local_offset == 0xffffffff && len >= 8)
+					local_offset = RL64(extra);
+				break;
 			}
-		} else {
-			/* Capture data is chunked, advance to the next chunk. */
-			vdev->cur_chunk++;
-			snprintf(capturefile, sizeof(capturefile) - 1, "%s-%d", vdev->capturefile,
-					vdev->cur_chunk);
-			if (zip_stat(vdev->archive, capturefile, 0, &zs) != -1) {
-				if (!(vdev->capfile = zip_fopen(vdev->archive,
-						capturefile, 0)))
-					return FALSE;
-				sr_dbg("Opened %s.", capturefile);
-			} else if (vdev->cur_analog_channel < vdev->num_analog_channels) {
-				vdev->capturefile = g_strdup_printf("analog-1-%d",
-						vdev->num_logic_channels + vdev->cur_analog_channel + 1);
-				vdev->cur_analog_channel++;
-				vdev->cur_chunk = 0;
-				return TRUE;
+			extra += len;
+		}
+
+		if (comp_size == uncomp_size
+				&& local_offset <= map_size - ZIP_LOCAL_SIZE
+				&& RL32(map + local_offset) == ZIP_SIG_LOCAL) {
+			local = map + local_offset;
+			local_offset += ZIP_LOCAL_SIZE + RL16(local + 26)
+				+ RL16(local + 28);
+			name = g_strndup((const char *)p + ZIP_CENTRAL_SIZE,
+				name_len);
+			if (local_offset <= map_size
+					&& comp_size <= map_size - local_offset
+					&& !g_hash_table_contains(table, name)) {
+				stored = g_malloc(sizeof(*stored));
+				stored->offset = local_offset;
+				stored->size = comp_size;
+				g_hash_table_insert(table, name, stored);
 			} else {
-				/* We got all the chunks, finish up. */
-				g_free(vdev->capturefile);
-
-				/* If the file has logic channels, the initial value for
-				 * capturefile is set by stream_session_data() - however only
-				 * once. In order to not mess this mechanism up, we simulate
-				 * this here if needed. For purely analog files, capturefile
-				 * is not set.
-				 */
-				if (vdev->num_logic_channels)
-					vdev->capturefile = g_strdup("logic-1");
-				else
-					vdev->capturefile = NULL;
-				return FALSE;
+				g_free(name);
 			}
 		}
+		p += ZIP_CENTRAL_SIZE + name_len + extra_len + comment_len;
 	}
 
-	buf = g_malloc(CHUNKSIZE);
+	return table;
+}
+
+static void add_entry(struct session_vdev *vdev, GHashTable *stored_entries,
+		const char *name, int analog_index, uint64_t size,
+		uint64_t *first_sample)
+{
+	struct replay_entry entry;
+	const struct stored_entry *stored;
+	unsigned int sample_size;
 
 	/* unitsize is not defined for purely analog session files. */
-	if (vdev->unitsize)
-		ret = zip_fread(vdev->capfile, buf,
-				CHUNKSIZE / vdev->unitsize * vdev->unitsize);
-	else
-		ret = zip_fread(vdev->capfile, buf, CHUNKSIZE);
-
-	if (ret > 0) {
-		if (vdev->cur_analog_channel != 0) {
-			got_data = TRUE;
-			packet.type = SR_DF_ANALOG;
-			packet.payload = &analog;
-			/* TODO: Use proper 'digits' value for this device (and its modes). */
-			sr_analog_init(&analog, &encoding, &meaning, &spec, 2);
-			analog.meaning->channels = g_slist_prepend(NULL,
-					g_array_index(vdev->analog_channels,
-						struct sr_channel *, vdev->cur_analog_channel - 1));
-			analog.num_samples = ret / sizeof(float);
-			analog.meaning->mq = SR_MQ_VOLTAGE;
-			analog.meaning->unit = SR_UNIT_VOLT;
-			analog.meaning->mqflags = SR_MQFLAG_DC;
-			analog.data = (float *) buf;
-		} else if (vdev->unitsize) {
-			got_data = TRUE;
-			if (ret % vdev->unitsize != 0)
-				sr_warn("Read size %d not a multiple of the"
-					" unit size %d.", ret, vdev->unitsize);
-			packet.type = SR_DF_LOGIC;
-			packet.payload = &logic;
-			logic.length = ret;
-			logic.unitsize = vdev->unitsize;
-			logic.data = buf;
+	sample_size = analog_index ? sizeof(float) : vdev->unitsize;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.name = g_strdup(name);
+	entry.analog_index = analog_index;
+	entry.first_sample = *first_sample;
+	entry.num_samples = sample_size ? size / sample_size : 0;
+	entry.length = size;
+	*first_sample += entry.num_samples;
+	if (stored_entries
+			&& (stored = g_hash_table_lookup(stored_entries, name))) {
+		entry.mapped = TRUE;
+		entry.offset = stored->offset;
+		entry.size = stored->size;
+	}
+	g_array_append_val(vdev->entries, entry);
+}
+
+/*
+ * Add a capture file's entries: either its unchunked base name, or the
+ * chunks "<basename>-1", "<basename>-2", and so on. The uncompressed
+ * sizes from the archive's directory make up the seek index, without
+ * reading any of the data.
+ */
+static void add_capture_entries(struct session_vdev *vdev,
+		GHashTable *stored_entries, const char *basename,
+		int analog_index)
+{
+	struct zip_stat zs;
+	uint64_t first_sample;
+	char *name;
+	int chunk;
+
+	first_sample = 0;
+	if (zip_stat(vdev->archive, basename, 0, &zs) != -1) {
+		add_entry(vdev, stored_entries, basename, analog_index,
+			zs.size, &first_sample);
+		return;
+	}
+
+	for (chunk = 1; ; chunk++) {
+		name = g_strdup_printf("%s-%d", basename, chunk);
+		if (zip_stat(vdev->archive, name, 0, &zs) == -1) {
+			g_free(name);
+			break;
+		}
+		add_entry(vdev, stored_entries, name, analog_index,
+			zs.size, &first_sample);
+		g_free(name);
+	}
+}
+
+/*
+ * Restrict the playback list to the configured sample range. Entries
+ * outside the range are dropped, those which overlap it are trimmed.
+ */
+static void apply_range(struct session_vdev *vdev)
+{
+	struct replay_entry *entry;
+	uint64_t start, end, sample_size;
+	unsigned int i;
+
+	for (i = 0; i < vdev->entries->len; ) {
+		entry = &g_array_index(vdev->entries, struct replay_entry, i);
+		start = MAX(entry->first_sample, vdev->range_start);
+		end = MIN(entry->first_sample + entry->num_samples,
+			vdev->range_end);
+		if (start >= end) {
+			g_free(entry->name);
+			g_array_remove_index(vdev->entries, i);
+			continue;
+		}
+		sample_size = entry->length / entry->num_samples;
+		entry->skip = (start - entry->first_sample) * sample_size;
+		entry->length = (end - start) * sample_size;
+		if (entry->mapped) {
+			entry->offset += entry->skip;
+			entry->size = entry->length;
+		}
+		i++;
+	}
+}
+
+static void free_entries(struct session_vdev *vdev)
+{
+	unsigned int i;
+
+	if (!vdev->entries)
+		return;
+	for (i = 0; i < vdev->entries->len; i++)
+		g_free(g_array_index(vdev->entries, struct replay_entry, i).name);
+	g_array_free(vdev->entries, TRUE);
+	vdev->entries = NULL;
+}
+
+/* Reader thread: get a free ring slot to fill, or NULL when stopped. */
+static struct replay_block *ring_acquire(struct session_vdev *vdev)
+{
+	struct replay_block *block;
+
+	g_mutex_lock(&vdev->ring_mutex);
+	while (vdev->ring_count == RING_SIZE && !vdev->reader_stop)
+		g_cond_wait(&vdev->ring_cond, &vdev->ring_mutex);
+	block = NULL;
+	if (!vdev->reader_stop)
+		block = &vdev->ring[(vdev->ring_tail + vdev->ring_count) % RING_SIZE];
+	g_mutex_unlock(&vdev->ring_mutex);
+
+	return block;
+}
+
+/* Reader thread: hand the slot from ring_acquire() to the main loop. */
+static void ring_commit(struct session_vdev *vdev)
+{
+	g_mutex_lock(&vdev->ring_mutex);
+	vdev->ring_count++;
+	g_cond_broadcast(&vdev->ring_cond);
+	g_mutex_unlock(&vdev->ring_mutex);
+}
+
+/*
+ * Send a stored entry straight from the mapping, or copy it into ring
+ * buffers for transforms. Returns FALSE when stopped.
+ */
+static gboolean read_mapped_entry(struct session_vdev *vdev,
+		const struct replay_entry *entry, size_t chunksize)
+{
+	struct replay_block *block;
+	const uint8_t *map;
+	uint64_t pos;
+
+	sr_dbg("Replaying mapped %s.", entry->name);
+	map = (const uint8_t *)g_mapped_file_get_contents(vdev->mapped_file);
+	for (pos = 0; pos < entry->size; pos += block->length) {
+		if (!(block = ring_acquire(vdev)))
+			return FALSE;
+		block->length = MIN(chunksize, entry->size - pos);
+		if (vdev->copy_mapped) {
+			memcpy(block->buf, map + entry->offset + pos,
+				block->length);
+			block->data = block->buf;
 		} else {
-			/*
-			 * Neither analog data, nor logic which has
-			 * unitsize, must be an unexpected API use.
-			 */
-			sr_warn("Neither analog nor logic data. Ignoring.");
+			block->data = map + entry->offset + pos;
 		}
-		if (got_data) {
-			vdev->bytes_read += ret;
-			sr_session_send(sdi, &packet);
+		block->analog_index = entry->analog_index;
+		ring_commit(vdev);
+	}
+
+	return TRUE;
+}
+
+/* Inflate an entry into ring buffers. Returns FALSE when stopped. */
+static gboolean read_zip_entry(struct session_vdev *vdev,
+		const struct replay_entry *entry, size_t chunksize)
+{
+	struct replay_block *block;
+	struct zip_file *zf;
+	uint64_t pos;
+	zip_int64_t ret;
+
+	if (!(zf = zip_fopen(vdev->archive, entry->name, 0))) {
+		sr_err("Cannot open '%s' in session file: %s",
+			entry->name, zip_strerror(vdev->archive));
+		return FALSE;
+	}
+	sr_dbg("Opened %s.", entry->name);
+
+	ret = 0;
+	block = NULL;
+	for (pos = 0; pos < entry->skip + entry->length; pos += ret) {
+		if (!block && !(block = ring_acquire(vdev))) {
+			zip_fclose(zf);
+			return FALSE;
 		}
-	} else {
-		/* done with this capture file */
-		zip_fclose(vdev->capfile);
-		vdev->capfile = NULL;
-		if (vdev->cur_chunk != 0) {
-			/* There might be more chunks, so don't fall through
-			 * to the SR_DF_END here. */
-			got_data = TRUE;
+		if (pos < entry->skip) {
+			/* Compressed data can only be skipped by inflating it. */
+			ret = zip_fread(zf, block->buf,
+				MIN(CHUNKSIZE, entry->skip - pos));
+		} else {
+			ret = zip_fread(zf, block->buf,
+				MIN(chunksize, entry->skip + entry->length - pos));
+		}
+		if (ret < 0)
+			sr_err("Cannot read session file data: %s",
+				zip_file_strerror(zf));
+		if (ret <= 0)
+			break;
+		if (pos >= entry->skip) {
+			block->data = block->buf;
+			block->length = ret;
+			block->analog_index = entry->analog_index;
+			ring_commit(vdev);
+			block = NULL;
 		}
 	}
-	g_free(buf);
+	zip_fclose(zf);
+
+	return TRUE;
+}
+
+static gpointer reader_thread(gpointer data)
+{
+	struct session_vdev *vdev;
+	struct replay_entry *entry;
+	size_t chunksize;
+	gboolean ok;
+	unsigned int i;
+
+	vdev = data;
+
+	ok = TRUE;
+	for (i = 0; ok && i < vdev->entries->len; i++) {
+		entry = &g_array_index(vdev->entries, struct replay_entry, i);
+
+		/* unitsize is not defined for purely analog session files. */
+		if (!entry->analog_index && vdev->unitsize)
+			chunksize = CHUNKSIZE / vdev->unitsize * vdev->unitsize;
+		else
+			chunksize = CHUNKSIZE;
+
+		if (entry->mapped)
+			ok = read_mapped_entry(vdev, entry, chunksize);
+		else
+			ok = read_zip_entry(vdev, entry, chunksize);
+	}
+
+	g_mutex_lock(&vdev->ring_mutex);
+	vdev->reader_done = TRUE;
+	g_cond_broadcast(&vdev->ring_cond);
+	g_mutex_unlock(&vdev->ring_mutex);
+
+	return NULL;
+}
+
+static void stop_reader(struct session_vdev *vdev)
+{
+	unsigned int i;
+
+	if (vdev->reader) {
+		g_mutex_lock(&vdev->ring_mutex);
+		vdev->reader_stop = TRUE;
+		g_cond_broadcast(&vdev->ring_cond);
+		g_mutex_unlock(&vdev->ring_mutex);
+		g_thread_join(vdev->reader);
+		vdev->reader = NULL;
+		g_mutex_clear(&vdev->ring_mutex);
+		g_cond_clear(&vdev->ring_cond);
+	}
+	for (i = 0; i < RING_SIZE; i++) {
+		g_free(vdev->ring[i].buf);
+		vdev->ring[i].buf = NULL;
+	}
+}
+
+static void send_block(const struct sr_dev_inst *sdi,
+		const struct replay_block *block)
+{
+	struct session_vdev *vdev;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+
+	vdev = sdi->priv;
+
+	if (block->analog_index) {
+		packet.type = SR_DF_ANALOG;
+		packet.payload = &analog;
+		/* TODO: Use proper 'digits' value for this device (and its modes). */
+		sr_analog_init(&analog, &encoding, &meaning, &spec, 2);
+		analog.meaning->channels = g_slist_prepend(NULL,
+				g_array_index(vdev->analog_channels,
+					struct sr_channel *, block->analog_index - 1));
+		analog.num_samples = block->length / sizeof(float);
+		analog.meaning->mq = SR_MQ_VOLTAGE;
+		analog.meaning->unit = SR_UNIT_VOLT;
+		analog.meaning->mqflags = SR_MQFLAG_DC;
+		analog.data = (void *)block->data;
+		sr_session_send(sdi, &packet);
+		g_slist_free(analog.meaning->channels);
+	} else if (vdev->unitsize) {
+		if (block->length % vdev->unitsize != 0)
+			sr_warn("Read size %zu not a multiple of the"
+				" unit size %u.", block->length, vdev->unitsize);
+		packet.type = SR_DF_LOGIC;
+		packet.payload = &logic;
+		logic.length = block->length;
+		logic.unitsize = vdev->unitsize;
+		logic.data = (void *)block->data;
+		sr_session_send(sdi, &packet);
+	} else {
+		/*
+		 * Neither analog data, nor logic which has
+		 * unitsize, must be an unexpected API use.
+		 */
+		sr_warn("Neither analog nor logic data. Ignoring.");
+		return;
+	}
+	vdev->bytes_read += block->length;
+}
+
+/*
+ * Send the next block which the reader thread has prepared. Returns
+ * FALSE when all data was sent.
+ */
+static gboolean stream_session_data(struct sr_dev_inst *sdi)
+{
+	struct session_vdev *vdev;
+	struct replay_block *block;
+	gint64 end_time;
+
+	vdev = sdi->priv;
 
-	return got_data;
+	g_mutex_lock(&vdev->ring_mutex);
+	end_time = g_get_monotonic_time() + RING_WAIT_US;
+	while (!vdev->ring_count && !vdev->reader_done) {
+		if (!g_cond_wait_until(&vdev->ring_cond, &vdev->ring_mutex,
+				end_time))
+			break;
+	}
+	if (!vdev->ring_count) {
+		/* Keep the main loop responsive while the reader is busy. */
+		g_mutex_unlock(&vdev->ring_mutex);
+		return !vdev->reader_done;
+	}
+	block = &vdev->ring[vdev->ring_tail];
+	g_mutex_unlock(&vdev->ring_mutex);
+
+	send_block(sdi, block);
+
+	g_mutex_lock(&vdev->ring_mutex);
+	vdev->ring_tail = (vdev->ring_tail + 1) % RING_SIZE;
+	vdev->ring_count--;
+	g_cond_broadcast(&vdev->ring_cond);
+	g_mutex_unlock(&vdev->ring_mutex);
+
+	return TRUE;
 }
 
 static int receive_data(int fd, int revents, void *cb_data)
@@ -216,14 +618,20 @@ static int receive_data(int fd, int revents, void *cb_data)
 	if (!vdev->finished)
 		return G_SOURCE_CONTINUE;
 
-	if (vdev->capfile) {
-		zip_fclose(vdev->capfile);
-		vdev->capfile = NULL;
-	}
+	stop_reader(vdev);
+	free_entries(vdev);
 	if (vdev->archive) {
 		zip_discard(vdev->archive);
 		vdev->archive = NULL;
 	}
+	if (vdev->mapped_file) {
+		g_mapped_file_unref(vdev->mapped_file);
+		vdev->mapped_file = NULL;
+	}
+	if (vdev->analog_channels) {
+		g_array_free(vdev->analog_channels, TRUE);
+		vdev->analog_channels = NULL;
+	}
 
 	std_session_send_df_end(sdi);
 
@@ -278,6 +686,11 @@ static int config_get(uint32_t key, GVariant **data,
 	case SR_CONF_CAPTURE_UNITSIZE:
 		*data = g_variant_new_uint64(vdev->unitsize);
 		break;
+	case SR_CONF_CAPTURE_RANGE:
+		if (!vdev->have_range)
+			return SR_ERR_NA;
+		*data = std_gvar_tuple_u64(vdev->range_start, vdev->range_end);
+		break;
 	default:
 		return SR_ERR_NA;
 	}
@@ -289,6 +702,7 @@ static int config_set(uint32_t key, GVariant *data,
 	const struct sr_dev_inst *sdi, const struct sr_channel_group *cg)
 {
 	struct session_vdev *vdev;
+	uint64_t start, end;
 
 	(void)cg;
 
@@ -318,6 +732,16 @@ static int config_set(uint32_t key, GVariant *data,
 	case SR_CONF_NUM_ANALOG_CHANNELS:
 		vdev->num_analog_channels = g_variant_get_int32(data);
 		break;
+	case SR_CONF_CAPTURE_RANGE:
+		g_variant_get(data, "(tt)", &start, &end);
+		if (start >= end)
+			return SR_ERR_ARG;
+		vdev->range_start = start;
+		vdev->range_end = end;
+		vdev->have_range = TRUE;
+		sr_info("Setting capture range to [%" PRIu64 ", %" PRIu64 ").",
+			start, end);
+		break;
 	default:
 		return SR_ERR_NA;
 	}
@@ -334,13 +758,15 @@ static int config_list(uint32_t key, GVariant **data,
 static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 {
 	struct session_vdev *vdev;
-	int ret;
+	int ret, i;
 	GSList *l;
 	struct sr_channel *ch;
+	GError *error;
+	GHashTable *stored_entries;
+	char *name;
 
 	vdev = sdi->priv;
 	vdev->bytes_read = 0;
-	vdev->cur_analog_channel = 0;
 	vdev->analog_channels = g_array_sized_new(FALSE, FALSE,
 			sizeof(struct sr_channel *), vdev->num_analog_channels);
 	for (l = sdi->channels; l; l = l->next) {
@@ -348,7 +774,6 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		if (ch->type == SR_CHANNEL_ANALOG)
 			g_array_append_val(vdev->analog_channels, ch);
 	}
-	vdev->cur_chunk = 0;
 	vdev->finished = FALSE;
 
 	sr_info("Opening archive %s file %s", vdev->sessionfile,
@@ -360,6 +785,51 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		return SR_ERR;
 	}
 
+	/* Stored entries get replayed from a mapping of the file. */
+	error = NULL;
+	stored_entries = NULL;
+	vdev->mapped_file = g_mapped_file_new(vdev->sessionfile, FALSE, &error);
+	if (!vdev->mapped_file) {
+		sr_dbg("Cannot map session file: %s", error->message);
+		g_error_free(error);
+	} else {
+		stored_entries = index_stored_entries((const uint8_t *)
+			g_mapped_file_get_contents(vdev->mapped_file),
+			g_mapped_file_get_length(vdev->mapped_file));
+	}
+
+	/* Logic data first, then all analog channels in turn. */
+	vdev->entries = g_array_new(FALSE, FALSE, sizeof(struct replay_entry));
+	if (vdev->capturefile) {
+		add_capture_entries(vdev, stored_entries,
+			vdev->capturefile, 0);
+		if (!vdev->entries->len)
+			sr_err("No capture file '%s' in session file '%s'.",
+				vdev->capturefile, vdev->sessionfile);
+	}
+	for (i = 0; i < vdev->num_analog_channels
+			&& i < (int)vdev->analog_channels->len; i++) {
+		name = g_strdup_printf("analog-1-%d",
+			vdev->num_logic_channels + i + 1);
+		add_capture_entries(vdev, stored_entries, name, i + 1);
+		g_free(name);
+	}
+	if (stored_entries)
+		g_hash_table_destroy(stored_entries);
+	if (vdev->have_range)
+		apply_range(vdev);
+
+	for (i = 0; i < RING_SIZE; i++)
+		vdev->ring[i].buf = g_malloc(CHUNKSIZE);
+	vdev->ring_tail = 0;
+	vdev->ring_count = 0;
+	vdev->copy_mapped = sdi->session->transforms != NULL;
+	vdev->reader_done = FALSE;
+	vdev->reader_stop = FALSE;
+	g_mutex_init(&vdev->ring_mutex);
+	g_cond_init(&vdev->ring_cond);
+	vdev->reader = g_thread_new("session-reader", reader_thread, vdev);
+
 	std_session_send_df_header(sdi);
 
 	/* freewheeling source */
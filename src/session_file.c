@@ -149,7 +149,7 @@ SR_PRIV int sr_sessionfile_check(const char *filename)
 	zip_fclose(zf);
 	s[ret] = '\0';
 	version = g_ascii_strtoull(s, NULL, 10);
-	if (version == 0 || version > 2) {
+	if (version == 0 || version > 3) {
 		sr_dbg("Cannot handle sigrok session file version %" PRIu64 ".",
 			version);
 		zip_discard(archive);
@@ -391,4 +391,46 @@ SR_API int sr_session_load(struct sr_context *ctx, const char *filename,
 	return ret;
 }
 
+/**
+ * Restrict the replay of a loaded session file to a range of samples.
+ *
+ * Only the archive entries which cover the range get decompressed, so
+ * this allows jumping into large captures. The range applies to logic
+ * as well as analog data. It takes effect on the next sr_session_start().
+ *
+ * @param session A session loaded with sr_session_load(). Must not be NULL.
+ * @param start The first sample to replay.
+ * @param end The sample after the last one to replay. Must be greater
+ *            than start.
+ *
+ * @retval SR_OK Success
+ * @retval SR_ERR_ARG Invalid arguments
+ * @retval SR_ERR_NA The session contains no devices from a session file
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_range_set(struct sr_session *session,
+		uint64_t start, uint64_t end)
+{
+	struct sr_dev_inst *sdi;
+	GSList *l;
+	int ret;
+
+	if (!session || start >= end)
+		return SR_ERR_ARG;
+
+	ret = SR_ERR_NA;
+	for (l = session->owned_devs; l; l = l->next) {
+		sdi = l->data;
+		if (sdi->driver != &session_driver)
+			continue;
+		ret = sr_config_set(sdi, NULL, SR_CONF_CAPTURE_RANGE,
+				std_gvar_tuple_u64(start, end));
+		if (ret != SR_OK)
+			break;
+	}
+
+	return ret;
+}
+
 /** @} */
@@ -41,6 +41,79 @@ SR_PRIV int logic_channel_unitsize(GSList *channels)
 	return (number + 7) / 8;
 }
 
+static void compile_stages(struct soft_trigger_logic *stl)
+{
+	const struct sr_trigger_stage *stage;
+	const struct sr_trigger_match *match;
+	struct soft_trigger_stage *st;
+	GSList *l, *m;
+	uint8_t *masks, bit;
+	int i, byte;
+
+	stl->num_stages = g_slist_length(stl->trigger->stages);
+	stl->stages = g_new0(struct soft_trigger_stage, stl->num_stages);
+	for (i = 0, l = stl->trigger->stages; l; l = l->next, i++) {
+		stage = l->data;
+		st = &stl->stages[i];
+		masks = g_malloc0(5 * stl->unitsize);
+		st->level_mask = masks;
+		st->level_value = masks + stl->unitsize;
+		st->rising_mask = masks + 2 * stl->unitsize;
+		st->falling_mask = masks + 3 * stl->unitsize;
+		st->edge_mask = masks + 4 * stl->unitsize;
+		st->first_byte = stl->unitsize;
+		st->last_byte = -1;
+		st->duration = stage->duration;
+		st->duration_samples = stage->duration_samples;
+
+		for (m = stage->matches; m; m = m->next) {
+			match = m->data;
+			if (match->channel->type != SR_CHANNEL_LOGIC) {
+				sr_warn("Stage %d: Ignoring match on non-logic "
+					"channel %s.", i, match->channel->name);
+				continue;
+			}
+			st->num_matches++;
+			if (!match->channel->enabled)
+				/* Ignore disabled channels with a trigger. */
+				continue;
+			byte = match->channel->index / 8;
+			bit = 1 << (match->channel->index % 8);
+			if (byte >= stl->unitsize)
+				continue;
+			switch (match->match) {
+			case SR_TRIGGER_ZERO:
+				st->level_mask[byte] |= bit;
+				break;
+			case SR_TRIGGER_ONE:
+				st->level_mask[byte] |= bit;
+				st->level_value[byte] |= bit;
+				break;
+			case SR_TRIGGER_RISING:
+				st->rising_mask[byte] |= bit;
+				st->has_edges = TRUE;
+				break;
+			case SR_TRIGGER_FALLING:
+				st->falling_mask[byte] |= bit;
+				st->has_edges = TRUE;
+				break;
+			case SR_TRIGGER_EDGE:
+				st->edge_mask[byte] |= bit;
+				st->has_edges = TRUE;
+				break;
+			default:
+				/* sr_trigger_match_add() rejects other matches. */
+				continue;
+			}
+			st->first_byte = MIN(st->first_byte, byte);
+			st->last_byte = MAX(st->last_byte, byte);
+		}
+
+		/* A stage without any (usable) matches is a client error. */
+		st->valid = st->num_matches > 0;
+	}
+}
+
 SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
 		const struct sr_dev_inst *sdi, struct sr_trigger *trigger,
 		int pre_trigger_samples)
@@ -52,6 +125,7 @@ SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
 	stl->trigger = trigger;
 	stl->unitsize = logic_channel_unitsize(sdi->channels);
 	stl->prev_sample = g_malloc0(stl->unitsize);
+	compile_stages(stl);
 	stl->pre_trigger_size = stl->unitsize * pre_trigger_samples;
 	stl->pre_trigger_buffer = g_try_malloc(stl->pre_trigger_size);
 	if (pre_trigger_samples > 0 && !stl->pre_trigger_buffer) {
@@ -75,6 +149,11 @@ SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
 
 SR_PRIV void soft_trigger_logic_free(struct soft_trigger_logic *stl)
 {
+	int i;
+
+	for (i = 0; i < stl->num_stages; i++)
+		g_free(stl->stages[i].level_mask);
+	g_free(stl->stages);
 	g_free(stl->pre_trigger_buffer);
 	g_free(stl->prev_sample);
 	g_free(stl);
@@ -138,36 +217,70 @@ static void pre_trigger_send(struct soft_trigger_logic *stl,
 	}
 }
 
-static gboolean logic_check_match(struct soft_trigger_logic *stl,
-		uint8_t *sample, struct sr_trigger_match *match)
+static inline gboolean stage_levels_match(const struct soft_trigger_stage *st,
+		const uint8_t *sample)
 {
-	int bit, prev_bit;
-	gboolean result;
-
-	stl->count++;
-	result = FALSE;
-	bit = *(sample + match->channel->index / 8)
-			& (1 << (match->channel->index % 8));
-	if (match->match == SR_TRIGGER_ZERO)
-		result = bit == 0;
-	else if (match->match == SR_TRIGGER_ONE)
-		result = bit != 0;
-	else {
-		/* Edge matches. */
-		if (stl->count == 1)
-			/* First sample, don't have enough for an edge match yet. */
+	int b;
+
+	for (b = st->first_byte; b <= st->last_byte; b++) {
+		if ((sample[b] & st->level_mask[b]) != st->level_value[b])
 			return FALSE;
-		prev_bit = *(stl->prev_sample + match->channel->index / 8)
-				& (1 << (match->channel->index % 8));
-		if (match->match == SR_TRIGGER_RISING)
-			result = prev_bit == 0 && bit != 0;
-		else if (match->match == SR_TRIGGER_FALLING)
-			result = prev_bit != 0 && bit == 0;
-		else if (match->match == SR_TRIGGER_EDGE)
-			result = prev_bit != bit;
 	}
 
-	return result;
+	return TRUE;
+}
+
+static gboolean stage_edges_match(const struct soft_trigger_stage *st,
+		const uint8_t *sample, const uint8_t *prev)
+{
+	uint8_t diff;
+	int b;
+
+	for (b = st->first_byte; b <= st->last_byte; b++) {
+		diff = sample[b] ^ prev[b];
+		if ((diff & sample[b] & st->rising_mask[b]) != st->rising_mask[b])
+			return FALSE;
+		if ((diff & prev[b] & st->falling_mask[b]) != st->falling_mask[b])
+			return FALSE;
+		if ((diff & st->edge_mask[b]) != st->edge_mask[b])
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Returns the number of consecutive samples (starting at buf) on which
+ * the levels of the stage hold. The common case of all level matches
+ * living in the same byte gets a tight loop over that byte.
+ */
+static uint64_t stage_levels_run(const struct soft_trigger_stage *st,
+		const uint8_t *buf, int unitsize, uint64_t num_samples)
+{
+	const uint8_t *p;
+	uint8_t mask, value;
+	uint64_t run;
+
+	if (st->first_byte > st->last_byte)
+		return num_samples;
+
+	if (st->first_byte == st->last_byte) {
+		p = buf + st->first_byte;
+		mask = st->level_mask[st->first_byte];
+		value = st->level_value[st->first_byte];
+		for (run = 0; run < num_samples; run++, p += unitsize) {
+			if ((*p & mask) != value)
+				break;
+		}
+		return run;
+	}
+
+	for (run = 0; run < num_samples; run++, buf += unitsize) {
+		if (!stage_levels_match(st, buf))
+			break;
+	}
+
+	return run;
 }
 
 /* Returns the offset (in samples) within buf of where the trigger
@@ -176,45 +289,85 @@ SR_PRIV int soft_trigger_logic_check(struct soft_trigger_logic *stl,
 		uint8_t *buf, int len, int *pre_trigger_samples)
 {
 	struct sr_datafeed_packet packet;
-	struct sr_trigger_stage *stage;
-	struct sr_trigger_match *match;
-	GSList *l, *l_stage;
+	struct soft_trigger_stage *st;
+	const uint8_t *sample, *prev;
+	int64_t num_samples, i;
+	uint64_t run, need;
 	int offset;
-	int i;
 	gboolean match_found;
 
 	offset = -1;
-	for (i = 0; i < len; i += stl->unitsize) {
-		l_stage = g_slist_nth(stl->trigger->stages, stl->cur_stage);
-		stage = l_stage->data;
-		if (!stage->matches)
-			/* No matches supplied, client error. */
+	num_samples = len / stl->unitsize;
+	for (i = 0; i < num_samples; i++) {
+		st = &stl->stages[stl->cur_stage];
+		if (!st->valid)
+			/* No (usable) matches supplied, client error. */
 			return SR_ERR_ARG;
 
-		match_found = TRUE;
-		for (l = stage->matches; l; l = l->next) {
-			match = l->data;
-			if (!match->channel->enabled)
-				/* Ignore disabled channels with a trigger. */
-				continue;
-			if (!logic_check_match(stl, buf + i, match)) {
-				match_found = FALSE;
-				break;
+		sample = buf + i * stl->unitsize;
+		if (st->duration == SR_TRIGGER_DURATION_NONE) {
+			match_found = stage_levels_match(st, sample);
+			if (match_found && st->has_edges) {
+				if (i > 0)
+					prev = sample - stl->unitsize;
+				else if (stl->have_prev_sample)
+					prev = stl->prev_sample;
+				else
+					/* First sample, don't have enough for an edge match yet. */
+					prev = NULL;
+				match_found = prev && stage_edges_match(st, sample, prev);
+			}
+		} else {
+			/*
+			 * Qualified stage: skip the whole run of samples which
+			 * the levels hold on in one go, and then decide based
+			 * on the accumulated run length.
+			 */
+			run = stage_levels_run(st, sample, stl->unitsize,
+				num_samples - i);
+			if (st->duration == SR_TRIGGER_DURATION_AT_LEAST) {
+				need = st->duration_samples - stl->run_length;
+				if (run >= need) {
+					/* Match on the sample completing the duration. */
+					i += need - 1;
+					match_found = TRUE;
+				} else {
+					i += run;
+					stl->run_length += run;
+					match_found = FALSE;
+				}
+			} else {
+				if (run > 0 && i == 0 && !stl->have_prev_sample)
+					/* Unknown width, started before the acquisition. */
+					stl->run_from_start = TRUE;
+				i += run;
+				stl->run_length += run;
+				/* Match on the first sample after a short pulse. */
+				match_found = stl->run_length > 0 &&
+					stl->run_length < st->duration_samples &&
+					!stl->run_from_start;
 			}
+			if (i >= num_samples)
+				/* The run continues into the next buffer. */
+				break;
+			stl->run_length = 0;
+			stl->run_from_start = FALSE;
 		}
-		memcpy(stl->prev_sample, buf + i, stl->unitsize);
+
 		if (match_found) {
 			/* Matched on the current stage. */
-			if (l_stage->next) {
+			if (stl->cur_stage == 0)
+				stl->first_match = i;
+			if (stl->cur_stage + 1 < stl->num_stages) {
 				/* Advance to next stage. */
 				stl->cur_stage++;
 			} else {
 				/* Matched on last stage, send pre-trigger data. */
-				pre_trigger_append(stl, buf, i);
+				pre_trigger_append(stl, buf, i * stl->unitsize);
 				pre_trigger_send(stl, pre_trigger_samples);
 
 				/* Fire trigger. */
-				offset = i / stl->unitsize;
+				offset = i;
 
 				packet.type = SR_DF_TRIGGER;
 				packet.payload = NULL;
@@ -227,11 +380,11 @@ SR_PRIV int soft_trigger_logic_check(struct soft_trigger_logic *stl,
 			 * current stage. However, we may have a match on this
 			 * stage in the next bit -- trigger on 0001 will fail on
 			 * seeing 00001, so we need to go back to stage 0 -- but
-			 * at the next sample from the one that matched originally,
-			 * which the counter increment at the end of the loop
-			 * takes care of.
+			 * at the next sample from the one that matched stage 0
+			 * originally, which the counter increment at the end of
+			 * the loop takes care of.
 			 */
-			i -= stl->cur_stage * stl->unitsize;
+			i = stl->first_match;
 			if (i < -1)
 				i = -1; /* Oops, went back past this buffer. */
 			/* Reset trigger stage. */
@@ -239,8 +392,16 @@ SR_PRIV int soft_trigger_logic_check(struct soft_trigger_logic *stl,
 		}
 	}
 
-	if (offset == -1)
+	if (offset == -1) {
 		pre_trigger_append(stl, buf, len);
+		if (num_samples > 0) {
+			memcpy(stl->prev_sample,
+				buf + (num_samples - 1) * stl->unitsize,
+				stl->unitsize);
+			stl->have_prev_sample = TRUE;
+		}
+		stl->first_match -= num_samples;
+	}
 
 	return offset;
 }
@@ -119,6 +119,13 @@ SR_API struct sr_trigger_stage *sr_trigger_stage_add(struct sr_trigger *trig)
 	return stage;
 }
 
+/* Duration qualifiers only apply to these matches. */
+static gboolean level_match(int trigger_match)
+{
+	return trigger_match == SR_TRIGGER_ZERO ||
+		trigger_match == SR_TRIGGER_ONE;
+}
+
 /**
  * Allocate a new trigger match and add it to the specified trigger stage.
  *
@@ -134,7 +141,9 @@ SR_API struct sr_trigger_stage *sr_trigger_stage_add(struct sr_trigger *trig)
  * @param value Trigger value.
  *
  * @retval SR_OK Success.
- * @retval SR_ERR_ARG Invalid argument(s) were passed to this functions.
+ * @retval SR_ERR_ARG Invalid argument(s) were passed to this functions,
+ *                    or the stage has a duration qualifier and the match
+ *                    is not SR_TRIGGER_ZERO or SR_TRIGGER_ONE.
  *
  * @since 0.4.0
  */
@@ -169,6 +178,12 @@ SR_API int sr_trigger_match_add(struct sr_trigger_stage *stage,
 		return SR_ERR_ARG;
 	}
 
+	if (stage->duration != SR_TRIGGER_DURATION_NONE &&
+			!level_match(trigger_match)) {
+		sr_err("Duration qualified stages only take level matches.");
+		return SR_ERR_ARG;
+	}
+
 	match = g_malloc0(sizeof(struct sr_trigger_match));
 	match->channel = ch;
 	match->match = trigger_match;
@@ -178,4 +193,66 @@ SR_API int sr_trigger_match_add(struct sr_trigger_stage *stage,
 	return SR_OK;
 }
 
+/**
+ * Set a duration qualifier on a trigger stage.
+ *
+ * A qualified stage only matches when the levels of its matches are held
+ * for at least, or for less than, the given number of samples after the
+ * previous stage matched (after the start of the acquisition for the
+ * first stage). Levels which were already present before that don't
+ * count. Duration qualifiers only apply to SR_TRIGGER_ZERO and
+ * SR_TRIGGER_ONE matches, a qualified stage must not contain other
+ * matches. A pulse which is already present on the first acquired sample
+ * has an unknown width, and never completes a
+ * SR_TRIGGER_DURATION_LESS_THAN first stage.
+ *
+ * @param stage The trigger stage to qualify. Must not be NULL.
+ * @param duration The duration qualifier. Must be a valid value from
+ *                 enum sr_trigger_durations.
+ * @param samples The number of samples. Must be non-zero unless the
+ *                qualifier is SR_TRIGGER_DURATION_NONE.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument(s) were passed to this functions,
+ *                    or the stage has matches other than SR_TRIGGER_ZERO
+ *                    and SR_TRIGGER_ONE.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_trigger_stage_duration_set(struct sr_trigger_stage *stage,
+		int duration, uint64_t samples)
+{
+	const struct sr_trigger_match *match;
+	GSList *l;
+
+	if (!stage)
+		return SR_ERR_ARG;
+
+	if (duration != SR_TRIGGER_DURATION_NONE &&
+			duration != SR_TRIGGER_DURATION_AT_LEAST &&
+			duration != SR_TRIGGER_DURATION_LESS_THAN) {
+		sr_err("Invalid trigger duration qualifier: %d.", duration);
+		return SR_ERR_ARG;
+	}
+	if (duration != SR_TRIGGER_DURATION_NONE && !samples) {
+		sr_err("Trigger duration qualifier needs a sample count.");
+		return SR_ERR_ARG;
+	}
+	if (duration != SR_TRIGGER_DURATION_NONE) {
+		for (l = stage->matches; l; l = l->next) {
+			match = l->data;
+			if (!level_match(match->match)) {
+				sr_err("Duration qualifiers only apply to "
+					"level matches.");
+				return SR_ERR_ARG;
+			}
+		}
+	}
+
+	stage->duration = duration;
+	stage->duration_samples = samples;
+
+	return SR_OK;
+}
+
 /** @} */
@@ -85,6 +85,57 @@ START_TEST(test_analog_to_float)
 }
 END_TEST
 
+/* Check conversion of byte swapped, double and scaled float data. */
+START_TEST(test_analog_to_float_encodings)
+{
+	int ret;
+	unsigned int i;
+	uint8_t buf[4 * sizeof(double)];
+	float fout[4];
+	uint32_t u;
+	double d;
+	struct sr_channel ch;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	const float v[] = {-12.5, 0, 3.25, 989898.0};
+
+	sr_analog_init_(&analog, &encoding, &meaning, &spec, 3);
+	analog.num_samples = ARRAY_SIZE(v);
+	analog.data = buf;
+	meaning.channels = g_slist_append(NULL, &ch);
+
+	/* Floats in the other byte order. */
+	encoding.is_bigendian = !encoding.is_bigendian;
+	for (i = 0; i < ARRAY_SIZE(v); i++) {
+		memcpy(&u, &v[i], sizeof(u));
+		u = GUINT32_SWAP_LE_BE(u);
+		memcpy(buf + i * sizeof(float), &u, sizeof(u));
+	}
+	ret = sr_analog_to_float(&analog, fout);
+	fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d.", ret);
+	for (i = 0; i < ARRAY_SIZE(v); i++)
+		fail_unless(fout[i] == v[i], "%f != %f", fout[i], v[i]);
+
+	/* Native doubles, scaled by 1/2 and with an offset of 1. */
+	encoding.is_bigendian = !encoding.is_bigendian;
+	encoding.unitsize = sizeof(double);
+	encoding.scale.q = 2;
+	encoding.offset.p = 1;
+	for (i = 0; i < ARRAY_SIZE(v); i++) {
+		d = v[i];
+		memcpy(buf + i * sizeof(double), &d, sizeof(double));
+	}
+	ret = sr_analog_to_float(&analog, fout);
+	fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d.", ret);
+	for (i = 0; i < ARRAY_SIZE(v); i++)
+		fail_unless(fout[i] == v[i] / 2 + 1, "%f != %f", fout[i], v[i] / 2 + 1);
+
+	g_slist_free(meaning.channels);
+}
+END_TEST
+
 START_TEST(test_analog_to_float_null)
 {
 	int ret;
@@ -123,6 +174,119 @@ START_TEST(test_analog_to_float_null)
 }
 END_TEST
 
+static GArray *raw_input_floats;
+
+static void datafeed_raw_input(const struct sr_dev_inst *sdi,
+	const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_analog *analog;
+
+	(void)sdi;
+	(void)cb_data;
+
+	if (packet->type != SR_DF_ANALOG)
+		return;
+	analog = packet->payload;
+	fail_unless(analog->encoding->is_float, "Samples were not converted.");
+	fail_unless(analog->encoding->unitsize == sizeof(float));
+	g_array_append_vals(raw_input_floats, analog->data,
+		analog->num_samples * g_slist_length(analog->meaning->channels));
+}
+
+/*
+ * Have the raw_analog input convert samples of the given format, and
+ * check the result against sr_analog_to_float() on the same data.
+ */
+static void check_raw_input(const char *format,
+		const struct sr_analog_encoding *raw_encoding)
+{
+	int ret;
+	unsigned int i, num_channels, count;
+	GHashTable *options;
+	struct sr_input *in;
+	struct sr_session *session;
+	struct sr_channel ch[2];
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	GString *buf;
+	float *fout;
+
+	num_channels = ARRAY_SIZE(ch);
+	count = 1000 * num_channels;
+	buf = g_string_sized_new(count * raw_encoding->unitsize);
+	for (i = 0; i < count * raw_encoding->unitsize; i++)
+		g_string_append_c(buf, (i * 37 + i / 7) & 0xff);
+
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, g_strdup("numchannels"),
+		g_variant_ref_sink(g_variant_new_int32(num_channels)));
+	g_hash_table_insert(options, g_strdup("format"),
+		g_variant_ref_sink(g_variant_new_string(format)));
+	g_hash_table_insert(options, g_strdup("convert"),
+		g_variant_ref_sink(g_variant_new_boolean(TRUE)));
+
+	in = sr_input_new(sr_input_find("raw_analog"), options);
+	fail_unless(in != NULL, "Failed to create input instance.");
+	raw_input_floats = g_array_new(FALSE, FALSE, sizeof(float));
+	sr_session_new(srtest_ctx, &session);
+	sr_session_datafeed_callback_add(session, datafeed_raw_input, NULL);
+	ret = sr_input_send(in, buf);
+	fail_unless(ret == SR_OK, "sr_input_send() error: %d", ret);
+	fail_unless(sr_input_dev_inst_get(in) != NULL,
+		"Device instance is not ready.");
+	sr_session_dev_add(session, sr_input_dev_inst_get(in));
+	ret = sr_input_end(in);
+	fail_unless(ret == SR_OK, "sr_input_end() error: %d", ret);
+	sr_input_free(in);
+	sr_session_destroy(session);
+
+	sr_analog_init_(&analog, &encoding, &meaning, &spec, 3);
+	encoding = *raw_encoding;
+	analog.num_samples = count / num_channels;
+	analog.data = buf->str;
+	meaning.channels = g_slist_append(NULL, &ch[0]);
+	meaning.channels = g_slist_append(meaning.channels, &ch[1]);
+	fout = g_malloc_n(count, sizeof(float));
+	ret = sr_analog_to_float(&analog, fout);
+	fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d.", ret);
+
+	fail_unless(raw_input_floats->len == count,
+		"%s: Expected %u values, got %u.", format, count,
+		raw_input_floats->len);
+	fail_unless(!memcmp(raw_input_floats->data, fout, count * sizeof(float)),
+		"%s: Converted values differ from sr_analog_to_float().", format);
+
+	g_free(fout);
+	g_slist_free(meaning.channels);
+	g_array_free(raw_input_floats, TRUE);
+	g_string_free(buf, TRUE);
+	g_hash_table_destroy(options);
+}
+
+START_TEST(test_analog_raw_input_convert)
+{
+	unsigned int i;
+	const struct {
+		const char *format;
+		struct sr_analog_encoding encoding;
+	} formats[] = {
+		{ "S8",     { 1, TRUE,  FALSE, FALSE,  7, FALSE, { 1,                     128}, { 0, 1}}},
+		{ "U8",     { 1, FALSE, FALSE, FALSE,  8, FALSE, { 1,                     255}, {-1, 2}}},
+		{ "S16_LE", { 2, TRUE,  FALSE, FALSE, 15, FALSE, { 1,           INT16_MAX + 1}, { 0, 1}}},
+		{ "U16_BE", { 2, FALSE, FALSE, TRUE,  16, FALSE, { 1,              UINT16_MAX}, {-1, 2}}},
+		{ "S32_BE", { 4, TRUE,  FALSE, TRUE,  31, FALSE, { 1, (uint64_t)INT32_MAX + 1}, { 0, 1}}},
+		{ "U32_LE", { 4, FALSE, FALSE, FALSE, 32, FALSE, { 1,              UINT32_MAX}, {-1, 2}}},
+		{ "FLOAT_BE", { 4, TRUE, TRUE, TRUE,   6, TRUE,  { 1,                       1}, { 0, 1}}},
+	};
+
+	for (i = 0; i < ARRAY_SIZE(formats); i++)
+		check_raw_input(formats[i].format, &formats[i].encoding);
+}
+END_TEST
+
 START_TEST(test_analog_si_prefix)
 {
 	struct {
@@ -385,6 +549,7 @@ Suite *suite_analog(void)
 
 	tc = tcase_create("analog_to_float");
 	tcase_add_test(tc, test_analog_to_float);
+	tcase_add_test(tc, test_analog_to_float_encodings);
 	tcase_add_test(tc, test_analog_to_float_null);
 	tcase_add_test(tc, test_analog_si_prefix);
 	tcase_add_test(tc, test_analog_si_prefix_null);
@@ -397,5 +562,10 @@ Suite *suite_analog(void)
 	tcase_add_test(tc, test_div_rational);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("raw_input");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_analog_raw_input_convert);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
@@ -19,6 +19,8 @@
 
 #include <config.h>
 #include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
 #include <check.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
@@ -33,6 +35,96 @@ START_TEST(test_input_available)
 }
 END_TEST
 
+static const char scan_vcd[] =
+	"$timescale 1 us $end\n"
+	"$scope module top $end\n"
+	"$var wire 1 ! a $end\n"
+	"$upscope $end\n"
+	"$enddefinitions $end\n"
+	"#0 1!\n#10 0!\n";
+
+static const char scan_csv[] = "0,1\n1,0\n1,1\n";
+
+static const char *scan_buffer_id(const char *text, size_t length)
+{
+	const struct sr_input *in;
+	const char *id;
+	GString *buf;
+	int ret;
+
+	buf = g_string_new_len(text, length);
+	ret = sr_input_scan_buffer(buf, &in);
+	g_string_free(buf, TRUE);
+	if (ret != SR_OK) {
+		fail_unless(in == NULL, "Failed scan returned an instance.");
+		return NULL;
+	}
+	fail_unless(in != NULL, "Successful scan returned no instance.");
+	id = sr_input_id_get(sr_input_module_get(in));
+	sr_input_free(in);
+
+	return id;
+}
+
+static const char *scan_file_id(const char *text, const char *ext)
+{
+	const struct sr_input *in;
+	const char *id;
+	char *name, *filename;
+	int ret;
+
+	name = g_strdup_printf("sr-input-scan-test.%s", ext);
+	filename = g_build_filename(g_get_tmp_dir(), name, NULL);
+	fail_unless(g_file_set_contents(filename, text, strlen(text), NULL),
+		"Failed to write temporary file.");
+	ret = sr_input_scan_file(filename, &in);
+	g_unlink(filename);
+	g_free(filename);
+	g_free(name);
+	if (ret != SR_OK) {
+		fail_unless(in == NULL, "Failed scan returned an instance.");
+		return NULL;
+	}
+	fail_unless(in != NULL, "Successful scan returned no instance.");
+	id = sr_input_id_get(sr_input_module_get(in));
+	sr_input_free(in);
+
+	return id;
+}
+
+/* Check that buffers get recognized by their content. */
+START_TEST(test_input_scan_buffer)
+{
+	const char *id;
+
+	id = scan_buffer_id(scan_vcd, strlen(scan_vcd));
+	fail_unless(id && !strcmp(id, "vcd"), "VCD was detected as %s.", id);
+	id = scan_buffer_id(scan_csv, strlen(scan_csv));
+	fail_unless(id && !strcmp(id, "csv"), "CSV was detected as %s.", id);
+	id = scan_buffer_id("\x00\x01\x02\x03", 4);
+	fail_unless(id == NULL, "Binary data was detected as %s.", id);
+}
+END_TEST
+
+/*
+ * Check that the file name extension only changes the order in which
+ * modules get asked, and content with a better match still wins.
+ */
+START_TEST(test_input_scan_file)
+{
+	const char *id;
+
+	id = scan_file_id(scan_vcd, "vcd");
+	fail_unless(id && !strcmp(id, "vcd"), "VCD was detected as %s.", id);
+	id = scan_file_id(scan_vcd, "csv");
+	fail_unless(id && !strcmp(id, "vcd"), "VCD was detected as %s.", id);
+	id = scan_file_id(scan_csv, "csv");
+	fail_unless(id && !strcmp(id, "csv"), "CSV was detected as %s.", id);
+	id = scan_file_id(scan_csv, "vcd");
+	fail_unless(id && !strcmp(id, "csv"), "CSV was detected as %s.", id);
+}
+END_TEST
+
 Suite *suite_input_all(void)
 {
 	Suite *s;
@@ -44,5 +136,10 @@ Suite *suite_input_all(void)
 	tcase_add_test(tc, test_input_available);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("scan");
+	tcase_add_test(tc, test_input_scan_buffer);
+	tcase_add_test(tc, test_input_scan_file);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
@@ -29,6 +29,7 @@ enum {
 	CHECK_ALL_LOW,
 	CHECK_ALL_HIGH,
 	CHECK_HELLO_WORLD,
+	CHECK_EXPECTED,
 };
 
 static uint64_t df_packet_counter = 0, sample_counter = 0;
@@ -37,6 +38,8 @@ static GArray *logic_channellist = NULL;
 static int check_to_perform;
 static uint64_t expected_samples;
 static uint64_t *expected_samplerate;
+static const uint8_t *expected_data;
+static uint16_t expected_unitsize;
 
 static void check_all_low(const struct sr_datafeed_logic *logic)
 {
@@ -76,6 +79,17 @@ static void check_hello_world(const struct sr_datafeed_logic *logic)
 	}
 }
 
+static void check_expected(const struct sr_datafeed_logic *logic)
+{
+	fail_unless(logic->unitsize == expected_unitsize,
+		"Expected unitsize %d, got %d.", expected_unitsize,
+		logic->unitsize);
+	fail_unless(!memcmp(logic->data,
+		expected_data + sample_counter * logic->unitsize,
+		logic->length), "Logic data differs from the expected data "
+		"after sample %" PRIu64 ".", sample_counter);
+}
+
 static void datafeed_in(const struct sr_dev_inst *sdi,
 	const struct sr_datafeed_packet *packet, void *cb_data)
 {
@@ -158,6 +172,8 @@ static void datafeed_in(const struct sr_dev_inst *sdi,
 			check_all_high(logic);
 		else if (check_to_perform == CHECK_HELLO_WORLD)
 			check_hello_world(logic);
+		else if (check_to_perform == CHECK_EXPECTED)
+			check_expected(logic);
 
 		sample_counter += logic->length / logic->unitsize;
 
@@ -221,6 +237,70 @@ static void check_buf(GHashTable *options, const uint8_t *buf, int check,
 	g_string_free(gbuf, TRUE);
 }
 
+/*
+ * Have a read-only file mapped and processed by sr_input_send_mapped(),
+ * optionally through a transform module. The file's content must not
+ * change.
+ */
+static void check_file(GHashTable *options, const uint8_t *buf,
+		uint64_t size, int check, uint64_t samples, const char *transform)
+{
+	int ret;
+	struct sr_input *in;
+	struct sr_session *session;
+	struct sr_dev_inst *sdi;
+	const struct sr_transform_module *tmod;
+	char *filename, *contents;
+	gsize length;
+
+	df_packet_counter = sample_counter = 0;
+	have_seen_df_end = FALSE;
+	logic_channellist = NULL;
+	check_to_perform = check;
+	expected_samples = samples;
+	expected_samplerate = NULL;
+
+	filename = g_build_filename(g_get_tmp_dir(),
+		"sr-input-binary-test.bin", NULL);
+	fail_unless(g_file_set_contents(filename, (const gchar *)buf,
+		size, NULL), "Failed to write temporary file.");
+	/* The file gets mapped read-only, its permissions must suffice. */
+	g_chmod(filename, 0444);
+
+	in = sr_input_new(sr_input_find("binary"), options);
+	fail_unless(in != NULL, "Failed to create input instance.");
+
+	sr_session_new(srtest_ctx, &session);
+	sr_session_datafeed_callback_add(session, datafeed_in, NULL);
+
+	ret = sr_input_send_mapped(in, filename);
+	fail_unless(ret == SR_OK, "sr_input_send_mapped() error: %d", ret);
+	sdi = sr_input_dev_inst_get(in);
+	fail_unless(sdi != NULL, "Device instance is not ready.");
+	sr_session_dev_add(session, sdi);
+	if (transform) {
+		tmod = sr_transform_find(transform);
+		fail_unless(tmod != NULL, "Failed to find transform module.");
+		fail_unless(sr_transform_new(tmod, NULL, sdi) != NULL,
+			"Failed to create transform instance.");
+	}
+	ret = sr_input_end(in);
+	fail_unless(ret == SR_OK, "sr_input_end() error: %d", ret);
+	fail_unless(have_seen_df_end, "No SR_DF_END was seen.");
+	sr_input_free(in);
+
+	sr_session_destroy(session);
+
+	fail_unless(g_file_get_contents(filename, &contents, &length, NULL),
+		"Failed to read temporary file.");
+	fail_unless(length == size && !memcmp(contents, buf, size),
+		"Content of the mapped file has changed.");
+	g_free(contents);
+
+	g_unlink(filename);
+	g_free(filename);
+}
+
 START_TEST(test_input_binary_all_low)
 {
 	uint64_t i, samplerate;
@@ -308,6 +388,119 @@ START_TEST(test_input_binary_hello_world)
 }
 END_TEST
 
+START_TEST(test_input_binary_mapped)
+{
+	uint8_t *buf;
+
+	buf = (uint8_t *)g_strdup("Hello world");
+	check_file(NULL, buf, 11, CHECK_HELLO_WORLD, 11, NULL);
+	g_free(buf);
+
+	buf = g_malloc(BUFSIZE);
+	memset(buf, 0xff, BUFSIZE);
+	check_file(NULL, buf, BUFSIZE, CHECK_ALL_HIGH, BUFSIZE, NULL);
+	g_free(buf);
+}
+END_TEST
+
+/* Transforms modify packets in place, which reference the mapping. */
+START_TEST(test_input_binary_mapped_transform)
+{
+	uint8_t *buf;
+
+	buf = g_malloc(BUFSIZE);
+	memset(buf, 0xff, BUFSIZE);
+	check_file(NULL, buf, BUFSIZE, CHECK_ALL_LOW, BUFSIZE, "invert");
+	g_free(buf);
+}
+END_TEST
+
+/*
+ * Feed patterned samples through a channel selection, and compare the
+ * result with a bit by bit repacking of the selected channels.
+ */
+static void check_channel_subset(int num_channels, int unitsize,
+		const char *spec, const int *channels, size_t count)
+{
+	GHashTable *options;
+	uint8_t *buf, *expected;
+	const uint8_t masks[] = { 0x55, 0xaa, 0x0f, 0xf0, 0x3c };
+	uint64_t i, samples;
+	size_t out_unitsize, ch;
+	const uint8_t *sample;
+
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, g_strdup("numchannels"),
+		g_variant_ref_sink(g_variant_new_int32(num_channels)));
+	g_hash_table_insert(options, g_strdup("unitsize"),
+		g_variant_ref_sink(g_variant_new_int32(unitsize)));
+	g_hash_table_insert(options, g_strdup("channels"),
+		g_variant_ref_sink(g_variant_new_string(spec)));
+
+	buf = g_malloc(BUFSIZE);
+	for (i = 0; i < BUFSIZE; i++)
+		buf[i] = masks[i % ARRAY_SIZE(masks)] ^ (i / 7);
+
+	samples = BUFSIZE / unitsize;
+	out_unitsize = (count + 7) / 8;
+	expected = g_malloc0(samples * out_unitsize);
+	for (i = 0; i < samples; i++) {
+		sample = &buf[i * unitsize];
+		for (ch = 0; ch < count; ch++) {
+			if (sample[channels[ch] / 8] & (1 << (channels[ch] % 8)))
+				expected[i * out_unitsize + ch / 8] |= 1 << (ch % 8);
+		}
+	}
+
+	expected_data = expected;
+	expected_unitsize = out_unitsize;
+	check_file(options, buf, BUFSIZE, CHECK_EXPECTED, samples, NULL);
+
+	g_free(expected);
+	g_free(buf);
+	g_hash_table_destroy(options);
+}
+
+START_TEST(test_input_binary_channel_subset)
+{
+	int channels[80];
+	size_t i, count;
+
+	/* Eight of 16 channels, from 3 byte samples, become 1 byte samples. */
+	for (i = 0; i < 8; i++)
+		channels[i] = 4 + i;
+	check_channel_subset(16, 3, "4-11", channels, 8);
+
+	/* Reordered channels, and more than 64 of them. */
+	count = 0;
+	for (i = 70; i < 80; i++)
+		channels[count++] = i;
+	channels[count++] = 5;
+	for (i = 8; i < 69; i++)
+		channels[count++] = i;
+	check_channel_subset(80, 10, "70-79,5,8-68", channels, count);
+
+	/* All channels but the first one, with padding. */
+	count = 0;
+	for (i = 1; i < 72; i++)
+		channels[count++] = i;
+	check_channel_subset(72, 12, "1-71", channels, count);
+
+	/* Some bits of each byte last, which needs more gather tables. */
+	count = 0;
+	for (i = 0; i < 72; i++) {
+		if (i % 8 != 1 || i >= 64)
+			channels[count++] = i;
+	}
+	for (i = 1; i < 64; i += 8)
+		channels[count++] = i;
+	check_channel_subset(72, 9,
+		"0,2-8,10-16,18-24,26-32,34-40,42-48,50-56,58-71,1,9,17,25,33,41,49,57",
+		channels, count);
+}
+END_TEST
+
 Suite *suite_input_binary(void)
 {
 	Suite *s;
@@ -321,6 +514,9 @@ Suite *suite_input_binary(void)
 	tcase_add_test(tc, test_input_binary_all_high);
 	tcase_add_loop_test(tc, test_input_binary_all_high_loop, 1, 10);
 	tcase_add_test(tc, test_input_binary_hello_world);
+	tcase_add_test(tc, test_input_binary_mapped);
+	tcase_add_test(tc, test_input_binary_mapped_transform);
+	tcase_add_test(tc, test_input_binary_channel_subset);
 	suite_add_tcase(s, tc);
 
 	return s;
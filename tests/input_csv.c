@@ -0,0 +1,372 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "lib.h"
+
+static GHashTable *csv_options(const char *column_formats)
+{
+	GHashTable *options;
+
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, g_strdup("column_formats"),
+		g_variant_ref_sink(g_variant_new_string(column_formats)));
+
+	return options;
+}
+
+/*
+ * Analog columns get converted by the CSV module's own number parser.
+ * Its values must match g_ascii_strtod(), bit for bit, and it must
+ * reject the text which g_ascii_strtod() does not fully consume.
+ */
+static void check_analog_values(const char **values, size_t count)
+{
+	struct srtest_input_data result;
+	GHashTable *options;
+	GString *text;
+	float expected, value;
+	size_t i;
+	int ret;
+
+	text = g_string_new("v\n");
+	for (i = 0; i < count; i++)
+		g_string_append_printf(text, "%s\n", values[i]);
+
+	options = csv_options("a");
+	ret = srtest_input_run("csv", options, text->str, text->len, 0,
+		&result);
+	fail_unless(ret == SR_OK, "CSV input failed: %d.", ret);
+	fail_unless(result.analog[0]->len == count,
+		"Got %u analog values, expected %zu.",
+		result.analog[0]->len, count);
+	for (i = 0; i < count; i++) {
+		expected = g_ascii_strtod(values[i], NULL);
+		value = g_array_index(result.analog[0], float, i);
+		fail_unless(!memcmp(&value, &expected, sizeof(value)),
+			"'%s' was read as %a, expected %a.",
+			values[i], value, expected);
+	}
+
+	srtest_input_data_free(&result);
+	g_hash_table_destroy(options);
+	g_string_free(text, TRUE);
+}
+
+static void check_analog_invalid(const char *value)
+{
+	struct srtest_input_data result;
+	GHashTable *options;
+	char *text, *end;
+	int ret;
+
+	errno = 0;
+	g_ascii_strtod(value, &end);
+	fail_unless(end == value || *end || errno,
+		"g_ascii_strtod() accepts '%s'.", value);
+
+	text = g_strdup_printf("v\n%s\n", value);
+	options = csv_options("a");
+	ret = srtest_input_run("csv", options, text, strlen(text), 0,
+		&result);
+	fail_unless(ret != SR_OK, "Analog text '%s' was accepted.", value);
+
+	srtest_input_data_free(&result);
+	g_hash_table_destroy(options);
+	g_free(text);
+}
+
+START_TEST(test_input_csv_analog_boundaries)
+{
+	GPtrArray *values;
+	uint64_t mantissa, scale;
+	int i, exponent;
+	const char *fixed[] = {
+		"9007199254740993", "900719925474099.3", "0.9007199254740993",
+		/* Around the exact powers of ten. */
+		"1e22", "1e23", "1e-22", "1e-23", "3.7e22", "3.7e-21",
+		"3.7e-22", "12.5e-23", "0.001e25",
+		/* 19 digits get collected, 20 do not. */
+		"1234567890123456789", "12345678901234567890",
+		"0.1234567890123456789", "0.12345678901234567890",
+		"0.0000000000000000001", "0.00000000000000000001234",
+		"4503599627.370497", "123456789.01234567890e-5",
+	};
+
+	values = g_ptr_array_new_with_free_func(g_free);
+	for (i = -2; i <= 2; i++) {
+		mantissa = (UINT64_C(1) << 53) + i;
+		for (exponent = -24; exponent <= 24; exponent++) {
+			g_ptr_array_add(values, g_strdup_printf(
+				"%" PRIu64 "e%d", mantissa, exponent));
+			g_ptr_array_add(values, g_strdup_printf(
+				"-%" PRIu64 "e%d", mantissa, exponent));
+		}
+	}
+	/*
+	 * Halfway between two floats. Any rounding error in the double
+	 * result tips the conversion to float away from the even neighbour.
+	 */
+	for (i = 0; i < 4; i++) {
+		mantissa = (UINT64_C(1) << 24) + 2 * i + 1;
+		scale = 1;
+		for (exponent = 0; exponent <= 8; exponent++) {
+			g_ptr_array_add(values, g_strdup_printf(
+				"%" PRIu64 "e-%d", mantissa * scale, exponent));
+			scale *= 10;
+		}
+	}
+	for (i = 0; i < (int)ARRAY_SIZE(fixed); i++)
+		g_ptr_array_add(values, g_strdup(fixed[i]));
+
+	check_analog_values((const char **)values->pdata, values->len);
+	g_ptr_array_free(values, TRUE);
+}
+END_TEST
+
+START_TEST(test_input_csv_analog_special)
+{
+	const char *values[] = {
+		"0", "-0", "+0", "-0.0", "-0e5", "000123.5", "0.000123",
+		"-.000001", "1.", ".5", "-.5e1", "1E+2", "inf", "nan", "0x1p3",
+	};
+	const char *invalid[] = {
+		".", "-", "1e", "1e+", "e5", "1.5x", "1e400", "1e-400",
+	};
+	unsigned int i;
+
+	check_analog_values(values, ARRAY_SIZE(values));
+	for (i = 0; i < ARRAY_SIZE(invalid); i++)
+		check_analog_invalid(invalid[i]);
+}
+END_TEST
+
+/*
+ * The lines get split in place, check the parts of the text which the
+ * scanner must skip or cut off: lines before the start line, the header
+ * line, comments, empty lines, multi-character separators, and CR LF
+ * line ends, with a last line which has none.
+ */
+START_TEST(test_input_csv_scanner)
+{
+	const char *text =
+		"not CSV\r\n"
+		"time||a||nib||v\r\n"
+		"0||1||a||1.5 // comment\r\n"
+		"\r\n"
+		"// only a comment\r\n"
+		"1||0||5||-2\r\n"
+		"2||1||f||0.25";
+	const uint8_t expected_logic[] = { 0x15, 0x0a, 0x1f };
+	const float expected_analog[] = { 1.5, -2, 0.25 };
+	struct srtest_input_data result;
+	GHashTable *options;
+	size_t chunk;
+	int ret;
+
+	options = csv_options("-,l,x4,a");
+	g_hash_table_insert(options, g_strdup("start_line"),
+		g_variant_ref_sink(g_variant_new_uint32(2)));
+	g_hash_table_insert(options, g_strdup("header"),
+		g_variant_ref_sink(g_variant_new_boolean(TRUE)));
+	g_hash_table_insert(options, g_strdup("column_separator"),
+		g_variant_ref_sink(g_variant_new_string("||")));
+	g_hash_table_insert(options, g_strdup("comment_leader"),
+		g_variant_ref_sink(g_variant_new_string("//")));
+
+	/* At once, and in pieces which split lines and separators. */
+	for (chunk = 0; chunk <= 5; chunk += 5) {
+		ret = srtest_input_run("csv", options, text, strlen(text),
+			chunk, &result);
+		fail_unless(ret == SR_OK, "CSV input failed: %d.", ret);
+		fail_unless(result.unitsize == 1, "Unit size is %u.",
+			result.unitsize);
+		fail_unless(result.logic->len == sizeof(expected_logic)
+			&& !memcmp(result.logic->data, expected_logic,
+			sizeof(expected_logic)),
+			"Unexpected logic samples in chunks of %zu bytes.", chunk);
+		fail_unless(result.analog[0]->len == ARRAY_SIZE(expected_analog)
+			&& !memcmp(result.analog[0]->data, expected_analog,
+			sizeof(expected_analog)),
+			"Unexpected analog samples in chunks of %zu bytes.", chunk);
+		fail_unless(result.channel_names->len == 6
+			&& !strcmp(result.channel_names->pdata[0], "a")
+			&& !strcmp(result.channel_names->pdata[5], "v"),
+			"Unexpected channel names in chunks of %zu bytes.", chunk);
+		srtest_input_data_free(&result);
+	}
+
+	g_hash_table_destroy(options);
+}
+END_TEST
+
+/*
+ * Text which the CSV module parses in several threads: more than four
+ * times the minimum amount of text per thread. One line can be made
+ * invalid.
+ */
+#define THREAD_TEST_LINES 120000
+
+static GString *thread_test_text(int bad_line)
+{
+	GString *text;
+	int i;
+
+	text = g_string_new("clk,nibble,value\n");
+	for (i = 0; i < THREAD_TEST_LINES; i++) {
+		if (i == bad_line)
+			g_string_append(text, "1,g,0.5\n");
+		else
+			g_string_append_printf(text, "%d,%x,%d.5\n",
+				i & 1, (i / 3) & 15, i % 1000);
+	}
+
+	return text;
+}
+
+static int thread_test_run(const GString *text, unsigned int threads,
+		size_t chunk, struct srtest_input_data *result)
+{
+	GHashTable *options;
+	int ret;
+
+	options = csv_options("l,x4,a");
+	g_hash_table_insert(options, g_strdup("threads"),
+		g_variant_ref_sink(g_variant_new_uint32(threads)));
+	ret = srtest_input_run("csv", options, text->str, text->len, chunk,
+		result);
+	g_hash_table_destroy(options);
+
+	return ret;
+}
+
+/*
+ * The samples of text which gets parsed in several threads must be
+ * the same as from one thread, and in the order of the text. Chunks
+ * of input text end within lines, and leave a partial line for the
+ * next chunk.
+ */
+START_TEST(test_input_csv_threads)
+{
+	struct srtest_input_data result;
+	GString *text;
+	unsigned int threads;
+	size_t chunk;
+	int i, ret;
+	uint8_t logic;
+	float analog;
+
+	text = thread_test_text(-1);
+	for (threads = 1; threads <= 4; threads += 3) {
+		for (chunk = 0; chunk <= 700001; chunk += 700001) {
+			ret = thread_test_run(text, threads, chunk, &result);
+			fail_unless(ret == SR_OK, "CSV input failed: %d.", ret);
+			fail_unless(result.logic->len == THREAD_TEST_LINES
+				&& result.analog[0]->len == THREAD_TEST_LINES,
+				"Got %u logic and %u analog samples.",
+				result.logic->len, result.analog[0]->len);
+			for (i = 0; i < THREAD_TEST_LINES; i++) {
+				logic = (i & 1) | (((i / 3) & 15) << 1);
+				analog = i % 1000 + 0.5;
+				if (result.logic->data[i] != logic || g_array_index(
+						result.analog[0], float, i) != analog)
+					break;
+			}
+			fail_unless(i == THREAD_TEST_LINES,
+				"Sample %d differs, %u threads, %zu byte chunks.",
+				i, threads, chunk);
+			srtest_input_data_free(&result);
+		}
+	}
+	g_string_free(text, TRUE);
+}
+END_TEST
+
+static int collect_errors(void *cb_data, int loglevel, const char *format,
+		va_list args)
+{
+	if (loglevel == SR_LOG_ERR && !((GString *)cb_data)->len)
+		g_string_append_vprintf(cb_data, format, args);
+
+	return SR_OK;
+}
+
+/*
+ * An invalid line in a later slice of the text must be reported the
+ * same way as when all lines get parsed in one thread.
+ */
+START_TEST(test_input_csv_threads_error)
+{
+	struct srtest_input_data result;
+	GString *text, *error, *thread_error;
+	int ret;
+
+	text = thread_test_text(100000);
+	error = g_string_new(NULL);
+	thread_error = g_string_new(NULL);
+
+	sr_log_callback_set(collect_errors, error);
+	ret = thread_test_run(text, 1, 0, &result);
+	fail_unless(ret != SR_OK, "Invalid line was accepted.");
+	srtest_input_data_free(&result);
+	sr_log_callback_set(collect_errors, thread_error);
+	ret = thread_test_run(text, 4, 0, &result);
+	fail_unless(ret != SR_OK, "Invalid line was accepted in threads.");
+	srtest_input_data_free(&result);
+	sr_log_callback_set_default();
+
+	/* The header is line 1. */
+	fail_unless(strstr(error->str, "line 100002") != NULL,
+		"Unexpected error: %s", error->str);
+	fail_unless(!strcmp(error->str, thread_error->str),
+		"Error '%s' from threads, expected '%s'.",
+		thread_error->str, error->str);
+
+	g_string_free(error, TRUE);
+	g_string_free(thread_error, TRUE);
+	g_string_free(text, TRUE);
+}
+END_TEST
+
+Suite *suite_input_csv(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("input-csv");
+
+	tc = tcase_create("analog");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_input_csv_analog_boundaries);
+	tcase_add_test(tc, test_input_csv_analog_special);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("parse");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_input_csv_scanner);
+	tcase_add_test(tc, test_input_csv_threads);
+	tcase_add_test(tc, test_input_csv_threads_error);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
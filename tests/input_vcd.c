@@ -0,0 +1,158 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "lib.h"
+
+/*
+ * Run VCD text through the input module, all at once and in small
+ * pieces which split lines and tokens. Both must give the expected
+ * samples.
+ */
+static void check_vcd(const char *text, const uint8_t *expected,
+		size_t count, unsigned int unitsize)
+{
+	struct srtest_input_data result;
+	size_t chunk;
+	int ret;
+
+	for (chunk = 0; chunk <= 7; chunk += 7) {
+		ret = srtest_input_run("vcd", NULL, text, strlen(text), chunk,
+			&result);
+		fail_unless(ret == SR_OK, "VCD input failed: %d.", ret);
+		fail_unless(result.have_end, "No SR_DF_END was seen.");
+		fail_unless(result.unitsize == unitsize,
+			"Unit size is %u, expected %u.", result.unitsize, unitsize);
+		fail_unless(result.logic->len == count * unitsize
+			&& !memcmp(result.logic->data, expected, count * unitsize),
+			"Unexpected samples in chunks of %zu bytes.", chunk);
+		srtest_input_data_free(&result);
+	}
+}
+
+/*
+ * Single character identifiers are looked up in a table, longer ones
+ * in a hash table. Unknown identifiers must not change any channel.
+ */
+START_TEST(test_input_vcd_identifiers)
+{
+	const char *text =
+		"$timescale 1 us $end\n"
+		"$var wire 1 ! a $end\n"
+		"$var wire 1 %x b $end\n"
+		"$var wire 1 ~ c $end\n"
+		"$var wire 1 %xy d $end\n"
+		"$enddefinitions $end\n"
+		"#0 0! 1%x 0~ 1%xy\n"
+		"#2 1! 0%xy\n"
+		"#3 0%x 1~ 1% 1x\n"
+		"#5 1 %xy 0!\n"
+		"#6\n";
+	const uint8_t expected[] = { 0x0a, 0x0a, 0x03, 0x05, 0x05, 0x0c };
+
+	check_vcd(text, expected, ARRAY_SIZE(expected), 1);
+}
+END_TEST
+
+/*
+ * Vectors become one channel per bit, least significant bit first,
+ * named after the bit numbers of their "[msb:lsb]" suffix. Values get
+ * extended or truncated to the size of the vector.
+ */
+START_TEST(test_input_vcd_vectors)
+{
+	const char *text =
+		"$timescale 1 us $end\n"
+		"$var wire 4 # data [3:0] $end\n"
+		"$var wire 3 $ rev[0:2] $end\n"
+		"$var wire 1 ! clk $end\n"
+		"$var wire 2 % bus $end\n"
+		"$enddefinitions $end\n"
+		"#0 b1010 # b011 $ 1! b1 %\n"
+		"#3 bx1 # b10 %\n"
+		"#4 b111111 $\n"
+		"#8\n";
+	const uint8_t expected[] = {
+		0xba, 0x01, 0xba, 0x01, 0xba, 0x01, 0xb1, 0x02,
+		0xf1, 0x02, 0xf1, 0x02, 0xf1, 0x02, 0xf1, 0x02,
+	};
+	const char *names[] = {
+		"data[0]", "data[1]", "data[2]", "data[3]",
+		"rev[2]", "rev[1]", "rev[0]", "clk", "bus[0]", "bus[1]",
+	};
+	struct srtest_input_data result;
+	unsigned int i;
+	int ret;
+
+	check_vcd(text, expected, ARRAY_SIZE(expected) / 2, 2);
+
+	ret = srtest_input_run("vcd", NULL, text, strlen(text), 0, &result);
+	fail_unless(ret == SR_OK, "VCD input failed: %d.", ret);
+	fail_unless(result.channel_names->len == ARRAY_SIZE(names),
+		"Got %u channels, expected %zu.",
+		result.channel_names->len, ARRAY_SIZE(names));
+	for (i = 0; i < MIN(result.channel_names->len, ARRAY_SIZE(names)); i++) {
+		fail_unless(!strcmp(result.channel_names->pdata[i], names[i]),
+			"Channel %u is '%s', expected '%s'.", i,
+			(char *)result.channel_names->pdata[i], names[i]);
+	}
+	srtest_input_data_free(&result);
+}
+END_TEST
+
+/* Idle periods get filled with the current levels, also across chunks. */
+START_TEST(test_input_vcd_idle)
+{
+	const char *text =
+		"$timescale 1 us $end\n"
+		"$var wire 1 ! a $end\n"
+		"$var wire 8 \" d $end\n"
+		"$enddefinitions $end\n"
+		"#0 1! b10000001 \"\n"
+		"#1000 0!\n"
+		"#5000000\n";
+	GByteArray *expected;
+	const uint8_t first[] = { 0x03, 0x01 }, second[] = { 0x02, 0x01 };
+	unsigned int i;
+
+	expected = g_byte_array_new();
+	for (i = 0; i < 5000000; i++)
+		g_byte_array_append(expected, i < 1000 ? first : second, 2);
+	check_vcd(text, expected->data, expected->len / 2, 2);
+	g_byte_array_free(expected, TRUE);
+}
+END_TEST
+
+Suite *suite_input_vcd(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("input-vcd");
+
+	tc = tcase_create("parse");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_input_vcd_identifiers);
+	tcase_add_test(tc, test_input_vcd_vectors);
+	tcase_add_test(tc, test_input_vcd_idle);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
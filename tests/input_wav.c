@@ -0,0 +1,232 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "lib.h"
+
+enum {
+	WAV_RIFF,
+	WAV_RF64,
+	WAV_W64,
+};
+
+static const char *container_names[] = { "RIFF", "RF64", "Wave64" };
+
+static const uint8_t w64_riff_guid[] = {
+	'r', 'i', 'f', 'f', 0x2e, 0x91, 0xcf, 0x11,
+	0xa5, 0xd6, 0x28, 0xdb, 0x04, 0xc1, 0x00, 0x00,
+};
+
+static const uint8_t w64_guid_tail[] = {
+	0xf3, 0xac, 0xd3, 0x11, 0x8c, 0xd1, 0x00, 0xc0,
+	0x4f, 0x8e, 0xdb, 0x8a,
+};
+
+/* Stereo 16-bit samples, and a partial frame at the end. */
+static const int16_t wav_samples[] = {
+	0, 1, -1, INT16_MAX, -INT16_MAX, 100, 16384, -16384, 7, -7, 12345,
+};
+
+#define WAV_FRAMES (ARRAY_SIZE(wav_samples) / 2)
+
+static void append_le(GByteArray *file, uint64_t value, unsigned int size)
+{
+	uint8_t byte;
+
+	while (size--) {
+		byte = value & 0xff;
+		g_byte_array_append(file, &byte, 1);
+		value >>= 8;
+	}
+}
+
+/*
+ * Append a chunk and its padding: to an even size for RIFF, and to a
+ * multiple of eight bytes for Wave64, whose sizes include the header.
+ */
+static void append_chunk(GByteArray *file, int container, const char *id,
+		const void *data, size_t len)
+{
+	const uint8_t zeros[8] = { 0 };
+
+	g_byte_array_append(file, (const uint8_t *)id, 4);
+	if (container == WAV_W64) {
+		g_byte_array_append(file, w64_guid_tail, sizeof(w64_guid_tail));
+		append_le(file, len + 24, 8);
+		g_byte_array_append(file, data, len);
+		g_byte_array_append(file, zeros, (8 - len % 8) % 8);
+	} else {
+		append_le(file, len, 4);
+		g_byte_array_append(file, data, len);
+		g_byte_array_append(file, zeros, len % 2);
+	}
+}
+
+/*
+ * Build a file with the test samples in the given container. Chunks
+ * of odd size surround the format and sample data chunks. RF64 files
+ * take the size of their "data" chunk from the "ds64" chunk.
+ */
+static GByteArray *wav_file(int container, gboolean with_ds64)
+{
+	GByteArray *file, *fmt, *data, *ds64;
+	size_t offset;
+	unsigned int i;
+
+	fmt = g_byte_array_new();
+	append_le(fmt, 0x0001, 2);
+	append_le(fmt, 2, 2);
+	append_le(fmt, 48000, 4);
+	append_le(fmt, 48000 * 4, 4);
+	append_le(fmt, 4, 2);
+	append_le(fmt, 16, 2);
+	data = g_byte_array_new();
+	for (i = 0; i < ARRAY_SIZE(wav_samples); i++)
+		append_le(data, (uint16_t)wav_samples[i], 2);
+
+	file = g_byte_array_new();
+	if (container == WAV_W64) {
+		g_byte_array_append(file, w64_riff_guid, sizeof(w64_riff_guid));
+		append_le(file, 0, 8);
+		g_byte_array_append(file, (const uint8_t *)"wave", 4);
+		g_byte_array_append(file, w64_guid_tail, sizeof(w64_guid_tail));
+	} else {
+		g_byte_array_append(file,
+			(const uint8_t *)(container == WAV_RF64 ? "RF64" : "RIFF"), 4);
+		append_le(file, 0, 4);
+		g_byte_array_append(file, (const uint8_t *)"WAVE", 4);
+	}
+	if (container == WAV_RF64 && with_ds64) {
+		ds64 = g_byte_array_new();
+		append_le(ds64, 0, 8);
+		append_le(ds64, data->len, 8);
+		append_le(ds64, WAV_FRAMES, 8);
+		append_le(ds64, 0, 4);
+		append_chunk(file, container, "ds64", ds64->data, ds64->len);
+		g_byte_array_free(ds64, TRUE);
+	}
+	append_chunk(file, container, "JUNK", "abc", 3);
+	append_chunk(file, container, "fmt ", fmt->data, fmt->len);
+	offset = file->len;
+	append_chunk(file, container, "data", data->data, data->len);
+	if (container == WAV_RF64)
+		memset(file->data + offset + 4, 0xff, 4);
+	append_chunk(file, container, "LIST", "defgh", 5);
+
+	/* Fill in the size of the form. */
+	if (container == WAV_W64) {
+		for (i = 0; i < 8; i++)
+			file->data[16 + i] = (uint64_t)file->len >> (8 * i);
+	} else if (container == WAV_RIFF) {
+		for (i = 0; i < 4; i++)
+			file->data[4 + i] = (file->len - 8) >> (8 * i);
+	} else {
+		memset(file->data + 4, 0xff, 4);
+	}
+
+	g_byte_array_free(fmt, TRUE);
+	g_byte_array_free(data, TRUE);
+
+	return file;
+}
+
+/*
+ * All containers give the same samples, also when their chunk headers
+ * get split across receive calls. Chunks around the sample data get
+ * skipped, as does the partial frame at its end.
+ */
+START_TEST(test_input_wav_containers)
+{
+	struct srtest_input_data result;
+	GByteArray *file;
+	int container, ret;
+	size_t chunk;
+	unsigned int i, ch;
+	float expected;
+
+	for (container = WAV_RIFF; container <= WAV_W64; container++) {
+		file = wav_file(container, TRUE);
+		for (chunk = 0; chunk <= 7; chunk += 7) {
+			ret = srtest_input_run("wav", NULL, (const char *)file->data,
+				file->len, chunk, &result);
+			fail_unless(ret == SR_OK, "%s input failed: %d.",
+				container_names[container], ret);
+			fail_unless(result.have_end, "No SR_DF_END was seen.");
+			fail_unless(result.samplerate == 48000,
+				"Samplerate is %" PRIu64 ".", result.samplerate);
+			fail_unless(result.channel_names->len == 2,
+				"Got %u channels.", result.channel_names->len);
+			for (ch = 0; ch < 2; ch++) {
+				fail_unless(result.analog[ch]->len == WAV_FRAMES,
+					"%s channel %u has %u samples, %zu byte chunks.",
+					container_names[container], ch,
+					result.analog[ch]->len, chunk);
+				for (i = 0; i < MIN(result.analog[ch]->len, WAV_FRAMES); i++) {
+					expected = wav_samples[i * 2 + ch] / (float)INT16_MAX;
+					fail_unless(g_array_index(result.analog[ch], float, i) == expected,
+						"%s channel %u sample %u is %f, expected %f.",
+						container_names[container], ch, i,
+						g_array_index(result.analog[ch], float, i),
+						expected);
+				}
+			}
+			srtest_input_data_free(&result);
+		}
+		g_byte_array_free(file, TRUE);
+	}
+}
+END_TEST
+
+/* RF64 files don't have the size of their sample data without "ds64". */
+START_TEST(test_input_wav_rf64_no_ds64)
+{
+	struct srtest_input_data result;
+	GByteArray *file;
+	size_t chunk;
+	int ret;
+
+	file = wav_file(WAV_RF64, FALSE);
+	for (chunk = 0; chunk <= 7; chunk += 7) {
+		ret = srtest_input_run("wav", NULL, (const char *)file->data,
+			file->len, chunk, &result);
+		fail_unless(ret != SR_OK,
+			"RF64 without ds64 was accepted, %zu byte chunks.", chunk);
+		fail_unless(!result.analog[0]->len, "Got samples.");
+		srtest_input_data_free(&result);
+	}
+	g_byte_array_free(file, TRUE);
+}
+END_TEST
+
+Suite *suite_input_wav(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("input-wav");
+
+	tc = tcase_create("chunks");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_input_wav_containers);
+	tcase_add_test(tc, test_input_wav_rf64_no_ds64);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
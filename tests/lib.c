@@ -160,3 +160,147 @@ GArray *srtest_get_enabled_logic_channels(const struct sr_dev_inst *sdi)
 
 	return channels;
 }
+
+/* Index of an analog channel among the device's analog channels. */
+static unsigned int analog_channel_pos(const struct sr_dev_inst *sdi,
+		const struct sr_channel *channel)
+{
+	struct sr_channel *ch;
+	unsigned int pos;
+	GSList *l;
+
+	pos = 0;
+	for (l = sr_dev_inst_channels_get(sdi); l; l = l->next) {
+		ch = l->data;
+		if (ch == channel)
+			break;
+		if (ch->type == SR_CHANNEL_ANALOG)
+			pos++;
+	}
+
+	return pos;
+}
+
+static void collect_input_data(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct srtest_input_data *result;
+	const struct sr_datafeed_meta *meta;
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_analog *analog;
+	struct sr_config *src;
+	unsigned int pos;
+	float *values;
+	GSList *l;
+	int ret;
+
+	result = cb_data;
+	fail_unless(!result->have_end, "Packet after SR_DF_END.");
+
+	switch (packet->type) {
+	case SR_DF_META:
+		meta = packet->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key == SR_CONF_SAMPLERATE)
+				result->samplerate = g_variant_get_uint64(src->data);
+		}
+		break;
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		fail_unless(!result->unitsize
+			|| result->unitsize == logic->unitsize,
+			"Unit size changed from %u to %u.",
+			result->unitsize, logic->unitsize);
+		result->unitsize = logic->unitsize;
+		g_byte_array_append(result->logic, logic->data, logic->length);
+		break;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		fail_unless(g_slist_length(analog->meaning->channels) == 1,
+			"Analog packet for more than one channel.");
+		pos = analog_channel_pos(sdi, analog->meaning->channels->data);
+		fail_unless(pos < SRTEST_ANALOG_CHANNELS,
+			"Too many analog channels.");
+		values = g_malloc_n(analog->num_samples, sizeof(float));
+		ret = sr_analog_to_float(analog, values);
+		fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d.", ret);
+		g_array_append_vals(result->analog[pos], values,
+			analog->num_samples);
+		g_free(values);
+		break;
+	case SR_DF_END:
+		result->have_end = TRUE;
+		break;
+	}
+}
+
+/*
+ * Feed text to an input module in chunks of the given size (all of it
+ * at once for 0), and collect the module's output. Returns the first
+ * error of sr_input_send() or sr_input_end().
+ */
+int srtest_input_run(const char *id, GHashTable *options,
+		const char *text, size_t length, size_t chunk,
+		struct srtest_input_data *result)
+{
+	const struct sr_input_module *imod;
+	struct sr_input *in;
+	struct sr_session *session;
+	struct sr_dev_inst *sdi;
+	struct sr_channel *ch;
+	GString *buf;
+	GSList *l;
+	size_t pos, count;
+	unsigned int i;
+	int ret;
+
+	memset(result, 0, sizeof(*result));
+	result->logic = g_byte_array_new();
+	result->channel_names = g_ptr_array_new_with_free_func(g_free);
+	for (i = 0; i < SRTEST_ANALOG_CHANNELS; i++)
+		result->analog[i] = g_array_new(FALSE, FALSE, sizeof(float));
+
+	imod = sr_input_find((char *)id);
+	fail_unless(imod != NULL, "Failed to find input module '%s'.", id);
+	in = sr_input_new(imod, options);
+	fail_unless(in != NULL, "Failed to create input instance.");
+
+	sr_session_new(srtest_ctx, &session);
+	sr_session_datafeed_callback_add(session, collect_input_data, result);
+
+	ret = SR_OK;
+	sdi = NULL;
+	buf = g_string_sized_new(chunk ? chunk : length);
+	for (pos = 0; ret == SR_OK && pos < length; pos += count) {
+		count = chunk ? MIN(chunk, length - pos) : length;
+		g_string_assign(buf, "");
+		g_string_append_len(buf, text + pos, count);
+		ret = sr_input_send(in, buf);
+		/* Like frontends, add the device once it is ready. */
+		if (!sdi && (sdi = sr_input_dev_inst_get(in)))
+			sr_session_dev_add(session, sdi);
+	}
+	g_string_free(buf, TRUE);
+	if (ret == SR_OK)
+		ret = sr_input_end(in);
+
+	for (l = sdi ? sr_dev_inst_channels_get(sdi) : NULL; l; l = l->next) {
+		ch = l->data;
+		g_ptr_array_add(result->channel_names, g_strdup(ch->name));
+	}
+	sr_input_free(in);
+	sr_session_destroy(session);
+
+	return ret;
+}
+
+void srtest_input_data_free(struct srtest_input_data *result)
+{
+	unsigned int i;
+
+	g_byte_array_free(result->logic, TRUE);
+	g_ptr_array_free(result->channel_names, TRUE);
+	for (i = 0; i < SRTEST_ANALOG_CHANNELS; i++)
+		g_array_free(result->analog[i], TRUE);
+}
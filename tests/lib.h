@@ -41,10 +41,32 @@ void srtest_check_samplerate(struct sr_context *sr_ctx, const char *drivername,
 
 GArray *srtest_get_enabled_logic_channels(const struct sr_dev_inst *sdi);
 
+#define SRTEST_ANALOG_CHANNELS 4
+
+/* Output of an input module, collected by srtest_input_run(). */
+struct srtest_input_data {
+	GByteArray *logic;
+	unsigned int unitsize;
+	/* Samples per analog channel, in the device's channel order. */
+	GArray *analog[SRTEST_ANALOG_CHANNELS];
+	uint64_t samplerate;
+	gboolean have_end;
+	/* Names of the device's channels. */
+	GPtrArray *channel_names;
+};
+
+int srtest_input_run(const char *id, GHashTable *options,
+		const char *text, size_t length, size_t chunk,
+		struct srtest_input_data *result);
+void srtest_input_data_free(struct srtest_input_data *result);
+
 Suite *suite_core(void);
 Suite *suite_driver_all(void);
 Suite *suite_input_all(void);
 Suite *suite_input_binary(void);
+Suite *suite_input_csv(void);
+Suite *suite_input_vcd(void);
+Suite *suite_input_wav(void);
 Suite *suite_output_all(void);
 Suite *suite_transform_all(void);
 Suite *suite_session(void);
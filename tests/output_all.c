@@ -18,8 +18,11 @@
  */
 
 #include <config.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <check.h>
+#include <glib/gstdio.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
 
@@ -96,6 +99,494 @@ START_TEST(test_output_options)
 }
 END_TEST
 
+/* Check whether sr_output_new_file() rejects a missing file name. */
+START_TEST(test_output_new_file_bogus)
+{
+	const struct sr_output_module *omod;
+
+	omod = sr_output_find("bits");
+	fail_unless(sr_output_new_file(omod, NULL, NULL, NULL) == NULL,
+		"sr_output_new_file() accepted a NULL file name.");
+	fail_unless(sr_output_new_file(omod, NULL, NULL, "") == NULL,
+		"sr_output_new_file() accepted an empty file name.");
+	fail_unless(sr_output_new_file(NULL, NULL, NULL, "x") == NULL,
+		"sr_output_new_file() accepted a NULL module.");
+}
+END_TEST
+
+/* Create a user device with some logic channels. */
+static struct sr_dev_inst *logic_dev_new(int num_channels)
+{
+	struct sr_dev_inst *sdi;
+	char name[8];
+	int i;
+
+	sdi = sr_dev_inst_user_new("test", "logic", NULL);
+	for (i = 0; i < num_channels; i++) {
+		snprintf(name, sizeof(name), "D%d", i);
+		sr_dev_inst_channel_add(sdi, i, SR_CHANNEL_LOGIC, name);
+	}
+
+	return sdi;
+}
+
+/* Check the partial byte at the end of hex lines which are not byte sized. */
+START_TEST(test_output_hex_width)
+{
+	const struct sr_output *o;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	GHashTable *options;
+	GString *out, *text;
+	/* Two lines of 12 samples, "b3 9" and "4c 6" in hex. */
+	const uint8_t data[] = {
+		1, 0, 1, 1, 0, 0, 1, 1, 1, 0, 0, 1,
+		0, 1, 0, 0, 1, 1, 0, 0, 0, 1, 1, 0,
+	};
+
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, g_strdup("width"),
+		g_variant_ref_sink(g_variant_new_uint32(12)));
+	o = sr_output_new(sr_output_find("hex"), options, logic_dev_new(1), NULL);
+	fail_unless(o != NULL, "Failed to create hex output.");
+
+	text = g_string_new(NULL);
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.length = sizeof(data);
+	logic.unitsize = 1;
+	logic.data = (void *)data;
+	fail_unless(sr_output_send(o, &packet, &out) == SR_OK);
+	if (out) {
+		g_string_append_len(text, out->str, out->len);
+		g_string_free(out, TRUE);
+	}
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	fail_unless(sr_output_send(o, &packet, &out) == SR_OK);
+	if (out) {
+		g_string_append_len(text, out->str, out->len);
+		g_string_free(out, TRUE);
+	}
+	fail_unless(strstr(text->str, "\nD0:b3 90 \nD0:4c 60 \n") != NULL,
+		"Unexpected hex output: %s", text->str);
+	fail_unless(g_str_has_suffix(text->str, "D0:4c 60 \n"),
+		"Unexpected hex output after the last line: %s", text->str);
+
+	g_string_free(text, TRUE);
+	sr_output_free(o);
+	g_hash_table_destroy(options);
+}
+END_TEST
+
+/* Send a packet, and append the returned output to a string. */
+static void output_packet(const struct sr_output *o, int type,
+		const void *payload, GString *text)
+{
+	struct sr_datafeed_packet packet;
+	GString *out;
+	int ret;
+
+	packet.type = type;
+	packet.payload = payload;
+	ret = sr_output_send(o, &packet, &out);
+	fail_unless(ret == SR_OK, "sr_output_send() failed: %d.", ret);
+	if (out) {
+		g_string_append_len(text, out->str, out->len);
+		g_string_free(out, TRUE);
+	}
+}
+
+static void output_samplerate(const struct sr_output *o, uint64_t samplerate,
+		GString *text)
+{
+	struct sr_datafeed_meta meta;
+	struct sr_config src;
+
+	src.key = SR_CONF_SAMPLERATE;
+	src.data = g_variant_ref_sink(g_variant_new_uint64(samplerate));
+	meta.config = g_slist_append(NULL, &src);
+	output_packet(o, SR_DF_META, &meta, text);
+	g_slist_free(meta.config);
+	g_variant_unref(src.data);
+}
+
+static void output_logic(const struct sr_output *o, const uint8_t *data,
+		size_t length, unsigned int unitsize, GString *text)
+{
+	struct sr_datafeed_logic logic;
+
+	logic.length = length;
+	logic.unitsize = unitsize;
+	logic.data = (void *)data;
+	output_packet(o, SR_DF_LOGIC, &logic, text);
+}
+
+/* The VCD output after the header, which has the current date. */
+static const char *vcd_body(const GString *text)
+{
+	const char *body;
+
+	body = strstr(text->str, "$enddefinitions $end\n");
+	fail_unless(body != NULL, "No VCD header end in: %s", text->str);
+
+	return body + strlen("$enddefinitions $end\n");
+}
+
+/*
+ * Check VCD timestamps in integer arithmetic, rounded to the timescale,
+ * and continued across packets.
+ */
+START_TEST(test_output_vcd_timestamps)
+{
+	const struct sr_output *o;
+	GString *text;
+	uint8_t data[24];
+
+	/* Changes at samples 2 and 21, runs longer than a machine word. */
+	memset(data, 0, sizeof(data));
+	memset(&data[2], 1, 19);
+
+	o = sr_output_new(sr_output_find("vcd"), NULL, logic_dev_new(1), NULL);
+	fail_unless(o != NULL, "Failed to create VCD output.");
+	text = g_string_new(NULL);
+	/* 3MHz needs a 1GHz timescale, sample 2 is at 666.67ns. */
+	output_samplerate(o, SR_MHZ(3), text);
+	output_logic(o, data, 10, 1, text);
+	output_logic(o, &data[10], sizeof(data) - 10, 1, text);
+	output_packet(o, SR_DF_END, NULL, text);
+
+	fail_unless(strstr(text->str, "$timescale 1 ns $end\n") != NULL,
+		"Unexpected VCD timescale: %s", text->str);
+	fail_unless(!strcmp(vcd_body(text), "#0 0!\n#667 1!\n#7000 0!\n#8000\n"),
+		"Unexpected VCD output: %s", vcd_body(text));
+
+	g_string_free(text, TRUE);
+	sr_output_free(o);
+}
+END_TEST
+
+/* Check the base-94 identifiers of channels beyond the first 94. */
+START_TEST(test_output_vcd_identifiers)
+{
+	const struct sr_output *o;
+	GString *text;
+	uint8_t data[2 * 13];
+
+	/* Channels 0 and 94 change in the second sample. */
+	memset(data, 0, sizeof(data));
+	data[13] = 0x01;
+	data[13 + 94 / 8] = 1 << (94 % 8);
+
+	o = sr_output_new(sr_output_find("vcd"), NULL, logic_dev_new(100), NULL);
+	fail_unless(o != NULL, "Failed to create VCD output.");
+	text = g_string_new(NULL);
+	output_samplerate(o, SR_MHZ(1), text);
+	output_logic(o, data, sizeof(data), 13, text);
+	output_packet(o, SR_DF_END, NULL, text);
+
+	fail_unless(strstr(text->str, "$var wire 1 ! D0 $end\n"
+		"$var wire 1 \" D1 $end\n") != NULL,
+		"Unexpected VCD identifiers: %s", text->str);
+	fail_unless(strstr(text->str, "$var wire 1 ~ D93 $end\n"
+		"$var wire 1 !! D94 $end\n$var wire 1 \"! D95 $end\n") != NULL,
+		"Unexpected VCD identifiers: %s", text->str);
+	fail_unless(strstr(text->str, " 0%! 0&!\n#1 1! 1!!\n#2\n") != NULL,
+		"Unexpected VCD output: %s", vcd_body(text));
+
+	g_string_free(text, TRUE);
+	sr_output_free(o);
+}
+END_TEST
+
+/* Check vectors of channels, written MSB first, and single channels. */
+START_TEST(test_output_vcd_vectors)
+{
+	const struct sr_output *o;
+	GHashTable *options;
+	GString *text;
+	/* D0-D7 are 0x00, 0xa5 and 0xa5, D9 changes in the last sample. */
+	const uint8_t data[] = { 0x00, 0x00, 0xa5, 0x00, 0xa5, 0x02 };
+
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, g_strdup("vectors"),
+		g_variant_ref_sink(g_variant_new_string("data=0-7")));
+	o = sr_output_new(sr_output_find("vcd"), options, logic_dev_new(10), NULL);
+	fail_unless(o != NULL, "Failed to create VCD output.");
+	text = g_string_new(NULL);
+	output_samplerate(o, SR_MHZ(1), text);
+	output_logic(o, data, sizeof(data), 2, text);
+	output_packet(o, SR_DF_END, NULL, text);
+
+	fail_unless(strstr(text->str, "$var wire 8 ! data $end\n"
+		"$var wire 1 \" D8 $end\n$var wire 1 # D9 $end\n") != NULL,
+		"Unexpected VCD variables: %s", text->str);
+	fail_unless(!strcmp(vcd_body(text), "#0 0\" 0# b00000000 !\n"
+		"#1 b10100101 !\n#2 1#\n#3\n"),
+		"Unexpected VCD output: %s", vcd_body(text));
+
+	g_string_free(text, TRUE);
+	sr_output_free(o);
+	g_hash_table_destroy(options);
+}
+END_TEST
+
+/* Options for CSV output of just the values. */
+static GHashTable *csv_options(gboolean dedup)
+{
+	GHashTable *options;
+
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, g_strdup("header"),
+		g_variant_ref_sink(g_variant_new_boolean(FALSE)));
+	g_hash_table_insert(options, g_strdup("label"),
+		g_variant_ref_sink(g_variant_new_string("off")));
+	g_hash_table_insert(options, g_strdup("dedup"),
+		g_variant_ref_sink(g_variant_new_boolean(dedup)));
+
+	return options;
+}
+
+/* Check that analog values get written as the shortest round trip text. */
+START_TEST(test_output_csv_floats)
+{
+	const struct sr_output *o;
+	struct sr_dev_inst *sdi;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	GHashTable *options;
+	GString *text;
+	float data[] = {
+		0.1, 0.3, 3.14159274, 123456.789, 2.5e-6, 16777216, 100, 0, -0.5,
+	};
+
+	sdi = sr_dev_inst_user_new("test", "analog", NULL);
+	sr_dev_inst_channel_add(sdi, 0, SR_CHANNEL_ANALOG, "A0");
+	options = csv_options(FALSE);
+	o = sr_output_new(sr_output_find("csv"), options, sdi, NULL);
+	fail_unless(o != NULL, "Failed to create CSV output.");
+
+	memset(&analog, 0, sizeof(analog));
+	memset(&encoding, 0, sizeof(encoding));
+	memset(&meaning, 0, sizeof(meaning));
+	memset(&spec, 0, sizeof(spec));
+	analog.data = data;
+	analog.num_samples = ARRAY_SIZE(data);
+	analog.encoding = &encoding;
+	analog.meaning = &meaning;
+	analog.spec = &spec;
+	encoding.unitsize = sizeof(float);
+	encoding.is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+	encoding.is_bigendian = TRUE;
+#endif
+	encoding.scale.p = encoding.scale.q = 1;
+	encoding.offset.q = 1;
+	meaning.channels = sr_dev_inst_channels_get(sdi);
+
+	text = g_string_new(NULL);
+	output_packet(o, SR_DF_ANALOG, &analog, text);
+	output_packet(o, SR_DF_END, NULL, text);
+	/* Printing with %g would give 3.14159, 123457 and 2.5e-06. */
+	fail_unless(!strcmp(text->str, "0.1\n0.3\n3.1415927\n123456.79\n"
+		"0.0000025\n16777216\n100\n0\n-0.5\n"),
+		"Unexpected CSV output: %s", text->str);
+
+	g_string_free(text, TRUE);
+	sr_output_free(o);
+	g_hash_table_destroy(options);
+}
+END_TEST
+
+/*
+ * Check that deduplicated CSV output has the rows with changes, and the
+ * last one. Their time column starts at zero and continues across
+ * packets, without a samplerate it is the sample number.
+ */
+START_TEST(test_output_csv_dedup)
+{
+	const struct sr_output *o;
+	GHashTable *options;
+	GString *text;
+	/* D0 changes at sample 2, D1 at sample 5. */
+	const uint8_t data[] = { 0, 0, 1, 1, 1, 3, 3, 3 };
+
+	options = csv_options(TRUE);
+	o = sr_output_new(sr_output_find("csv"), options, logic_dev_new(2), NULL);
+	fail_unless(o != NULL, "Failed to create CSV output.");
+	text = g_string_new(NULL);
+	output_logic(o, data, 4, 1, text);
+	output_logic(o, &data[4], sizeof(data) - 4, 1, text);
+	output_packet(o, SR_DF_END, NULL, text);
+	fail_unless(!strcmp(text->str, "0,0,0\n2,1,0\n5,1,1\n7,1,1\n"),
+		"Unexpected CSV output: %s", text->str);
+
+	g_string_free(text, TRUE);
+	sr_output_free(o);
+	g_hash_table_destroy(options);
+}
+END_TEST
+
+/* More output than the writer thread's three 1 MiB buffers can hold. */
+#define FILE_TEST_SIZE (7 * 1024 * 1024 / 2)
+/* Not a divisor of the buffer size, so packets straddle the buffers. */
+#define FILE_TEST_CHUNK 100000
+
+/* Send a number of logic bytes in chunks, stop at the first error. */
+static int send_logic(const struct sr_output *o, const uint8_t *data,
+		size_t size)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	GString *out;
+	size_t pos;
+	int ret;
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = 1;
+	for (pos = 0; pos < size; pos += logic.length) {
+		logic.length = MIN(FILE_TEST_CHUNK, size - pos);
+		logic.data = (void *)&data[pos];
+		ret = sr_output_send(o, &packet, &out);
+		fail_unless(out == NULL, "File output was returned.");
+		if (ret != SR_OK)
+			return ret;
+	}
+
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	return sr_output_send(o, &packet, &out);
+}
+
+/* Check that the writer thread writes all output to the file. */
+START_TEST(test_output_new_file)
+{
+	const struct sr_output *o;
+	uint8_t *data;
+	char *filename, *contents;
+	gsize length;
+	size_t i;
+	int ret;
+
+	data = g_malloc(FILE_TEST_SIZE);
+	for (i = 0; i < FILE_TEST_SIZE; i++)
+		data[i] = i * 7 + i / 251;
+	filename = g_build_filename(g_get_tmp_dir(),
+		"sr-output-file-test.bin", NULL);
+
+	o = sr_output_new_file(sr_output_find("binary"), NULL,
+		logic_dev_new(8), filename);
+	fail_unless(o != NULL, "Failed to create file output.");
+	ret = send_logic(o, data, FILE_TEST_SIZE);
+	fail_unless(ret == SR_OK, "sr_output_send() failed: %d.", ret);
+	ret = sr_output_free(o);
+	fail_unless(ret == SR_OK, "sr_output_free() failed: %d.", ret);
+
+	fail_unless(g_file_get_contents(filename, &contents, &length, NULL),
+		"Failed to read the output file.");
+	fail_unless(length == FILE_TEST_SIZE,
+		"Output file has %zu bytes, expected %d.",
+		(size_t)length, FILE_TEST_SIZE);
+	fail_unless(!memcmp(contents, data, length),
+		"Output file content differs from the sent data.");
+
+	g_free(contents);
+	g_unlink(filename);
+	g_free(filename);
+	g_free(data);
+}
+END_TEST
+
+/* Check that write errors of the writer thread get reported. */
+START_TEST(test_output_new_file_error)
+{
+	const struct sr_output *o;
+	uint8_t *data;
+	int ret;
+
+	/* Writes to /dev/full fail with ENOSPC. */
+	if (!g_file_test("/dev/full", G_FILE_TEST_EXISTS))
+		return;
+
+	data = g_malloc0(FILE_TEST_SIZE);
+
+	/*
+	 * Filling the third buffer waits for the first one to be written,
+	 * so the error shows up in the sends after that.
+	 */
+	o = sr_output_new_file(sr_output_find("binary"), NULL,
+		logic_dev_new(8), "/dev/full");
+	fail_unless(o != NULL, "Failed to create file output.");
+	ret = send_logic(o, data, FILE_TEST_SIZE);
+	fail_unless(ret == SR_ERR_IO, "Expected SR_ERR_IO, got %d.", ret);
+	ret = sr_output_free(o);
+	fail_unless(ret == SR_ERR_IO, "Expected SR_ERR_IO, got %d.", ret);
+
+	/* Output which fits a buffer is written when freeing the instance. */
+	o = sr_output_new_file(sr_output_find("binary"), NULL,
+		logic_dev_new(8), "/dev/full");
+	fail_unless(o != NULL, "Failed to create file output.");
+	ret = send_logic(o, data, 1000);
+	fail_unless(ret == SR_OK, "sr_output_send() failed: %d.", ret);
+	ret = sr_output_free(o);
+	fail_unless(ret == SR_ERR_IO, "Expected SR_ERR_IO, got %d.", ret);
+
+	g_free(data);
+}
+END_TEST
+
+/* WaveDrom output, which is rendered at the end, is written in pieces. */
+START_TEST(test_output_wavedrom_file)
+{
+	const struct sr_output *o;
+	uint8_t *data;
+	char *filename, *contents;
+	GString *expected;
+	gsize length;
+	size_t i;
+	int ret;
+
+	/* Runs of one million samples, all of them get rendered. */
+	data = g_malloc(FILE_TEST_SIZE);
+	expected = g_string_new("{ \"signal\": [{ \"name\": \"D0\", \"wave\": \"");
+	for (i = 0; i < FILE_TEST_SIZE; i++) {
+		data[i] = (i / 1000000) & 1;
+		if (i % 1000000)
+			g_string_append_c(expected, '.');
+		else
+			g_string_append_c(expected, '0' + data[i]);
+	}
+	g_string_append(expected, "\" }], \"config\": { \"skin\": \"narrow\" }}");
+	filename = g_build_filename(g_get_tmp_dir(),
+		"sr-output-wavedrom-test.json", NULL);
+
+	o = sr_output_new_file(sr_output_find("wavedrom"), NULL,
+		logic_dev_new(1), filename);
+	fail_unless(o != NULL, "Failed to create file output.");
+	ret = send_logic(o, data, FILE_TEST_SIZE);
+	fail_unless(ret == SR_OK, "sr_output_send() failed: %d.", ret);
+	ret = sr_output_free(o);
+	fail_unless(ret == SR_OK, "sr_output_free() failed: %d.", ret);
+
+	fail_unless(g_file_get_contents(filename, &contents, &length, NULL),
+		"Failed to read the output file.");
+	fail_unless(length == expected->len && !memcmp(contents,
+		expected->str, length), "Unexpected WaveDrom output.");
+
+	g_free(contents);
+	g_string_free(expected, TRUE);
+	g_unlink(filename);
+	g_free(filename);
+	g_free(data);
+}
+END_TEST
+
 Suite *suite_output_all(void)
 {
 	Suite *s;
@@ -110,6 +601,20 @@ Suite *suite_output_all(void)
 	tcase_add_test(tc, test_output_desc);
 	tcase_add_test(tc, test_output_find);
 	tcase_add_test(tc, test_output_options);
+	tcase_add_test(tc, test_output_new_file_bogus);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("modules");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_output_hex_width);
+	tcase_add_test(tc, test_output_new_file);
+	tcase_add_test(tc, test_output_new_file_error);
+	tcase_add_test(tc, test_output_wavedrom_file);
+	tcase_add_test(tc, test_output_vcd_timestamps);
+	tcase_add_test(tc, test_output_vcd_identifiers);
+	tcase_add_test(tc, test_output_vcd_vectors);
+	tcase_add_test(tc, test_output_csv_floats);
+	tcase_add_test(tc, test_output_csv_dedup);
 	suite_add_tcase(s, tc);
 
 	return s;
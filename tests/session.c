@@ -18,11 +18,20 @@
  */
 
 #include <config.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <check.h>
+#include <glib/gstdio.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
 
+/* Samples in the session files for replay tests, sample i is i % 251. */
+#define REPLAY_SAMPLES 100000
+
+static uint64_t replay_start, replay_samples;
+static int replay_first_sample;
+static gboolean replay_mismatch;
+
 /*
  * Check whether sr_session_new() works.
  * If it returns != SR_OK (or segfaults) this test will fail.
@@ -185,6 +194,160 @@ START_TEST(test_session_trigger_get_null)
 }
 END_TEST
 
+/*
+ * Check whether sr_session_range_set() rejects bogus parameters, and
+ * sessions which contain no devices from a session file.
+ */
+START_TEST(test_session_range_set_bogus)
+{
+	int ret;
+	struct sr_session *sess;
+
+	ret = sr_session_range_set(NULL, 0, 100);
+	fail_unless(ret == SR_ERR_ARG);
+
+	sr_session_new(srtest_ctx, &sess);
+	ret = sr_session_range_set(sess, 100, 100);
+	fail_unless(ret == SR_ERR_ARG);
+	ret = sr_session_range_set(sess, 0, 100);
+	fail_unless(ret == SR_ERR_NA);
+	sr_session_destroy(sess);
+}
+END_TEST
+
+/* Write a session file of REPLAY_SAMPLES samples with srzip. */
+static char *session_file_new(const char *compression)
+{
+	const struct sr_output *o;
+	struct sr_dev_inst *sdi;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_meta meta;
+	struct sr_datafeed_logic logic;
+	struct sr_config src;
+	GHashTable *options;
+	GString *out;
+	uint8_t *data;
+	char *filename, name[8];
+	int i;
+
+	filename = g_build_filename(g_get_tmp_dir(),
+		"sr-session-replay-test.sr", NULL);
+
+	sdi = sr_dev_inst_user_new("test", "logic", NULL);
+	for (i = 0; i < 8; i++) {
+		snprintf(name, sizeof(name), "D%d", i);
+		sr_dev_inst_channel_add(sdi, i, SR_CHANNEL_LOGIC, name);
+	}
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, g_strdup("compression"),
+		g_variant_ref_sink(g_variant_new_string(compression)));
+	o = sr_output_new(sr_output_find("srzip"), options, sdi, filename);
+	fail_unless(o != NULL, "Failed to create srzip output.");
+
+	src.key = SR_CONF_SAMPLERATE;
+	src.data = g_variant_new_uint64(SR_MHZ(1));
+	meta.config = g_slist_append(NULL, &src);
+	packet.type = SR_DF_META;
+	packet.payload = &meta;
+	fail_unless(sr_output_send(o, &packet, &out) == SR_OK);
+	g_slist_free(meta.config);
+	g_variant_unref(src.data);
+
+	data = g_malloc(REPLAY_SAMPLES);
+	for (i = 0; i < REPLAY_SAMPLES; i++)
+		data[i] = i % 251;
+	logic.length = REPLAY_SAMPLES;
+	logic.unitsize = 1;
+	logic.data = data;
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	fail_unless(sr_output_send(o, &packet, &out) == SR_OK);
+	g_free(data);
+
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	fail_unless(sr_output_send(o, &packet, &out) == SR_OK);
+	sr_output_free(o);
+	g_hash_table_destroy(options);
+
+	return filename;
+}
+
+static void datafeed_replay(const struct sr_dev_inst *sdi,
+	const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *logic;
+	const uint8_t *data;
+	uint64_t i;
+
+	(void)sdi;
+	(void)cb_data;
+
+	if (packet->type != SR_DF_LOGIC)
+		return;
+
+	logic = packet->payload;
+	data = logic->data;
+	if (!replay_samples && logic->length)
+		replay_first_sample = data[0];
+	for (i = 0; i < logic->length; i++) {
+		if (data[i] != (replay_start + replay_samples + i) % 251)
+			replay_mismatch = TRUE;
+	}
+	replay_samples += logic->length;
+}
+
+/* Replay a sample range of a session file, check the samples sent. */
+static void check_replay_range(const char *compression,
+		uint64_t start, uint64_t end)
+{
+	struct sr_session *session;
+	char *filename;
+	int ret;
+
+	replay_start = start;
+	replay_samples = 0;
+	replay_first_sample = -1;
+	replay_mismatch = FALSE;
+
+	filename = session_file_new(compression);
+	ret = sr_session_load(srtest_ctx, filename, &session);
+	fail_unless(ret == SR_OK, "sr_session_load() failed: %d.", ret);
+	ret = sr_session_range_set(session, start, end);
+	fail_unless(ret == SR_OK, "sr_session_range_set() failed: %d.", ret);
+	sr_session_datafeed_callback_add(session, datafeed_replay, NULL);
+	ret = sr_session_start(session);
+	fail_unless(ret == SR_OK, "sr_session_start() failed: %d.", ret);
+	ret = sr_session_run(session);
+	fail_unless(ret == SR_OK, "sr_session_run() failed: %d.", ret);
+	sr_session_destroy(session);
+	g_unlink(filename);
+	g_free(filename);
+
+	fail_unless(replay_first_sample == (int)(start % 251),
+		"First sample is %d, expected %d.", replay_first_sample,
+		(int)(start % 251));
+	fail_unless(replay_samples == end - start,
+		"Replayed %" PRIu64 " samples, expected %" PRIu64 ".",
+		replay_samples, end - start);
+	fail_unless(!replay_mismatch, "Replayed samples do not match.");
+}
+
+/* Stored entries get replayed from the mapped session file. */
+START_TEST(test_session_range_stored)
+{
+	check_replay_range("store", 1234, 5678);
+}
+END_TEST
+
+/* Compressed entries get inflated, and skipped up to the range start. */
+START_TEST(test_session_range_deflated)
+{
+	check_replay_range("deflate", 60000, REPLAY_SAMPLES);
+}
+END_TEST
+
 Suite *suite_session(void)
 {
 	Suite *s;
@@ -209,5 +372,12 @@ Suite *suite_session(void)
 	tcase_add_test(tc, test_session_trigger_get_null);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("range");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_range_set_bogus);
+	tcase_add_test(tc, test_session_range_stored);
+	tcase_add_test(tc, test_session_range_deflated);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
@@ -20,6 +20,7 @@
 #include <config.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <check.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
@@ -249,6 +250,341 @@ START_TEST(test_trigger_match_add_bogus)
 }
 END_TEST
 
+/* Check whether setting stage duration qualifiers works. */
+START_TEST(test_trigger_stage_duration_set)
+{
+	int ret;
+	struct sr_trigger *t;
+	struct sr_trigger_stage *s;
+
+	t = sr_trigger_new("T");
+	s = sr_trigger_stage_add(t);
+
+	/* Stages are unqualified by default. */
+	fail_unless(s->duration == SR_TRIGGER_DURATION_NONE);
+
+	ret = sr_trigger_stage_duration_set(s, SR_TRIGGER_DURATION_AT_LEAST, 10);
+	fail_unless(ret == SR_OK);
+	fail_unless(s->duration == SR_TRIGGER_DURATION_AT_LEAST);
+	fail_unless(s->duration_samples == 10);
+
+	ret = sr_trigger_stage_duration_set(s, SR_TRIGGER_DURATION_LESS_THAN, 3);
+	fail_unless(ret == SR_OK);
+	fail_unless(s->duration == SR_TRIGGER_DURATION_LESS_THAN);
+	fail_unless(s->duration_samples == 3);
+
+	/* NULL stage, invalid qualifier, missing sample count. */
+	ret = sr_trigger_stage_duration_set(NULL, SR_TRIGGER_DURATION_AT_LEAST, 1);
+	fail_unless(ret == SR_ERR_ARG);
+	ret = sr_trigger_stage_duration_set(s, 270, 1);
+	fail_unless(ret == SR_ERR_ARG);
+	ret = sr_trigger_stage_duration_set(s, SR_TRIGGER_DURATION_AT_LEAST, 0);
+	fail_unless(ret == SR_ERR_ARG);
+	fail_unless(s->duration == SR_TRIGGER_DURATION_LESS_THAN);
+	fail_unless(s->duration_samples == 3);
+
+	ret = sr_trigger_stage_duration_set(s, SR_TRIGGER_DURATION_NONE, 0);
+	fail_unless(ret == SR_OK);
+	fail_unless(s->duration == SR_TRIGGER_DURATION_NONE);
+
+	sr_trigger_free(t);
+}
+END_TEST
+
+/*
+ * The soft trigger is checked with the demo driver's graycode pattern on
+ * 16 logic channels. Sample number n (starting at 1) carries the Gray
+ * code of n, so channel Dk is high for runs of 2^(k+1) samples, starting
+ * at n = 2^k. The trigger position is recovered from the first sample
+ * after the trigger, as there is no pre-trigger data.
+ */
+#define SOFT_NUM_CHANNELS 16
+#define SOFT_LIMIT_SAMPLES 100000
+
+static gboolean soft_triggered;
+static uint64_t soft_trigger_step;
+
+static void datafeed_soft_trigger(const struct sr_dev_inst *sdi,
+	const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *logic;
+	const uint8_t *data;
+	uint64_t step;
+	int shift;
+
+	(void)sdi;
+	(void)cb_data;
+
+	switch (packet->type) {
+	case SR_DF_TRIGGER:
+		fail_unless(!soft_triggered, "Triggered more than once.");
+		soft_triggered = TRUE;
+		break;
+	case SR_DF_LOGIC:
+		fail_unless(soft_triggered, "Logic data before the trigger.");
+		logic = packet->payload;
+		if (soft_trigger_step || !logic->length)
+			break;
+		data = logic->data;
+		step = data[0] | data[1] << 8;
+		for (shift = 1; shift < SOFT_NUM_CHANNELS; shift <<= 1)
+			step ^= step >> shift;
+		soft_trigger_step = step;
+		break;
+	default:
+		break;
+	}
+}
+
+static struct sr_dev_inst *soft_trigger_dev_new(void)
+{
+	struct sr_dev_driver *driver;
+	struct sr_dev_inst *sdi;
+	struct sr_channel_group *cg;
+	struct sr_config src[2];
+	GSList *options, *devices, *l;
+	int ret;
+
+	driver = srtest_driver_get("demo");
+	srtest_driver_init(srtest_ctx, driver);
+	src[0].key = SR_CONF_NUM_LOGIC_CHANNELS;
+	src[0].data = g_variant_new_int32(SOFT_NUM_CHANNELS);
+	src[1].key = SR_CONF_NUM_ANALOG_CHANNELS;
+	src[1].data = g_variant_new_int32(1);
+	options = g_slist_append(NULL, &src[0]);
+	options = g_slist_append(options, &src[1]);
+	devices = sr_driver_scan(driver, options);
+	g_slist_free(options);
+	g_variant_unref(src[0].data);
+	g_variant_unref(src[1].data);
+	fail_unless(devices != NULL, "No demo device found.");
+	sdi = devices->data;
+	g_slist_free(devices);
+
+	ret = sr_dev_open(sdi);
+	fail_unless(ret == SR_OK, "sr_dev_open() failed: %d.", ret);
+	ret = sr_config_set(sdi, NULL, SR_CONF_SAMPLERATE,
+		g_variant_new_uint64(SR_MHZ(10)));
+	fail_unless(ret == SR_OK, "Failed to set the samplerate: %d.", ret);
+	ret = sr_config_set(sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+		g_variant_new_uint64(SOFT_LIMIT_SAMPLES));
+	fail_unless(ret == SR_OK, "Failed to set the sample limit: %d.", ret);
+	ret = sr_config_set(sdi, NULL, SR_CONF_CAPTURE_RATIO,
+		g_variant_new_uint64(0));
+	fail_unless(ret == SR_OK, "Failed to set the capture ratio: %d.", ret);
+	for (l = sr_dev_inst_channel_groups_get(sdi); l; l = l->next) {
+		cg = l->data;
+		if (!strcmp(cg->name, "Logic"))
+			break;
+	}
+	fail_unless(l != NULL, "No logic channel group found.");
+	ret = sr_config_set(sdi, cg, SR_CONF_PATTERN_MODE,
+		g_variant_new_string("graycode"));
+	fail_unless(ret == SR_OK, "Failed to set the pattern: %d.", ret);
+
+	return sdi;
+}
+
+/* Add a stage with a single match, on the n-th channel of the device. */
+static void soft_trigger_stage_add(struct sr_trigger *trigger,
+		const struct sr_dev_inst *sdi, int channel, int match,
+		int duration, uint64_t samples)
+{
+	struct sr_trigger_stage *stage;
+	int ret;
+
+	stage = sr_trigger_stage_add(trigger);
+	ret = sr_trigger_match_add(stage,
+		g_slist_nth_data(sr_dev_inst_channels_get(sdi), channel),
+		match, 0);
+	fail_unless(ret == SR_OK, "sr_trigger_match_add() failed: %d.", ret);
+	if (duration != SR_TRIGGER_DURATION_NONE) {
+		ret = sr_trigger_stage_duration_set(stage, duration, samples);
+		fail_unless(ret == SR_OK,
+			"sr_trigger_stage_duration_set() failed: %d.", ret);
+	}
+}
+
+/*
+ * Run an acquisition with the trigger, and return the result of starting
+ * it. The trigger's sample number is kept in soft_trigger_step, or 0 if
+ * the trigger never fired.
+ */
+static int soft_trigger_run(struct sr_dev_inst *sdi,
+		struct sr_trigger *trigger)
+{
+	struct sr_session *session;
+	int ret;
+
+	soft_triggered = FALSE;
+	soft_trigger_step = 0;
+
+	sr_session_new(srtest_ctx, &session);
+	sr_session_dev_add(session, sdi);
+	sr_session_trigger_set(session, trigger);
+	sr_session_datafeed_callback_add(session, datafeed_soft_trigger, NULL);
+	ret = sr_session_start(session);
+	if (ret == SR_OK) {
+		ret = sr_session_run(session);
+		fail_unless(ret == SR_OK, "sr_session_run() failed: %d.", ret);
+	}
+	sr_session_destroy(session);
+	sr_trigger_free(trigger);
+
+	return ret;
+}
+
+static void check_soft_trigger(struct sr_dev_inst *sdi,
+		struct sr_trigger *trigger, uint64_t expected)
+{
+	int ret;
+
+	ret = soft_trigger_run(sdi, trigger);
+	fail_unless(ret == SR_OK, "sr_session_start() failed: %d.", ret);
+	fail_unless(soft_triggered, "Trigger did not fire.");
+	fail_unless(soft_trigger_step == expected,
+		"Triggered on sample %" PRIu64 ", expected %" PRIu64 ".",
+		soft_trigger_step, expected);
+}
+
+/* Check duration qualified stages with runs shorter than a buffer. */
+START_TEST(test_soft_trigger_duration)
+{
+	struct sr_dev_inst *sdi;
+	struct sr_trigger *t;
+
+	sdi = soft_trigger_dev_new();
+
+	/* D3 is high from 8 to 23, the 10th sample of that is 17. */
+	t = sr_trigger_new("T");
+	soft_trigger_stage_add(t, sdi, 3, SR_TRIGGER_ONE,
+		SR_TRIGGER_DURATION_AT_LEAST, 10);
+	check_soft_trigger(sdi, t, 17);
+
+	/*
+	 * D0 is high on 1-2 and 5-6. The first pulse already holds on the
+	 * first sample and has an unknown width, the second one ends on 7.
+	 */
+	t = sr_trigger_new("T");
+	soft_trigger_stage_add(t, sdi, 0, SR_TRIGGER_ONE,
+		SR_TRIGGER_DURATION_LESS_THAN, 3);
+	check_soft_trigger(sdi, t, 7);
+
+	sr_dev_close(sdi);
+}
+END_TEST
+
+/* Check duration qualified stages with runs spanning several buffers. */
+START_TEST(test_soft_trigger_duration_buffers)
+{
+	struct sr_dev_inst *sdi;
+	struct sr_trigger *t;
+
+	sdi = soft_trigger_dev_new();
+
+	/* D13 is high from 8192 on, for 16384 samples. */
+	t = sr_trigger_new("T");
+	soft_trigger_stage_add(t, sdi, 13, SR_TRIGGER_ONE,
+		SR_TRIGGER_DURATION_AT_LEAST, 10000);
+	check_soft_trigger(sdi, t, 8192 + 10000 - 1);
+
+	/* D12 is high from 4096 to 12287, and low on 12288. */
+	t = sr_trigger_new("T");
+	soft_trigger_stage_add(t, sdi, 12, SR_TRIGGER_ONE,
+		SR_TRIGGER_DURATION_LESS_THAN, 10000);
+	check_soft_trigger(sdi, t, 12288);
+
+	/* No run of D12 is shorter than 8192 samples. */
+	t = sr_trigger_new("T");
+	soft_trigger_stage_add(t, sdi, 12, SR_TRIGGER_ONE,
+		SR_TRIGGER_DURATION_LESS_THAN, 8192);
+	fail_unless(soft_trigger_run(sdi, t) == SR_OK);
+	fail_unless(!soft_triggered, "Trigger fired on a long pulse.");
+
+	sr_dev_close(sdi);
+}
+END_TEST
+
+/* Check that a failed stage restarts after the first stage's match. */
+START_TEST(test_soft_trigger_rewind)
+{
+	struct sr_dev_inst *sdi;
+	struct sr_trigger *t;
+
+	sdi = soft_trigger_dev_new();
+
+	/*
+	 * D0 is 1, 1, 0 on samples 1-3. Stage 1 fails on sample 2, which
+	 * must then match stage 0 again.
+	 */
+	t = sr_trigger_new("T");
+	soft_trigger_stage_add(t, sdi, 0, SR_TRIGGER_ONE,
+		SR_TRIGGER_DURATION_NONE, 0);
+	soft_trigger_stage_add(t, sdi, 0, SR_TRIGGER_ZERO,
+		SR_TRIGGER_DURATION_NONE, 0);
+	check_soft_trigger(sdi, t, 3);
+
+	/*
+	 * The qualified stage 1 fails until D13 rises on 8192. The level
+	 * must then be held for 10000 samples after the previous stage
+	 * matched. The last match of D0 is on 8193, so the samples are
+	 * counted from 8194 on, the earlier high level of D13 on 8192 and
+	 * 8193 doesn't count.
+	 */
+	t = sr_trigger_new("T");
+	soft_trigger_stage_add(t, sdi, 0, SR_TRIGGER_ONE,
+		SR_TRIGGER_DURATION_NONE, 0);
+	soft_trigger_stage_add(t, sdi, 13, SR_TRIGGER_ONE,
+		SR_TRIGGER_DURATION_AT_LEAST, 10000);
+	check_soft_trigger(sdi, t, 8194 + 10000 - 1);
+
+	sr_dev_close(sdi);
+}
+END_TEST
+
+/* Check that stages the soft trigger cannot handle fail at setup. */
+START_TEST(test_soft_trigger_invalid)
+{
+	struct sr_dev_inst *sdi;
+	struct sr_trigger *t;
+	struct sr_trigger_stage *stage;
+	struct sr_channel *ch;
+	int ret;
+
+	sdi = soft_trigger_dev_new();
+	ch = g_slist_nth_data(sr_dev_inst_channels_get(sdi), 0);
+
+	/* A duration qualifier on an edge match, in either order. */
+	t = sr_trigger_new("T");
+	stage = sr_trigger_stage_add(t);
+	ret = sr_trigger_stage_duration_set(stage,
+		SR_TRIGGER_DURATION_AT_LEAST, 3);
+	fail_unless(ret == SR_OK);
+	ret = sr_trigger_match_add(stage, ch, SR_TRIGGER_RISING, 0);
+	fail_unless(ret == SR_ERR_ARG, "Qualified edge match was accepted.");
+	ret = sr_trigger_match_add(stage, ch, SR_TRIGGER_ONE, 0);
+	fail_unless(ret == SR_OK);
+	stage = sr_trigger_stage_add(t);
+	ret = sr_trigger_match_add(stage, ch, SR_TRIGGER_FALLING, 0);
+	fail_unless(ret == SR_OK);
+	ret = sr_trigger_stage_duration_set(stage,
+		SR_TRIGGER_DURATION_LESS_THAN, 3);
+	fail_unless(ret == SR_ERR_ARG, "Qualified edge match was accepted.");
+	fail_unless(stage->duration == SR_TRIGGER_DURATION_NONE);
+	sr_trigger_free(t);
+
+	/* The soft trigger ignores analog matches, it never fires. */
+	t = sr_trigger_new("T");
+	soft_trigger_stage_add(t, sdi, SOFT_NUM_CHANNELS, SR_TRIGGER_OVER,
+		SR_TRIGGER_DURATION_NONE, 0);
+	ret = soft_trigger_run(sdi, t);
+	fail_unless(ret == SR_OK, "sr_session_start() failed: %d.", ret);
+	fail_unless(!soft_triggered, "Analog match fired the trigger.");
+
+	sr_dev_close(sdi);
+}
+END_TEST
+
 Suite *suite_trigger(void)
 {
 	Suite *s;
@@ -267,6 +603,7 @@ Suite *suite_trigger(void)
 	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
 	tcase_add_test(tc, test_trigger_stage_add);
 	tcase_add_test(tc, test_trigger_stage_add_null);
+	tcase_add_test(tc, test_trigger_stage_duration_set);
 	suite_add_tcase(s, tc);
 
 	tc = tcase_create("match");
@@ -276,5 +613,13 @@ Suite *suite_trigger(void)
 	tcase_add_test(tc, test_trigger_match_add_bogus);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("soft");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_soft_trigger_duration);
+	tcase_add_test(tc, test_soft_trigger_duration_buffers);
+	tcase_add_test(tc, test_soft_trigger_rewind);
+	tcase_add_test(tc, test_soft_trigger_invalid);
+	suite_add_tcase(s, tc);
+
 	return s;
 }